@@ -66,9 +66,9 @@ void LoaderThread::loadTSImage()
     // Obtain the number of blocks in the image by reading the image's block count
     knoxcrypt::ContainerImageStream stream(m_io, std::ios::in | std::ios::binary);
     m_io->blocks = knoxcrypt::detail::getBlockCount(stream);
-    m_io->freeBlocks = m_io->blocks - knoxcrypt::detail::getNumberOfAllocatedBlocks(stream);
-    m_io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(m_io);
     stream.close();
+    (void)knoxcrypt::detail::initFreeBlocksOnMount(m_io);
+    m_io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(m_io);
 
     // Create the basic file system
     m_knoxcrypt = std::make_shared<knoxcrypt::knoxcrypt>(m_io);
@@ -146,9 +146,19 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    unmountContainer();
     delete ui;
 }
 
+void MainWindow::unmountContainer()
+{
+    // the next load can then skip counting the container's allocated blocks
+    if (m_knoxcrypt) {
+        m_knoxcrypt->unmount();
+        m_knoxcrypt.reset();
+    }
+}
+
 void MainWindow::loadFileButtonHandler()
 {
     QFileDialog dlg( NULL, tr("Open container"));
@@ -159,8 +169,8 @@ void MainWindow::loadFileButtonHandler()
 
         // reset state
         ui->fileTree->clear();
+        unmountContainer();
         cryptostreampp::IByteTransformer::m_init = false;
-        m_knoxcrypt.reset();
         std::set<std::string>().swap(m_populatedSet);
 
         // build new state
@@ -205,8 +215,8 @@ void MainWindow::newButtonHandler()
 
         // reset state
         ui->fileTree->clear();
+        unmountContainer();
         cryptostreampp::IByteTransformer::m_init = false;
-        m_knoxcrypt.reset();
         std::set<std::string>().swap(m_populatedSet);
 
         // build new state
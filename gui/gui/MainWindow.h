@@ -131,6 +131,12 @@ class MainWindow : public QMainWindow
     std::shared_ptr<QMovie> m_spinner;
     void doWork(WorkType workType);
     void createRootFolderInTree();
+
+    /**
+     * @brief unmounts any loaded container so that it is recorded as
+     * cleanly unmounted, then lets go of it
+     */
+    void unmountContainer();
 };
 
 #endif // MAINWINDOW_H
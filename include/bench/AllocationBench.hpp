@@ -0,0 +1,152 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/AllocationGroups.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/ExtentAllocator.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief threads that each write a file allocate its blocks one at a time,
+ * either from one extent allocator behind a single lock or from the
+ * allocation groups
+ */
+class AllocationBench
+{
+  public:
+    AllocationBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("AllocationBench");
+        for (int const threads : {1, 2, 4, 8}) {
+            double const single = benchSingleLock(threads);
+            double const grouped = benchAllocationGroups(threads);
+            report(boost::str(boost::format("%1% threads, single lock") % threads), single, single);
+            report(boost::str(boost::format("%1% threads, allocation groups") % threads), grouped, single);
+        }
+    }
+
+    ~AllocationBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const BLOCKS = 32 * knoxcrypt::AllocationGroups::GROUP_BLOCKS;
+    static uint64_t const BLOCKS_PER_FILE = 512;
+    static uint64_t const FILES_PER_THREAD = 64;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createImage()
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = (m_uniquePath / boost::filesystem::unique_path()).string();
+        io->blocks = BLOCKS;
+        io->freeBlocks = BLOCKS;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        io->useBlockCache = true;
+        return io;
+    }
+
+    /// runs writer threads, each allocating and registering the blocks of its files
+    template <typename Allocate>
+    double runWriters(int const threads, knoxcrypt::SharedCoreIO const &io,
+                      knoxcrypt::VolumeBitMap &bitMap, Allocate const &allocate)
+    {
+        return timeIt([&]{
+            std::vector<std::thread> writers;
+            for (int t = 0; t < threads; ++t) {
+                writers.emplace_back([&]{
+                    for (uint64_t f = 0; f < FILES_PER_THREAD; ++f) {
+                        knoxcrypt::VolumeBitMap::OptionalBlock goal;
+                        for (uint64_t b = 0; b < BLOCKS_PER_FILE; ++b) {
+                            uint64_t const block = *allocate(goal, BLOCKS_PER_FILE - b);
+                            bitMap.setBlockInUse(io, block);
+                            goal = knoxcrypt::VolumeBitMap::OptionalBlock(block + 1);
+                        }
+                    }
+                });
+            }
+            for (auto & writer : writers) {
+                writer.join();
+            }
+        }, 1);
+    }
+
+    double benchSingleLock(int const threads)
+    {
+        auto io(createImage());
+        knoxcrypt::VolumeBitMap bitMap;
+        knoxcrypt::ExtentAllocator allocator;
+        std::mutex mutex;
+        return runWriters(threads, io, bitMap, [&](knoxcrypt::VolumeBitMap::OptionalBlock const &goal,
+                                                   uint64_t const blocksExpected) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return allocator.allocate(io, bitMap, goal, blocksExpected);
+        });
+    }
+
+    double benchAllocationGroups(int const threads)
+    {
+        auto io(createImage());
+        knoxcrypt::VolumeBitMap bitMap;
+        knoxcrypt::AllocationGroups groups;
+        return runWriters(threads, io, bitMap, [&](knoxcrypt::VolumeBitMap::OptionalBlock const &goal,
+                                                   uint64_t const blocksExpected) {
+            return groups.allocate(io, bitMap, goal, blocksExpected);
+        });
+    }
+};
@@ -0,0 +1,191 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/detail/DetailBitMap.hpp"
+#include "knoxcrypt/detail/DetailKnoxCrypt.hpp"
+#include "bench/SimpleBench.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief compares the word / AVX2 bitmap kernels against the byte-at-a-time
+ * loops that they replaced, on a bitmap the size of a 256GB container
+ */
+class BitMapScanBench
+{
+  public:
+    BitMapScanBench()
+    : m_bitMap(BLOCKS / 8, 0xFF)
+    {
+        // a mostly allocated volume with a sprinkling of free blocks
+        // and a single free run towards the end
+        std::mt19937_64 generator(1);
+        for (uint64_t i = 0; i < m_bitMap.size(); i += 4096) {
+            m_bitMap[i + (generator() % 4096)] = uint8_t(generator());
+        }
+        for (uint64_t i = m_bitMap.size() - 64; i < m_bitMap.size() - 32; ++i) {
+            m_bitMap[i] = 0;
+        }
+        // block 0 is always the root folder
+        m_bitMap[0] = 0xFF;
+
+        heading("BitMapScanBench");
+        benchCountAllocated();
+        benchNextAvailable();
+        benchNAvailable();
+        benchAvailableRun();
+    }
+
+  private:
+
+    static uint64_t const BLOCKS = uint64_t(64) * 1024 * 1024;
+    static int const RUNS = 10;
+
+    std::vector<uint8_t> m_bitMap;
+
+    uint64_t byteLoopCountAllocated()
+    {
+        uint64_t allocatedBlocks(0);
+        for (uint64_t byte = 0; byte < m_bitMap.size(); ++byte) {
+            uint8_t dat = m_bitMap[byte];
+            if (dat == 0xFF) {
+                allocatedBlocks += 8;
+                continue;
+            }
+            for (int i = 0; i < 8; ++i) {
+                if (knoxcrypt::detail::isBitSetInByte(dat, i)) {
+                    ++allocatedBlocks;
+                }
+            }
+        }
+        return allocatedBlocks;
+    }
+
+    uint64_t byteLoopNextAvailable(std::vector<uint8_t> &bitMap)
+    {
+        for (uint64_t i = 0; i < bitMap.size(); ++i) {
+            int availableBit = knoxcrypt::detail::getNextAvailableBitInAByte(bitMap[i]);
+            if (availableBit > -1) {
+                return (i * 8) + availableBit;
+            }
+        }
+        return knoxcrypt::detail::NO_BIT;
+    }
+
+    std::vector<uint64_t> byteLoopNAvailable(uint64_t const blocksRequired)
+    {
+        std::vector<uint64_t> available;
+        for (uint64_t i = 0; i < m_bitMap.size() && available.size() < blocksRequired; ++i) {
+            if (m_bitMap[i] != 0xFF) {
+                for (int b = 0; b < 8 && available.size() < blocksRequired; ++b) {
+                    if (!knoxcrypt::detail::isBitSetInByte(m_bitMap[i], b)) {
+                        available.push_back((i * 8) + b);
+                    }
+                }
+            }
+        }
+        return available;
+    }
+
+    uint64_t byteLoopAvailableRun(uint64_t const runLength)
+    {
+        uint64_t runStart(0);
+        uint64_t run(0);
+        for (uint64_t i = 0; i < m_bitMap.size(); ++i) {
+            for (int b = 0; b < 8; ++b) {
+                if (knoxcrypt::detail::isBitSetInByte(m_bitMap[i], b)) {
+                    run = 0;
+                } else {
+                    if (run == 0) {
+                        runStart = (i * 8) + b;
+                    }
+                    if (++run == runLength) {
+                        return runStart;
+                    }
+                }
+            }
+        }
+        return knoxcrypt::detail::NO_BIT;
+    }
+
+    void benchCountAllocated()
+    {
+        double const bytes = timeIt([&]{ sink += byteLoopCountAllocated(); }, RUNS);
+        double const words = timeIt([&]{
+            sink += knoxcrypt::detail::countSetBits(m_bitMap.data(), m_bitMap.size());
+        }, RUNS);
+        report("count allocated blocks, byte loop", bytes, bytes);
+        report("count allocated blocks, popcount", words, bytes);
+    }
+
+    void benchNextAvailable()
+    {
+        // worst case; a full volume with only the final block free
+        std::vector<uint8_t> full(m_bitMap.size(), 0xFF);
+        full.back() = 0x7F;
+        double const bytes = timeIt([&]{ sink += byteLoopNextAvailable(full); }, RUNS);
+        double const words = timeIt([&]{
+            sink += knoxcrypt::detail::findFirstUnsetBit(full.data(), full.size());
+        }, RUNS);
+        report("next available block of full volume, byte loop", bytes, bytes);
+        report("next available block of full volume, vector compare", words, bytes);
+    }
+
+    void benchNAvailable()
+    {
+        uint64_t const required = 10000;
+        double const bytes = timeIt([&]{ sink += byteLoopNAvailable(required).size(); }, RUNS);
+        double const words = timeIt([&]{
+            uint64_t found(0);
+            uint64_t bit = knoxcrypt::detail::findFirstUnsetBit(m_bitMap.data(), m_bitMap.size());
+            while (found < required && bit != knoxcrypt::detail::NO_BIT) {
+                ++found;
+                bit = knoxcrypt::detail::findFirstUnsetBit(m_bitMap.data(), m_bitMap.size(), bit + 1);
+            }
+            sink += found;
+        }, RUNS);
+        report("10000 available blocks, byte loop", bytes, bytes);
+        report("10000 available blocks, ctz", words, bytes);
+    }
+
+    void benchAvailableRun()
+    {
+        uint64_t const runLength = 200;
+        double const bytes = timeIt([&]{ sink += byteLoopAvailableRun(runLength); }, RUNS);
+        double const words = timeIt([&]{
+            sink += knoxcrypt::detail::findFirstUnsetRun(m_bitMap.data(), m_bitMap.size(), runLength);
+        }, RUNS);
+        report("run of 200 available blocks, byte loop", bytes, bytes);
+        report("run of 200 available blocks, zero-run search", words, bytes);
+    }
+};
@@ -0,0 +1,136 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/FileBlock.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief measures how quickly block headers and small amounts of block data
+ * are read from random blocks of the image, as when many small files are
+ * read. Each block is opened through the one image stream, as a file's
+ * blocks are.
+ */
+class BlockHeaderBench
+{
+  public:
+    BlockHeaderBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("BlockHeaderBench");
+        for (bool const useBlockCache : {false, true}) {
+            bench(useBlockCache);
+        }
+    }
+
+    ~BlockHeaderBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 32 * 1024 * 1024;
+    static int const BLOCKS_READ = 200000;
+    static std::streamsize const DATA_BYTES = 64;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(bool const useBlockCache)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(path)).buildImage();
+        }
+        auto io(createIO(path));
+        io->useBlockCache = useBlockCache;
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint64_t> blocks(0, io->blocks - 1);
+        std::vector<uint64_t> indices(BLOCKS_READ);
+        for (auto &index : indices) {
+            index = blocks(rng);
+        }
+
+        knoxcrypt::SharedImageStream stream;
+        double const headerSeconds = timeIt([&]{
+            for (auto const index : indices) {
+                knoxcrypt::FileBlock block(io, index, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(), stream);
+                stream = block.getStream();
+                sink += block.getNextIndex();
+            }
+        }, 1);
+
+        // each block's header and then the start of its data
+        std::vector<char> data(DATA_BYTES);
+        double const dataSeconds = timeIt([&]{
+            for (auto const index : indices) {
+                knoxcrypt::FileBlock block(io, index, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(), stream);
+                sink += block.read(&data.front(), DATA_BYTES);
+            }
+        }, 1);
+
+        std::cout<<boost::format("%1% %|24t|%2$10.0f headers/s %|48t|%3$10.0f header+data reads/s\n")
+            % (useBlockCache ? "shared stream" : "stream per io")
+            % (BLOCKS_READ / headerSeconds) % (BLOCKS_READ / dataSeconds);
+    }
+};
@@ -0,0 +1,131 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief times writing one large file sequentially and reading it back in
+ * containers of differing block sizes. Larger blocks mean fewer blocks to
+ * allocate, chain and write headers for.
+ */
+class BlockSizeBench
+{
+  public:
+    BlockSizeBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("BlockSizeBench");
+        for (uint64_t blockSize = 4096; blockSize <= 1024 * 1024; blockSize *= 4) {
+            bench(blockSize);
+        }
+    }
+
+    ~BlockSizeBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 96 * 1024 * 1024;
+    static uint64_t const FILE_BYTES = 64 * 1024 * 1024;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path, uint64_t const blockSize)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / blockSize;
+        io->freeBlocks = io->blocks;
+        io->blockSize = blockSize;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(uint64_t const blockSize)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            auto io(createIO(path, blockSize));
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+
+        auto io(createIO(path, blockSize));
+        io->useBlockCache = true;
+        io->freeBlocks = io->blocks - 1;
+
+        // sequential writes in the 128K chunks a FUSE write typically arrives in
+        std::vector<char> chunk(128 * 1024, 'x');
+        uint64_t startBlock;
+        double const writeSeconds = timeIt([&]{
+            knoxcrypt::File file(io, "file");
+            for (uint64_t written = 0; written < FILE_BYTES; written += chunk.size()) {
+                (void)file.write(&chunk.front(), chunk.size());
+            }
+            file.flush();
+            startBlock = file.getStartVolumeBlockIndex();
+        }, 1);
+
+        double const readSeconds = timeIt([&]{
+            knoxcrypt::File file(io, "file", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+            for (uint64_t read = 0; read < FILE_BYTES; read += chunk.size()) {
+                sink += file.read(&chunk.front(), chunk.size());
+            }
+        }, 3);
+
+        double const megabytes = double(FILE_BYTES) / (1024 * 1024);
+        std::cout<<boost::format("%1% byte blocks %|24t|%2$8.1f MB/s write %|44t|%3$8.1f MB/s read\n")
+            % blockSize % (megabytes / writeSeconds) % (megabytes / readSeconds);
+    }
+};
@@ -0,0 +1,192 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreFS.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/FileBlockIterator.hpp"
+#include "knoxcrypt/detail/DetailFileBlock.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief fills a container, deletes half of it and rewrites what was
+ * deleted. Files are written two at a time in 128K chunks, as with two
+ * concurrent copies through fuse. The resulting layout and the read
+ * throughput are compared for the block deque and the extent allocator.
+ */
+class FragmentationBench
+{
+  public:
+    FragmentationBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    , m_chunk(CHUNK_BYTES, 'x')
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("FragmentationBench");
+        bench(false, "block deque");
+        bench(true, "extent allocator");
+    }
+
+    ~FragmentationBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const BLOCKS = 16384;
+    static uint64_t const CHUNK_BYTES = 128 * 1024;
+    static int const FILES = 48;
+
+    boost::filesystem::path m_uniquePath;
+    std::string m_chunk;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = BLOCKS;
+        io->freeBlocks = BLOCKS;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    std::string fileName(int const i)
+    {
+        return boost::str(boost::format("/file%1%") % i);
+    }
+
+    /// writes a pair of files by alternating 128K chunks between them
+    void writePair(knoxcrypt::CoreFS &fs, int const a, int const b, std::vector<uint64_t> const &sizes)
+    {
+        fs.addFile(fileName(a));
+        fs.addFile(fileName(b));
+        uint64_t const most = std::max(sizes[a], sizes[b]);
+        for (uint64_t written = 0; written < most; written += CHUNK_BYTES) {
+            for (int const i : {a, b}) {
+                if (written < sizes[i]) {
+                    auto device = fs.openFile(fileName(i), knoxcrypt::OpenDisposition::buildAppendDisposition());
+                    (void)device.write(m_chunk.c_str(), std::min(CHUNK_BYTES, sizes[i] - written));
+                }
+            }
+        }
+    }
+
+    uint64_t countFragments(knoxcrypt::SharedCoreIO const &io, knoxcrypt::CoreFS &fs, int const i)
+    {
+        auto info = fs.getInfo(fileName(i));
+        knoxcrypt::FileBlockIterator it(io, info.firstFileBlock(),
+                                        knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        knoxcrypt::FileBlockIterator end;
+        uint64_t fragments(0);
+        uint64_t last(0);
+        for (; it != end; ++it) {
+            if (fragments == 0 || it->getIndex() != last + 1) {
+                ++fragments;
+            }
+            last = it->getIndex();
+        }
+        return fragments;
+    }
+
+    void bench(bool const useExtentAllocation, std::string const &name)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            auto io(createIO(path));
+            knoxcrypt::MakeKnoxCrypt(io).buildImage();
+        }
+
+        auto io(createIO(path));
+        io->useBlockCache = true;
+        io->useExtentAllocation = useExtentAllocation;
+        io->freeBlocks = BLOCKS - 1;
+        knoxcrypt::CoreFS fs(io);
+
+        // file sizes between 256K and 2M; about 75% of the container
+        std::mt19937 generator(1);
+        std::uniform_int_distribution<uint64_t> distribution(256 * 1024, 2 * 1024 * 1024);
+        std::vector<uint64_t> sizes(FILES);
+        for (auto & size : sizes) {
+            size = distribution(generator);
+        }
+
+        // fill, delete every other file and rewrite the deleted files
+        for (int i = 0; i < FILES; i += 2) {
+            writePair(fs, i, i + 1, sizes);
+        }
+        for (int i = 0; i < FILES; i += 2) {
+            fs.removeFile(fileName(i));
+        }
+        for (int i = 0; i < FILES; i += 4) {
+            writePair(fs, i, i + 2, sizes);
+        }
+
+        uint64_t fragments(0);
+        uint64_t bytes(0);
+        for (int i = 0; i < FILES; ++i) {
+            fragments += countFragments(io, fs, i);
+            bytes += sizes[i];
+        }
+
+        std::vector<char> buffer(CHUNK_BYTES);
+        double const seconds = timeIt([&]{
+            for (int i = 0; i < FILES; ++i) {
+                auto device = fs.openFile(fileName(i), knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+                while (device.read(&buffer.front(), CHUNK_BYTES) > 0) {
+                    sink += buffer[0];
+                }
+            }
+        }, 3);
+
+        std::cout<<boost::format("%1% %|30t|%2$6.1f fragments per file %|60t|%3$8.1f MB/s read\n")
+            % name % (double(fragments) / FILES) % ((bytes / (1024.0 * 1024.0)) / seconds);
+    }
+};
@@ -0,0 +1,122 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief measures sequential reads and writes of the image through the
+ * shared stream in transfers of growing size, where the ciphering dominates
+ */
+class LargeTransferBench
+{
+  public:
+    LargeTransferBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("LargeTransferBench");
+        for (std::streamsize const bytes : {64 * 1024, 256 * 1024, 1024 * 1024}) {
+            bench(bytes);
+        }
+    }
+
+    ~LargeTransferBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 64 * 1024 * 1024;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(std::streamsize const transferBytes)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(path)).buildImage();
+        }
+        auto io(createIO(path));
+        io->useBlockCache = true;
+
+        // the image in transfers of the given size, leaving the last one spare
+        std::streamoff const transfers = (CONTAINER_BYTES - transferBytes) / transferBytes;
+        std::vector<char> data(transferBytes, 'x');
+        knoxcrypt::ContainerImageStream stream(io, std::ios::in | std::ios::out | std::ios::binary);
+        double const writeSeconds = timeIt([&]{
+            for (std::streamoff t = 0; t < transfers; ++t) {
+                (void)stream.writeAt(&data.front(), transferBytes, t * transferBytes);
+            }
+            stream.flush();
+        }, 1);
+        double const readSeconds = timeIt([&]{
+            for (std::streamoff t = 0; t < transfers; ++t) {
+                (void)stream.readAt(&data.front(), transferBytes, t * transferBytes);
+                sink += data[t % transferBytes];
+            }
+        }, 1);
+
+        double const megabytes = double(transfers * transferBytes) / (1024 * 1024);
+        std::cout<<boost::format("%1% KiB transfers %|20t|%2$8.0f MB/s written %|44t|%3$8.0f MB/s read\n")
+            % (transferBytes / 1024) % (megabytes / writeSeconds) % (megabytes / readSeconds);
+    }
+};
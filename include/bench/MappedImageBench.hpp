@@ -0,0 +1,145 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/detail/DetailFileBlock.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief compares the shared image stream with and without io->mapImage.
+ * Block headers are read from random blocks twice over, the first time
+ * with nothing yet decrypted in to the cache, and then small updates are
+ * written to random blocks and synced. The blocks are drawn from the
+ * whole image, which is larger than the cache, and then from a span the
+ * size of the cache.
+ */
+class MappedImageBench
+{
+  public:
+    MappedImageBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("MappedImageBench");
+        for (uint64_t const span : {CONTAINER_BYTES, CACHE_BYTES}) {
+            for (bool const mapImage : {false, true}) {
+                bench(mapImage, span);
+            }
+        }
+    }
+
+    ~MappedImageBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 32 * 1024 * 1024;
+    static uint64_t const CACHE_BYTES = 4 * 1024 * 1024;
+    static int const ACCESSES = 200000;
+    static std::streamsize const DATA_BYTES = 64;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(bool const mapImage, uint64_t const span)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(path)).buildImage();
+        }
+        auto io(createIO(path));
+        io->useBlockCache = true;
+        io->mapImage = mapImage;
+        io->mapImageBytes = CACHE_BYTES;
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint64_t> blocks(0, span / io->blockSize - 1);
+        std::vector<uint64_t> offsets(ACCESSES);
+        for (auto &offset : offsets) {
+            offset = knoxcrypt::detail::getOffsetOfFileBlock(blocks(rng), io->blocks, io->blockSize);
+        }
+
+        knoxcrypt::ContainerImageStream stream(io, std::ios::in | std::ios::out | std::ios::binary);
+        uint8_t header[knoxcrypt::detail::FILE_BLOCK_META];
+        auto const readHeaders = [&]{
+            for (auto const offset : offsets) {
+                (void)stream.readAt((char*)header, knoxcrypt::detail::FILE_BLOCK_META, offset);
+                sink += header[0];
+            }
+        };
+        double const coldSeconds = timeIt(readHeaders, 1);
+        double const warmSeconds = timeIt(readHeaders, 1);
+
+        // updates land after each header, as small writes to a block do
+        std::vector<char> data(DATA_BYTES, 'x');
+        double const writeSeconds = timeIt([&]{
+            for (auto const offset : offsets) {
+                (void)stream.writeAt(&data.front(), DATA_BYTES, offset + knoxcrypt::detail::FILE_BLOCK_META);
+            }
+            knoxcrypt::ContainerImageStream::sync(io);
+        }, 1);
+
+        std::cout<<boost::format("%1% %2%MB %|16t|%3$10.0f cold reads/s %|40t|%4$10.0f warm reads/s %|64t|%5$10.0f writes/s\n")
+            % (mapImage ? "mapped" : "fstream") % (span / (1024 * 1024))
+            % (ACCESSES / coldSeconds) % (ACCESSES / warmSeconds) % (ACCESSES / writeSeconds);
+    }
+};
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/FileDevice.hpp"
+#include "bench/AllocationCounter.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief counts the heap allocations made per MB read from a file, both
+ * through File::read and through a FileDevice. A file laid out in
+ * consecutive blocks and one whose blocks are interleaved with another
+ * file's are read so that both the block run and the block by block
+ * paths are measured.
+ */
+class ReadAllocationBench
+{
+  public:
+    ReadAllocationBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    , m_path(m_uniquePath / boost::filesystem::unique_path())
+    , m_io()
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("ReadAllocationBench");
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(), true).buildImage();
+        }
+        m_io = createIO();
+        m_io->useBlockCache = true;
+        m_io->freeBlocks = m_io->blocks - 1;
+
+        uint64_t const consecutive = writeFiles(FILE_BYTES);
+        uint64_t const interleaved = writeFiles(4096);
+        for (uint64_t const chunkBytes : {uint64_t(4 * 1024), uint64_t(128 * 1024)}) {
+            bench("consecutive blocks", consecutive, chunkBytes);
+            bench("interleaved blocks", interleaved, chunkBytes);
+        }
+    }
+
+    ~ReadAllocationBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 96 * 1024 * 1024;
+    static uint64_t const FILE_BYTES = 16 * 1024 * 1024;
+
+    boost::filesystem::path m_uniquePath;
+    boost::filesystem::path m_path;
+    knoxcrypt::SharedCoreIO m_io;
+
+    knoxcrypt::SharedCoreIO createIO()
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = m_path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    /// writes two files a chunk at a time in turn and returns the start
+    /// block of the first; small chunks interleave their blocks
+    uint64_t writeFiles(uint64_t const chunkBytes)
+    {
+        std::vector<char> chunk(chunkBytes, 'x');
+        knoxcrypt::File first(m_io, "first");
+        knoxcrypt::File second(m_io, "second");
+        for (uint64_t written = 0; written < FILE_BYTES; written += chunk.size()) {
+            (void)first.write(&chunk.front(), chunk.size());
+            first.flush();
+            if (chunkBytes < FILE_BYTES) {
+                (void)second.write(&chunk.front(), chunk.size());
+                second.flush();
+            }
+        }
+        return first.getStartVolumeBlockIndex();
+    }
+
+    void bench(std::string const &layout, uint64_t const startBlock, uint64_t const chunkBytes)
+    {
+        std::vector<char> chunk(chunkBytes);
+        double const megabytes = double(FILE_BYTES) / (1024 * 1024);
+        auto const disposition = knoxcrypt::OpenDisposition::buildReadOnlyDisposition();
+
+        knoxcrypt::File file(m_io, "first", startBlock, disposition);
+        uint64_t fileAllocations;
+        {
+            AllocationCounter counter;
+            for (uint64_t read = 0; read < FILE_BYTES; read += chunk.size()) {
+                sink += file.read(&chunk.front(), chunk.size());
+            }
+            fileAllocations = counter.count();
+        }
+
+        knoxcrypt::FileDevice device(std::make_shared<knoxcrypt::File>(m_io, "first", startBlock, disposition));
+        uint64_t deviceAllocations;
+        {
+            AllocationCounter counter;
+            for (uint64_t read = 0; read < FILE_BYTES; read += chunk.size()) {
+                sink += device.read(&chunk.front(), chunk.size());
+            }
+            deviceAllocations = counter.count();
+        }
+
+        std::cout<<boost::format("%1%, %2% byte reads %|40t|%3$8.2f allocs/MB File %|64t|%4$8.2f allocs/MB FileDevice\n")
+            % layout % chunkBytes % (fileAllocations / megabytes) % (deviceAllocations / megabytes);
+    }
+};
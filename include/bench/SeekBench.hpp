@@ -0,0 +1,156 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief writes one large file and times opening it and reading from its
+ * end, then reading 4K from random offsets of the open file, then opening it
+ * to append a short record. Chained files have to walk their blocks on
+ * opening unless given a recorded tail; indexed files read the extent index.
+ */
+class SeekBench
+{
+  public:
+    SeekBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("SeekBench");
+        bench(knoxcrypt::FileLayout::Chained, "chained", false);
+        bench(knoxcrypt::FileLayout::Chained, "chained, tail recorded", true);
+        bench(knoxcrypt::FileLayout::Indexed, "indexed", false);
+    }
+
+    ~SeekBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const BLOCKS = 16384;
+    static uint64_t const FILE_BYTES = 48 * 1024 * 1024;
+    static int const READS = 1000;
+    static int const APPENDS = 20;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = BLOCKS;
+        io->freeBlocks = BLOCKS;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(knoxcrypt::FileLayout const layout, std::string const &name, bool const recordTail)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            auto io(createIO(path));
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+
+        auto io(createIO(path));
+        io->useBlockCache = true;
+        io->freeBlocks = BLOCKS - 1;
+
+        uint64_t startBlock;
+        {
+            std::string const chunk(1024 * 1024, 'x');
+            knoxcrypt::File file(io, "file", false, layout);
+            for (uint64_t written = 0; written < FILE_BYTES; written += chunk.length()) {
+                (void)file.write(chunk.c_str(), chunk.length());
+            }
+            file.flush();
+            startBlock = file.getStartVolumeBlockIndex();
+        }
+
+        std::vector<char> buffer(4096);
+        double const openSeconds = timeIt([&]{
+            knoxcrypt::File file(io, "file", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(), layout);
+            (void)file.seek(-4096, std::ios::end);
+            sink += file.read(&buffer.front(), buffer.size());
+        }, 5);
+
+        knoxcrypt::File file(io, "file", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(), layout);
+        std::mt19937 generator(1);
+        std::uniform_int_distribution<uint64_t> distribution(0, FILE_BYTES - buffer.size());
+        double const readSeconds = timeIt([&]{
+            for (int i = 0; i < READS; ++i) {
+                (void)file.seek(distribution(generator));
+                sink += file.read(&buffer.front(), buffer.size());
+            }
+        }, 3);
+
+        // log-style appends: open, append a line and close
+        std::string const line(100, 'y');
+        knoxcrypt::OptionalSizeRecord record;
+        double const appendSeconds = timeIt([&]{
+            for (int i = 0; i < APPENDS; ++i) {
+                knoxcrypt::File appender(io, "file", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                                         layout, recordTail ? record : knoxcrypt::OptionalSizeRecord());
+                (void)appender.write(line.c_str(), line.length());
+                appender.flush();
+                record = appender.sizeRecord();
+            }
+        }, 1);
+
+        std::cout<<boost::format("%1% %|24t|%2$8.2f ms open and read end %|54t|%3$8.1f us per random read"
+                                 " %|84t|%4$8.2f ms per append\n")
+            % name % (openSeconds * 1000.0) % ((readSeconds * 1e6) / READS) % ((appendSeconds * 1000.0) / APPENDS);
+    }
+};
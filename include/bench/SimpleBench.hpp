@@ -0,0 +1,70 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <boost/format.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+namespace simplebench {
+
+    /// results are accumulated in to here so that the work being timed
+    /// can't be optimized away
+    volatile uint64_t sink = 0;
+
+    /// times how long a piece of work takes, averaged over a number of runs
+    /// For example
+    /// double const seconds = timeIt([&]{ sink += doWork(); }, 10);
+    template <typename F>
+    double timeIt(F const &f, int const runs)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; ++i) {
+            f();
+        }
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / runs;
+    }
+
+    /// prints a timing along with its speedup over a baseline timing
+    void report(std::string const &name, double const seconds, double const baselineSeconds)
+    {
+        std::cout<<boost::format("%1% %|70t|%2$10.3f ms %|90t|%3$8.1fx\n")
+            % name % (seconds * 1000.0) % (baselineSeconds / seconds);
+    }
+
+    /// prints a heading for a group of timings
+    void heading(std::string const &name)
+    {
+        std::cout<<"\n"<<name<<"\n"<<std::string(name.length(), '-')<<std::endl;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief measures small write IOPS with every block update flushed to the
+ * image (io->writeThrough, as before image writes were buffered) against
+ * leaving updates in the image stream's buffer until sync. Each write is
+ * followed by a file flush, as a FUSE write is.
+ */
+class SmallWriteBench
+{
+  public:
+    SmallWriteBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("SmallWriteBench");
+        for (bool const writeThrough : {true, false}) {
+            bench(writeThrough);
+        }
+    }
+
+    ~SmallWriteBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 32 * 1024 * 1024;
+    static uint64_t const FILE_BYTES = 8 * 1024 * 1024;
+    static uint64_t const WRITE_BYTES = 512;
+    static int const WRITES = 20000;
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void bench(bool const writeThrough)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(path), true).buildImage();
+        }
+
+        auto io(createIO(path));
+        io->useBlockCache = true;
+        io->writeThrough = writeThrough;
+        io->freeBlocks = io->blocks - 1;
+
+        std::vector<char> data(FILE_BYTES, 'x');
+        uint64_t startBlock;
+        {
+            knoxcrypt::File file(io, "file");
+            (void)file.write(&data.front(), data.size());
+            file.flush();
+            startBlock = file.getStartVolumeBlockIndex();
+        }
+
+        // overwrites at random offsets within the file
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<uint64_t> offsets(0, FILE_BYTES - WRITE_BYTES);
+        double const overwriteSeconds = timeIt([&]{
+            knoxcrypt::File file(io, "file", startBlock, knoxcrypt::OpenDisposition::buildOverwriteDisposition());
+            for (int i = 0; i < WRITES; ++i) {
+                (void)file.seek(offsets(rng));
+                sink += file.write(&data.front(), WRITE_BYTES);
+                file.flush();
+            }
+            file.sync();
+        }, 1);
+
+        // appends to the end of the file
+        double const appendSeconds = timeIt([&]{
+            knoxcrypt::File file(io, "file", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition());
+            (void)file.seek(0, std::ios_base::end);
+            for (int i = 0; i < WRITES; ++i) {
+                sink += file.write(&data.front(), WRITE_BYTES);
+                file.flush();
+            }
+            file.sync();
+        }, 1);
+
+        std::cout<<boost::format("%1% %|36t|%2$10.0f overwrites/s %|60t|%3$10.0f appends/s\n")
+            % (writeThrough ? "flushed every update" : "buffered until sync")
+            % (WRITES / overwriteSeconds) % (WRITES / appendSeconds);
+    }
+};
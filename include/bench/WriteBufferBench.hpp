@@ -0,0 +1,133 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/FileDevice.hpp"
+#include "bench/SimpleBench.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/format.hpp>
+#include <boost/iostreams/copy.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace simplebench;
+
+/**
+ * @brief times copying a file in to a container the way copyFromPhysical
+ * does, with boost::iostreams::copy pushing 4K chunks to a FileDevice.
+ * Compared with flushing after every chunk, as FileDevice used to, and
+ * with writing every chunk straight through to its block, the write
+ * buffer is tried at sizes of 1 to 8 MB.
+ */
+class WriteBufferBench
+{
+  public:
+    WriteBufferBench()
+    : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    , m_data(FILE_BYTES, 'x')
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        heading("WriteBufferBench");
+        double const baseline = bench(0, true);
+        report("flushed every 4K write", baseline, baseline);
+        report("written through, no write buffer", bench(0, false), baseline);
+        for (uint64_t megabytes = 1; megabytes <= 8; megabytes *= 2) {
+            report((boost::format("%1% MB write buffer") % megabytes).str(),
+                   bench(megabytes * 1024 * 1024, false), baseline);
+        }
+    }
+
+    ~WriteBufferBench()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    static uint64_t const CONTAINER_BYTES = 96 * 1024 * 1024;
+    static uint64_t const FILE_BYTES = 32 * 1024 * 1024;
+    static uint64_t const CHUNK_BYTES = 4096;
+
+    boost::filesystem::path m_uniquePath;
+    std::string m_data;
+
+    knoxcrypt::SharedCoreIO createIO(boost::filesystem::path const &path)
+    {
+        auto io(std::make_shared<knoxcrypt::CoreIO>());
+        io->path = path.string();
+        io->blocks = CONTAINER_BYTES / io->blockSize;
+        io->freeBlocks = io->blocks;
+        io->encProps.password = "abcd1234";
+        io->encProps.iv = uint64_t(3081342484970028645);
+        io->encProps.iv2 = uint64_t(3081342484970028645);
+        io->encProps.iv3 = uint64_t(3081342484970028645);
+        io->encProps.iv4 = uint64_t(3081342484970028645);
+        io->rounds = 64;
+        io->encProps.cipher = cryptostreampp::Algorithm::AES;
+        io->rootBlock = 0;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    /// a write buffer of 0 bytes writes each chunk straight through
+    double bench(uint64_t const writeBufferBytes, bool const flushEveryWrite)
+    {
+        boost::filesystem::path path = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::MakeKnoxCrypt(createIO(path), true).buildImage();
+        }
+
+        auto io(createIO(path));
+        io->useBlockCache = true;
+        io->useDelayedAllocation = (writeBufferBytes > 0);
+        io->writeBufferBytes = writeBufferBytes;
+        io->freeBlocks = io->blocks - 1;
+
+        return timeIt([&]{
+            knoxcrypt::FileDevice device(std::make_shared<knoxcrypt::File>(io, "file"));
+            if (flushEveryWrite) {
+                for (uint64_t written = 0; written < FILE_BYTES; written += CHUNK_BYTES) {
+                    (void)device.write(&m_data[written], CHUNK_BYTES);
+                    (void)device.flush();
+                }
+            } else {
+                std::istringstream in(m_data);
+                sink += boost::iostreams::copy(in, device, CHUNK_BYTES);
+            }
+        }, 1);
+    }
+};
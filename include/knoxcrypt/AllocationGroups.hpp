@@ -0,0 +1,107 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/ExtentAllocator.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace knoxcrypt
+{
+
+    /**
+     * @brief splits the volume into groups of GROUP_BLOCKS blocks, each with
+     * its own extent allocator and lock, so that writers on different threads
+     * can allocate blocks without waiting on one another
+     *
+     * A writer continuing a file allocates from the group holding its goal
+     * block. Otherwise it starts from a group picked by its thread so that
+     * new files written on different threads land in different groups. When
+     * a group has nothing free, the following groups are tried in turn.
+     */
+    class AllocationGroups
+    {
+      public:
+        using OptionalBlock = ExtentAllocator::OptionalBlock;
+
+        /// the number of blocks in each allocation group
+        static uint64_t const GROUP_BLOCKS = 8 * VolumeBitMap::GROUP_BLOCKS;
+
+        AllocationGroups();
+
+        /**
+         * @brief  allocates a block
+         * @param  io the core knoxcrypt io
+         * @param  volumeBitMap where free extents are read from
+         * @param  goal the block that would ideally be allocated
+         * @param  blocksExpected the number of blocks the writer expects to need
+         * @return the allocated block or nothing if the volume is full
+         */
+        OptionalBlock allocate(SharedCoreIO const &io,
+                               VolumeBitMap &volumeBitMap,
+                               OptionalBlock const &goal,
+                               uint64_t const blocksExpected);
+
+      private:
+
+        using GroupMutex = std::mutex;
+        using GroupLock = std::lock_guard<GroupMutex>;
+
+        struct Group
+        {
+            Group(uint64_t const firstBlock, uint64_t const endBlock);
+            GroupMutex mutex;
+            ExtentAllocator allocator;
+        };
+        using UniqueGroup = std::unique_ptr<Group>;
+        std::vector<UniqueGroup> m_groups;
+
+        // the groups are created on first use since the number
+        // of blocks in the volume isn't known until then
+        std::once_flag m_groupsCreated;
+
+        /**
+         * @brief creates one group for every GROUP_BLOCKS blocks
+         * @param blocks the number of blocks in the volume
+         */
+        void createGroups(uint64_t const blocks);
+
+        /**
+         * @brief  the group that the calling thread starts from
+         *         when the writer doesn't have a goal
+         * @return the group index
+         */
+        uint64_t getHomeGroup() const;
+    };
+
+}
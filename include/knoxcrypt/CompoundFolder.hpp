@@ -153,7 +153,8 @@ namespace knoxcrypt
 
         void writeNewMetaDataForEntry(std::string const &name,
                                       EntryType const &entryType,
-                                      uint64_t startBlock);
+                                      uint64_t startBlock,
+                                      OptionalSizeRecord const &sizeRecord = OptionalSizeRecord());
 
       private:
         void doAddContentFolder();
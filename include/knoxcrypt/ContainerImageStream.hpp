@@ -29,11 +29,14 @@
 #pragma once
 
 #include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/ImageCacheAdvisor.hpp"
+#include "knoxcrypt/MappedImage.hpp"
 #include "utility/EventType.hpp"
 #include "cryptostreampp/CryptoStreamPP.hpp"
 
 #include <functional>
 #include <memory>
+#include <mutex>
 
 #include <fstream>
 #include <string>
@@ -43,6 +46,69 @@ namespace knoxcrypt
     class ContainerImageStream;
     using SharedImageStream = std::shared_ptr<ContainerImageStream>;
 
+    /**
+     * An open image and the position of the stream in it. A fstream only
+     * gives up its position by seeking the underlying file so the position
+     * is kept here instead, shared by everything using the stream; it is -1
+     * when not known
+     */
+    struct ImageStreamHandle
+    {
+        ImageStreamHandle(cryptostreampp::SharedCryptoStream const &cryptoStream,
+                          bool const append)
+            : stream(cryptoStream)
+            , advisor()
+            , map()
+            , position(-1)
+            , appending(append)
+            , mutex()
+        {
+        }
+
+        cryptostreampp::SharedCryptoStream stream;
+
+        // with io->dropImageCache, told of everything read from the file
+        std::shared_ptr<ImageCacheAdvisor> advisor;
+
+        // with io->mapImage, where the shared stream's reads and writes are
+        // served from; the stream is then only used to fill and write back
+        // the map and its own position is not the one kept here
+        std::unique_ptr<MappedImage> map;
+
+        std::streamoff position;
+
+        // writes to a stream opened for appending go to its end
+        bool appending;
+
+        // held by every operation on the stream, and by readAt and writeAt
+        // across both their seek and transfer, so that the stream can be
+        // used from any thread
+        std::mutex mutex;
+    };
+
+    /**
+     * With io->useBlockCache the container is taken to be accessed only
+     * through the one io, so every stream opened for both reading and
+     * writing shares a single underlying stream. Writes then sit in its
+     * buffer, visible to all readers, until it is flushed by sync, by a
+     * stream opened some other way or by the last user letting go of it.
+     * Without the block cache, or with io->writeThrough, each update to a
+     * block is flushed straight away so that other ios see it.
+     *
+     * readAt and writeAt work at an absolute offset, as pread and pwrite
+     * do. The stream is only seeked when not already at the offset and
+     * its position is never asked of the file. A seek followed by a read
+     * or write is two steps that another thread can come between, so
+     * anything using the shared stream goes through readAt and writeAt.
+     *
+     * With io->mapImage as well, the shared stream keeps up to
+     * io->mapImageBytes of the image decrypted in a MappedImage so that a
+     * block read recently is read again with a copy rather than through
+     * the file stream and the cipher. If those bytes can't be locked in
+     * memory the stream is used alone.
+     * Anything written to the image by a stream opened some other way is
+     * dropped from the map so that it is decrypted afresh.
+     */
     class ContainerImageStream
     {
       public:
@@ -54,25 +120,126 @@ namespace knoxcrypt
 
         ContainerImageStream& write(char const * buf, std::streamsize const n);
 
+        /**
+         * @brief reads from an absolute offset in the image
+         * @param buf where to store the data
+         * @param n the number of bytes to read
+         * @param offset where in the image to read from
+         * @return the stream
+         */
+        ContainerImageStream& readAt(char * const buf, std::streamsize const n, std::streamoff const offset);
+
+        /**
+         * @brief writes to an absolute offset in the image
+         * @param buf the data to write
+         * @param n the number of bytes to write
+         * @param offset where in the image to write to
+         * @return the stream
+         */
+        ContainerImageStream& writeAt(char const * buf, std::streamsize const n, std::streamoff const offset);
+
         ContainerImageStream& seekg(std::streampos pos);
         ContainerImageStream& seekg(std::streamoff off, std::ios_base::seekdir way);
         ContainerImageStream& seekp(std::streampos pos);
         ContainerImageStream& seekp(std::streamoff off, std::ios_base::seekdir way);
         std::streampos tellg();
         std::streampos tellp();
+
+        /**
+         * @brief seeks to the end of the image and tells where that is, as
+         * one step
+         * @return the number of bytes in the image
+         */
+        std::streampos size();
+
         bool bad() const;
         void clear();
 
         void flush();
 
+        /**
+         * @brief flushes the stream unless image writes are buffered; called
+         * at the end of each update to a block
+         */
+        void flushUnlessBuffered();
+
+        /**
+         * @brief closes the stream; a shared stream is only flushed as it
+         * is still in use elsewhere
+         */
         void close();
 
         bool is_open() const;
 
         void open(SharedCoreIO const &io,
                   std::ios::openmode mode = std::ios::out | std::ios::binary);
+
+        /**
+         * @brief flushes the container's shared stream and has everything
+         * written to the image reach the disk
+         * @param io the core io of the container
+         */
+        static void sync(SharedCoreIO const &io);
+
       private:
-        cryptostreampp::SharedCryptoStream m_cryptoStream;
+        std::shared_ptr<ImageStreamHandle> m_handle;
+
+        // whether m_handle is the container's shared stream
+        bool m_shared;
+
+        // whether updates are left in the buffer until synced
+        bool m_buffered;
+
+        // for a writable stream of its own, the shared stream whose map
+        // must forget what this one writes
+        std::weak_ptr<ImageStreamHandle> m_mapped;
+
+        /**
+         * @brief maps the image for the shared stream if the container asks
+         * for it and the image fits in the address space
+         * @param io the core io of the container
+         */
+        void mapImage(SharedCoreIO const &io);
+
+        /**
+         * @brief readies a read or write that cannot be served from the map
+         * by writing back and dropping the mapped pages it overlaps and then
+         * putting the stream at the position
+         * @param n the number of bytes about to be transferred
+         */
+        void bypassMap(std::streamsize const n);
+
+        /**
+         * @brief flushes the map of the shared stream, if any, and then the
+         * stream itself
+         * @param handle the handle of the stream
+         */
+        static void flushHandle(ImageStreamHandle &handle);
+
+        /**
+         * @brief read, write, seeks and tellg for a caller already holding
+         * the handle's mutex
+         */
+        ContainerImageStream& doRead(char * const buf, std::streamsize const n);
+        ContainerImageStream& doWrite(char const * buf, std::streamsize const n);
+        ContainerImageStream& doSeekg(std::streampos pos);
+        ContainerImageStream& doSeekg(std::streamoff off, std::ios_base::seekdir way);
+        ContainerImageStream& doSeekp(std::streampos pos);
+        ContainerImageStream& doSeekp(std::streamoff off, std::ios_base::seekdir way);
+        std::streampos doTellg();
+
+        /**
+         * @brief moves the known position on after a transfer, or forgets
+         * it if the transfer failed
+         * @param n the number of bytes transferred
+         */
+        void advance(std::streamsize const n);
+
+        /**
+         * @brief records the position after a seek to an absolute offset
+         * @param offset the offset seeked to
+         */
+        void seeked(std::streamoff const offset);
     };
 
 }
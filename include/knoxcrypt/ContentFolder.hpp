@@ -206,10 +206,12 @@ namespace knoxcrypt
          * @param name name of entry
          * @param entryType the type of the entry
          * @param startBlock start block of entry
+         * @param sizeRecord size record of a file entry
          */
         void writeNewMetaDataForEntry(std::string const &name,
                                       EntryType const& entryType,
-                                      uint64_t startBlock);
+                                      uint64_t startBlock,
+                                      OptionalSizeRecord const &sizeRecord = OptionalSizeRecord());
 
         long getAliveEntryCount() const;
         long getTotalEntryCount() const;
@@ -224,10 +226,12 @@ namespace knoxcrypt
          * @param name name of entry
          * @param entryType the type of the entry
          * @param startBlock start block of entry
+         * @param sizeRecord size record of a file entry
          */
         void doWriteNewMetaDataForEntry(std::string const &name,
                                         EntryType const& entryType,
-                                        uint64_t startBlock);
+                                        uint64_t startBlock,
+                                        OptionalSizeRecord sizeRecord = OptionalSizeRecord());
 
         /**
          * @brief a private accessor for getting file entry from metadata
@@ -244,6 +248,15 @@ namespace knoxcrypt
          */
         bool doPutMetaDataOutOfUse(std::string const &name);
 
+        /**
+         * @brief removes a file entry, adding its blocks to those to be
+         * deallocated rather than deallocating them straight away
+         * @param name the name of the entry
+         * @param blocks where the file's blocks are added
+         * @return true if successful
+         */
+        bool doRemoveFile(std::string const &name, std::vector<uint64_t> &blocks);
+
         /**
          * @brief returns the entry index given the name
          * @param name the name of the entry
@@ -264,15 +277,22 @@ namespace knoxcrypt
         /**
          * @brief write the first byte of the file metadata data
          * @note assumes in correct position
+         * @param entryType the type of the entry
+         * @param sizeRecorded true if a size record follows the filename
          * @return
          */
-        std::streamsize doWriteFirstByteToEntryMetaData(EntryType const &entryType);
+        std::streamsize doWriteFirstByteToEntryMetaData(EntryType const &entryType,
+                                                        bool const sizeRecorded = false);
 
         /**
          * @brief write filename file metadata
+         * @param name the entry name
+         * @param sizeRecord size record to store after the name
          * @return number of bytes writeen
          */
-        std::streamsize doWriteFilenameToEntryMetaData(std::string const &name);
+        std::streamsize doWriteFilenameToEntryMetaData(std::string const &name,
+                                                       OptionalSizeRecord const &sizeRecord
+                                                           = OptionalSizeRecord());
 
         /**
          * @brief writes the first block index bytes to the file metadata
@@ -309,8 +329,9 @@ namespace knoxcrypt
         // the core knoxcrypt io (path, blocks, password)
         SharedCoreIO m_io;
 
-        // the underlying file blocks storing the folder entry data
-        mutable File m_folderData;
+        // the underlying file blocks storing the folder entry data; shared
+        // with the files opened from this folder to record their sizes
+        SharedFile m_folderData;
 
         uint64_t m_startVolumeBlock;
 
@@ -145,12 +145,53 @@ namespace knoxcrypt
          */
         void truncateFile(std::string const &path, std::ios_base::streamoff offset);
 
+        /**
+         * @brief  finds the next data or hole in a file; used for lseek's
+         *         SEEK_DATA and SEEK_HOLE
+         * @param  path the file to search
+         * @param  offset where to search from
+         * @param  hole true to find a hole, false to find data
+         * @return the offset found; -1 if there is none
+         * @throw  knoxcryptException NotFound if the file can't be found
+         */
+        std::streamoff findDataOrHole(std::string const &path,
+                                      std::streamoff offset,
+                                      bool const hole);
+
         /**
          * @brief gets file system info; used when a 'df' command is issued
          * @param buf stores the filesystem stats data
          */
         void statvfs(struct statvfs *buf);
 
+        /**
+         * @brief gets the size of the container's blocks
+         * @return the block size including each block's metadata
+         */
+        uint64_t blockSize() const;
+
+        /**
+         * @brief writes out what the open file at path has buffered and
+         * records its size in its folder entry; the image isn't synced
+         * @param path the file to flush
+         */
+        void flushFile(std::string const &path);
+
+        /**
+         * @brief writes any cached filesystem state (such as the in-memory
+         * volume bitmap and the open file's write buffer) back to the image
+         * and has the image reach the disk
+         */
+        void sync();
+
+        /**
+         * @brief writes back any cached filesystem state and records the
+         * container as cleanly unmounted along with its allocated block count
+         * so that the next mount needn't count the blocks, then syncs the
+         * image. Should be the last thing done with the filesystem.
+         */
+        void unmount();
+
       private:
 
         // the core knoxcrypt io (path, blocks, password)
@@ -176,6 +217,12 @@ namespace knoxcrypt
 
         void throwIfAlreadyExists(std::string const &path) const;
 
+        /**
+         * @brief derives the number of free blocks from the volume bitmap if
+         * this couldn't be done at mount time
+         */
+        void checkAndCountFreeBlocks();
+
         bool doFileExists(std::string const &path) const;
 
         bool doFolderExists(std::string const &path) const;
@@ -43,6 +43,8 @@ namespace knoxcrypt
     class FileBlockBuilder;
     using SharedBlockBuilder = std::shared_ptr<FileBlockBuilder>;
 
+    struct ImageStreamHandle;
+
     struct CoreIO
     {
         std::string path;                // path of the tea safe image
@@ -57,9 +59,22 @@ namespace knoxcrypt
         OptionalCallback ccb;            // call back for cipher
         bool useBlockCache;              // cache available file blocks for faster retrieval
         bool firstTimeInit;              // initialized very first time
+        bool freeBlocksCounted;          // false if freeBlocks is yet to be derived from the bitmap
+        bool useExtentAllocation;        // with useBlockCache, allocate contiguous runs of blocks
+        bool useDelayedAllocation;       // with useBlockCache, allocate appended blocks on flush
+        uint64_t writeBufferBytes;       // with useDelayedAllocation, appended bytes a file holds back before writing
+        bool writeThrough;               // with useBlockCache, flush every block update rather than on sync
+        std::weak_ptr<ImageStreamHandle> imageStream; // with useBlockCache, the stream shared by readers and writers
+        bool mapImage;                   // with useBlockCache, serve the shared stream from a cache of decrypted pages
+        uint64_t mapImageBytes;          // with mapImage, the most decrypted bytes held, locked in memory
+        bool dropImageCache;             // drop the image's pages from the kernel's page cache once read
+        bool indexedFiles;               // files are laid out with an extent index (image format feature)
+        uint64_t blockSize;              // bytes per file block including its metadata (image format feature)
         
         // Should key be initialized very first time?
-        CoreIO() : firstTimeInit(false) {}
+        CoreIO() : useBlockCache(false), firstTimeInit(false), freeBlocksCounted(true), useExtentAllocation(true)
+                 , useDelayedAllocation(true), writeBufferBytes(1024 * 1024), writeThrough(false)
+                 , mapImage(false), mapImageBytes(4 * 1024 * 1024), dropImageCache(false), indexedFiles(false), blockSize(4096) {}
         
     };
 
@@ -30,6 +30,8 @@
 
 #include "knoxcrypt/EntryType.hpp"
 
+#include <boost/optional.hpp>
+
 #include <string>
 
 namespace knoxcrypt
@@ -44,7 +46,8 @@ namespace knoxcrypt
                   EntryType const &entryType,
                   bool const writable,
                   uint64_t const firstFileBlock,
-                  uint64_t const folderIndex);
+                  uint64_t const folderIndex,
+                  uint64_t const blockCount = 0);
 
         /**
          * @brief  access the name of the entry
@@ -65,6 +68,30 @@ namespace knoxcrypt
          */
         void updateSize(uint64_t newSize);
 
+        /**
+         * @brief  access the number of volume blocks used by a file entry
+         * @return the block count
+         */
+        uint64_t blockCount() const;
+
+        /**
+         * @brief updates the block count
+         * @param newBlockCount
+         */
+        void updateBlockCount(uint64_t newBlockCount);
+
+        /**
+         * @brief  access the block that a file entry's data ends in, if known
+         * @return the tail block
+         */
+        boost::optional<uint64_t> tailBlock() const;
+
+        /**
+         * @brief updates the tail block
+         * @param newTailBlock
+         */
+        void updateTailBlock(uint64_t newTailBlock);
+
         /**
          * @brief  accesses the type of the entry (file or folder)
          * @return EntryType::File if file, EntryType::Folder if folder
@@ -108,6 +135,8 @@ namespace knoxcrypt
         uint64_t m_folderIndex;
         bool m_hasBucketIndex;
         uint64_t m_bucketIndex;
+        uint64_t m_blockCount;
+        boost::optional<uint64_t> m_tailBlock;
     };
 
 }
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+
+#include <limits>
+#include <map>
+#include <set>
+
+namespace knoxcrypt
+{
+
+    /**
+     * @brief hands out blocks from runs of free blocks (extents) so that
+     * the blocks of a file are laid out one after the other
+     *
+     * The free extents are read in from the volume bitmap and kept in two
+     * indices, one ordered by position and one by size. A writer that wants
+     * a block for a new file (or whose next block is taken) gets one from the
+     * smallest extent that fits the number of blocks it expects to write.
+     * The blocks following it are then reserved for that writer so that
+     * other writers can't interleave with it. A writer continuing a file
+     * passes the block after its last block as a goal which is satisfied
+     * from its reservation or, failing that, from a free extent starting
+     * at the goal.
+     *
+     * As with the block deque, blocks that are deallocated are picked up
+     * the next time the extents are read from the bitmap which is when the
+     * cached extents run out.
+     */
+    class ExtentAllocator
+    {
+      public:
+        using OptionalBlock = VolumeBitMap::OptionalBlock;
+        using Extent = VolumeBitMap::Extent;
+
+        ExtentAllocator();
+
+        /**
+         * @brief an allocator that only hands out blocks in a range
+         * @param firstBlock the first block of the range
+         * @param endBlock one past the last block of the range
+         */
+        ExtentAllocator(uint64_t const firstBlock, uint64_t const endBlock);
+
+        /**
+         * @brief  allocates a block
+         * @param  io the core knoxcrypt io
+         * @param  volumeBitMap where free extents are read from when none are cached
+         * @param  goal the block that would ideally be allocated; typically the
+         *         block following the last block of the file being written
+         * @param  blocksExpected the number of blocks the writer expects to need
+         * @return the allocated block or nothing if the volume is full
+         */
+        OptionalBlock allocate(SharedCoreIO const &io,
+                               VolumeBitMap &volumeBitMap,
+                               OptionalBlock const &goal,
+                               uint64_t const blocksExpected);
+
+      private:
+
+        // the range of blocks that this allocator hands out
+        uint64_t m_firstBlock;
+        uint64_t m_endBlock;
+
+        // free extents; maps first block to number of blocks
+        using ExtentMap = std::map<uint64_t, uint64_t>;
+        ExtentMap m_freeExtents;
+
+        // the free extents as (number of blocks, first block) for best fit searches
+        std::set<Extent> m_freeExtentsBySize;
+
+        // blocks set aside for a writer. Keyed on the next block that the
+        // writer is expected to ask for
+        struct Reservation
+        {
+            uint64_t end;      // one past the last reserved block
+            uint64_t lastUsed; // for evicting the least recently used
+        };
+        using Reservations = std::map<uint64_t, Reservation>;
+        Reservations m_reservations;
+
+        // incremented on each allocation; used to age reservations
+        uint64_t m_clock;
+
+        /**
+         * @brief reads the free extents of the range in from the volume bitmap
+         * @param io the core knoxcrypt io
+         * @param volumeBitMap the volume bitmap
+         */
+        void populate(SharedCoreIO const &io, VolumeBitMap &volumeBitMap);
+
+        /**
+         * @brief adds a free extent, merging it with adjacent free extents
+         * @param first the first block of the extent
+         * @param count the number of blocks in the extent
+         */
+        void addFreeExtent(uint64_t first, uint64_t count);
+
+        /**
+         * @brief removes a free extent
+         * @param it the extent to remove
+         */
+        void removeFreeExtent(ExtentMap::iterator const &it);
+
+        /**
+         * @brief  finds the free extent that contains a block
+         * @param  block the block
+         * @return the extent or m_freeExtents.end() if the block isn't free
+         */
+        ExtentMap::iterator findFreeExtentContaining(uint64_t const block);
+
+        /**
+         * @brief  allocates a block from a free extent, reserving the blocks
+         *         that follow it
+         * @param  it the extent that contains block
+         * @param  block the block to allocate
+         * @param  blocksWanted how many blocks (including block) to set aside
+         * @return block
+         */
+        uint64_t allocateAndReserve(ExtentMap::iterator const &it,
+                                    uint64_t const block,
+                                    uint64_t const blocksWanted);
+
+        /// returns the least recently used reservation to the free extents
+        void releaseOldestReservation();
+
+        /// returns all reservations to the free extents
+        void releaseAllReservations();
+    };
+
+}
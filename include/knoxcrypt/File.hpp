@@ -30,6 +30,8 @@
 
 #include "knoxcrypt/CoreIO.hpp"
 #include "knoxcrypt/FileBlock.hpp"
+#include "knoxcrypt/FileLayout.hpp"
+#include "knoxcrypt/FileSizeRecord.hpp"
 #include "knoxcrypt/OpenDisposition.hpp"
 #include "knoxcrypt/ContainerImageStream.hpp"
 
@@ -51,7 +53,7 @@ namespace knoxcrypt
     class File
     {
 
-        using SetEntryInfoSizeCallback = std::function<void(uint64_t)>;
+        using SetEntryInfoSizeCallback = std::function<void(FileSizeRecord const &)>;
         using OptionalSizeCallback = boost::optional<SetEntryInfoSizeCallback>;
         using SharedFileBlock = std::shared_ptr<FileBlock>;
 
@@ -62,8 +64,12 @@ namespace knoxcrypt
          * @param io the core knoxcrypt io (path, blocks, password)
          * @param name the name of the file entry
          * @param enforceStartBlock true if start block should be set
+         * @param layout how the file's blocks are to be found
          */
-        File(SharedCoreIO const &io, std::string const &name, bool const enforceStartBlock = false);
+        File(SharedCoreIO const &io,
+             std::string const &name,
+             bool const enforceStartBlock = false,
+             FileLayout const layout = FileLayout::Chained);
 
         /**
          * @brief when reading or appending or overwriting this constructor should be used
@@ -71,11 +77,33 @@ namespace knoxcrypt
          * @param name the name of the file entry
          * @param block the starting block of the file entry
          * @param openDisposition open mode
+         * @param layout how the file's blocks are to be found; must match
+         * the layout the file was created with
+         * @param sizeRecord the size and tail block recorded for the file, if
+         * known; lets an append start at the tail without walking the file
          */
         File(SharedCoreIO const &io,
                     std::string const &name,
                     uint64_t const startBlock,
-                    OpenDisposition const &openDisposition);
+                    OpenDisposition const &openDisposition,
+                    FileLayout const layout = FileLayout::Chained,
+                    OptionalSizeRecord const &sizeRecord = OptionalSizeRecord());
+
+        /// writes out any data still waiting for blocks to be allocated
+        /// and any changes to the extent index, then records the file's
+        /// size; errors are swallowed so call flush first to have them
+        /// reported
+        ~File();
+
+        /// a copy would write out the same pending data a second time
+        File(File const &) = delete;
+        File& operator=(File const &) = delete;
+
+        /// the moved from file is left with nothing to write out
+        File(File &&other);
+
+        /// writes out what this file has pending before taking other's place
+        File& operator=(File &&other);
 
         typedef char                                   char_type;
         typedef boost::iostreams::seekable_device_tag  category;
@@ -92,6 +120,19 @@ namespace knoxcrypt
          */
         uint64_t fileSize() const;
 
+        /**
+         * @brief  accesses the number of volume blocks the file occupies,
+         *         including any blocks holding its extent index
+         * @return the block count
+         */
+        uint64_t blockCount() const;
+
+        /**
+         * @brief  accesses the size, block count and tail block of the file
+         * @return the file's size record
+         */
+        FileSizeRecord sizeRecord() const;
+
         /**
          * @brief  retrieves the first file block making up this knoxcrypt file
          * @return the start block index of this file
@@ -99,7 +140,9 @@ namespace knoxcrypt
         uint64_t getStartVolumeBlockIndex() const;
 
         /**
-         * @brief truncates a file to new size
+         * @brief truncates a file to new size, deallocating any blocks
+         * beyond the new end. Only an indexed file is grown by this, with
+         * the new space left as a hole
          * @param newSize the new fileSize
          */
         void truncate(std::ios_base::streamoff newSize);
@@ -121,7 +164,9 @@ namespace knoxcrypt
         std::streamsize write(const char* s, std::streamsize n);
 
         /**
-         * @brief  allows seeking to a given position in the knoxcrypt file
+         * @brief  allows seeking to a given position in the knoxcrypt file.
+         * A writable indexed file can be seeked beyond its end; writing there
+         * leaves a hole between the old end and the written data
          * @param  off the offset to seek to
          * @param  way the position of where to offset from (begin, current, or end)
          * @return returns the offset (NOTE: should this be returning the actual
@@ -137,20 +182,53 @@ namespace knoxcrypt
         boost::iostreams::stream_offset tell() const;
 
         /**
-         * @brief flushes any remaining data
+         * @brief  finds the start of the next data, as with SEEK_DATA
+         * @param  from the offset to search from
+         * @return the offset of the first byte at or after from that isn't
+         * in a hole; -1 if there is none
+         */
+        boost::iostreams::stream_offset nextDataOffset(uint64_t const from) const;
+
+        /**
+         * @brief  finds the start of the next hole, as with SEEK_HOLE; the
+         * end of the file counts as a hole
+         * @param  from the offset to search from
+         * @return the offset of the first byte at or after from that is in
+         * a hole; -1 if from isn't within the file
+         */
+        boost::iostreams::stream_offset nextHoleOffset(uint64_t const from) const;
+
+        /**
+         * @brief flushes any remaining data; with delayed allocation, this is
+         * when appended data held in the write buffer is written out and the
+         * blocks for it allocated
          */
         void flush();
 
+        /**
+         * @brief flushes the file and has everything written to the image so
+         * far, by this file or otherwise, reach the disk
+         */
+        void sync();
+
         /**
          * @brief deallocates blocks associated with this file entry; used
          * in conjunction with deleting the file
          */
         void unlink();
 
+        /**
+         * @brief as unlink but rather than deallocating the file's blocks
+         * straight away, they are added to blocks so that the blocks of
+         * several files can be deallocated in one batch
+         * @param blocks where the file's blocks are added
+         */
+        void unlink(std::vector<uint64_t> &blocks);
+
         /**
          * @brief sets the callback that will be used to updated the reported
          * file size as stored in the entry info metadata of the parent
-         * @param callback the setSize function (probably) of EntryInfo
+         * @param callback called with the file's size record
          */
         void setOptionalSizeUpdateCallback(SetEntryInfoSizeCallback callback);
 
@@ -199,8 +277,18 @@ namespace knoxcrypt
         // the current 'stream position' of file entry
         std::streamoff m_pos;
 
-        // how many blocks make up the file?
-        mutable uint64_t m_blockCount;
+        // the volume indices of the blocks that make up the file, in file
+        // order; lets a seek go straight to a block rather than following
+        // the chain of next indices from the start block
+        mutable std::vector<uint64_t> m_blockIndices;
+
+        // when opened at a recorded tail, the number of blocks preceding
+        // those in m_blockIndices whose indices haven't been read yet
+        mutable uint64_t m_unmappedBlocks;
+
+        // the number of entries in m_blockIndices that are holes rather
+        // than blocks
+        mutable uint64_t m_holeBlocks;
 
         // an optional size update callback to be used in setting the reported
         // size in the entry info held in the parent folder entry info cache
@@ -210,6 +298,113 @@ namespace knoxcrypt
         // instantiating a new FileBlock
         mutable SharedImageStream m_stream;
 
+        // with delayed allocation, data appended to the end of the file
+        // waits here until flush or until io->writeBufferBytes are held
+        mutable std::vector<uint8_t> m_pendingData;
+
+        // whether the blocks are chained or listed in an extent index
+        FileLayout m_layout;
+
+        // for an indexed file, the blocks holding the extent index; the
+        // first of these is the file's start block
+        mutable std::vector<uint64_t> m_indexBlocks;
+
+        // for an indexed file, runs of contiguous blocks (first block and
+        // length) making up the file in file order; a run of holes has a
+        // first block of HOLE_BLOCK
+        mutable std::vector<std::pair<uint64_t, uint64_t>> m_extents;
+
+        // the first extent not yet written out to the index blocks
+        mutable boost::optional<size_t> m_firstDirtyExtent;
+
+        /**
+         * @brief records a newly allocated block as the last of the file
+         * @param block the volume index of the block
+         */
+        void addBlock(uint64_t const block) const;
+
+        /**
+         * @brief records holes as the last blocks of an indexed file
+         * @param count the number of blocks' worth of hole
+         */
+        void addHoles(uint64_t const count) const;
+
+        /**
+         * @brief allocates a zeroed block in place of a block of a hole and
+         * makes it the working block
+         * @param blockIndex the hole's position in m_blockIndices
+         */
+        void fillHole(uint64_t const blockIndex) const;
+
+        /**
+         * @brief grows an indexed file to a new size, leaving whole blocks
+         * of the new space as a hole; the file is left positioned at its end
+         * @param newSize the new size of the file
+         */
+        void extendWithHole(uint64_t const newSize);
+
+        /**
+         * @brief  whether the current block is a hole
+         * @return true if in a hole
+         */
+        bool inHole() const;
+
+        /**
+         * @brief  the position within the current block when it is a hole
+         * @return the offset in to the block
+         */
+        uint64_t holeOffset() const;
+
+        /**
+         * @brief  finds the next data or hole; see nextDataOffset and
+         * nextHoleOffset
+         * @param  from the offset to search from
+         * @param  hole true to find a hole, false to find data
+         * @return the offset found or -1
+         */
+        boost::iostreams::stream_offset nextOffset(uint64_t const from, bool const hole) const;
+
+        /**
+         * @brief allocates the block holding the root of an indexed
+         * file's extent index; this becomes the file's start block
+         * @param blocksExpected how many data blocks are expected to follow
+         */
+        void allocateIndexRoot(uint64_t const blocksExpected) const;
+
+        /**
+         * @brief reads the extent index of an indexed file, building the
+         * block map and setting the file size without visiting data blocks
+         */
+        void readIndex();
+
+        /**
+         * @brief writes out the index blocks holding changed extents,
+         * allocating or deallocating overflow index blocks as the number
+         * of extents requires
+         */
+        void writeIndex() const;
+
+        /**
+         * @brief has the size update callback record the size of a file
+         * opened for writing
+         */
+        void recordSize() const;
+
+        /**
+         * @brief  determines whether the next bytes of a write should be
+         *         held in m_pendingData rather than written straight away
+         * @return true if allocation should be delayed
+         */
+        bool shouldDelayAllocation() const;
+
+        /**
+         * @brief tops up the working block from m_pendingData then allocates
+         * every block needed for the rest as one batch so that they can be
+         * laid out contiguously, writes each run of consecutive blocks'
+         * metadata and data in one go and links them on to the file
+         */
+        void allocatePendingBlocks() const;
+
         /**
          * @brief  for keeping track of what the current file block as indicated
          *         by the current working file block
@@ -219,14 +414,37 @@ namespace knoxcrypt
 
         /**
          * @brief creates a new file block for writing and updates the working block
+         * @param blocksExpected how many more blocks the current write is expected
+         * to need; helps the block builder lay the file out contiguously
          */
-        void newWritableFileBlock() const;
+        void newWritableFileBlock(uint64_t const blocksExpected = 1) const;
 
         /**
          * @brief counts the number of blocks and sets file size
          */
         void enumerateBlockStats();
 
+        /**
+         * @brief sets up an append from the tail block of a size record
+         * rather than from the start of the file; the record is only trusted
+         * if its tail block still ends a file of the recorded size
+         * @param sizeRecord the recorded size and tail block
+         * @return true if the file was opened at the tail
+         */
+        bool openAtRecordedTail(OptionalSizeRecord const &sizeRecord);
+
+        /**
+         * @brief walks the chain to find any blocks skipped by
+         * openAtRecordedTail so that the block map is complete
+         */
+        void mapAllBlocks() const;
+
+        /**
+         * @brief  the number of data blocks, whether mapped or not
+         * @return the data block count
+         */
+        uint64_t dataBlockCount() const;
+
         /**
          * @brief  buffers as many bytes as permitted by the working block
          * @param  s the data to buffer
@@ -243,18 +461,49 @@ namespace knoxcrypt
         void writeBufferedDataToWorkingBlock(uint32_t const bytes);
 
         /**
-         * @brief  reads bytes from the working block in to buffer
+         * @brief  makes the given block of the file the working block
+         * @param  blockIndex the block's position in m_blockIndices
+         */
+        void openWorkingBlock(uint64_t const blockIndex);
+
+        /**
+         * @brief  reads bytes from the working block straight in to the
+         * destination
+         * @param  s where to store the data
+         * @param  bytes the most bytes to read
          * @return the number of bytes read
          */
-        std::streamsize readWorkingBlockBytes(uint32_t const bytes);
+        std::streamsize readWorkingBlockBytes(char * const s, uint32_t const bytes);
+
+        /**
+         * @brief  reads zeros from the hole the file is positioned in
+         * @param  s where to store the data
+         * @param  bytes the most bytes to read
+         * @return the number of bytes read
+         */
+        std::streamsize readHoleBytes(char * const s, uint32_t const bytes);
+
+        /**
+         * @brief  reads data from a run of physically consecutive blocks
+         * starting with the working block, which must be at its start. The
+         * run is read from the image in one go straight in to the destination
+         * and each block's data then moved down over the block headers
+         * @param  s where to store the data
+         * @param  n the number of bytes wanted
+         * @return the number of bytes read; 0 if fewer than two whole
+         * consecutive blocks fit in n bytes
+         */
+        std::streamsize readBlockRun(char * const s, std::streamsize const n);
 
 
         /**
          * @brief will build a new file block for writing to if there are
          * no file blocks or if there are file blocks and it is determined
          * that we're not in append mode
+         * @param blocksExpected how many more blocks the current write is expected
+         * to need
          */
-        void checkAndUpdateWorkingBlockWithNew() const;
+        void checkAndUpdateWorkingBlockWithNew(uint64_t const blocksExpected = 1) const;
 
         /**
          * @brief used in the context of discovering if currently set block
@@ -92,6 +92,37 @@ namespace knoxcrypt
          */
         std::streamsize write(char const * const buf, std::streamsize const n) const;
 
+        /**
+         * @brief  writes the size, next index and data of a newly allocated
+         *         block with a single write to the image. The image stream is
+         *         not flushed so that several blocks can be written in one go
+         * @param  buf the data to write
+         * @param  n the number of bytes to write; at most a block's worth
+         * @param  nextIndex the next block of the file or this block's own
+         *         index if it is the file's last block
+         */
+        void writeNewBlock(char const * const buf, std::streamsize const n, uint64_t const nextIndex) const;
+
+        /**
+         * @brief  as writeNewBlock but for a run of newly allocated blocks
+         *         that directly follow one another in the image; the whole
+         *         run is written with a single write. Every block of the run
+         *         but the last is filled
+         * @param  blocks the blocks of the run, in order
+         * @param  count the number of blocks in the run
+         * @param  buf the data to write
+         * @param  n the number of bytes to write
+         * @param  chained whether each block's next index is the block
+         *         following it rather than its own index
+         * @param  lastNext the next index of the run's last block
+         */
+        static void writeNewBlockRun(FileBlock const * const blocks,
+                                     size_t const count,
+                                     char const * const buf,
+                                     std::streamsize const n,
+                                     bool const chained,
+                                     uint64_t const lastNext);
+
         /**
          * @brief  seeks to a position in this file block
          * @param  off where to seek to given the seek-from type
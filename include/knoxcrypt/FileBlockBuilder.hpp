@@ -28,11 +28,14 @@
 
 #pragma once
 
+#include "knoxcrypt/AllocationGroups.hpp"
 #include "knoxcrypt/CoreIO.hpp"
 #include "knoxcrypt/FileBlock.hpp"
 #include "knoxcrypt/OpenDisposition.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
 
 #include <memory>
+#include <mutex>
 
 #include <deque>
 
@@ -49,20 +52,57 @@ namespace knoxcrypt
         FileBlockBuilder();
         FileBlockBuilder(SharedCoreIO const &io);
 
+        /**
+         * @brief  allocates a new file block for writing to
+         * @param  io the core knoxcrypt io
+         * @param  openDisposition the open mode of the block
+         * @param  stream the image stream
+         * @param  enforceRootBlock use io->rootBlock rather than allocating
+         * @param  goal the block that would ideally be used, typically the
+         *         one following the last block of the file being written
+         * @param  blocksExpected the number of blocks the writer expects to need
+         * @return the new file block
+         * @note   throws std::runtime_error if there are no free blocks
+         */
         FileBlock buildWritableFileBlock(SharedCoreIO const &io,
                                          OpenDisposition const &openDisposition,
                                          SharedImageStream &stream,
-                                         bool const enforceRootBlock = false);
+                                         bool const enforceRootBlock = false,
+                                         VolumeBitMap::OptionalBlock const &goal = VolumeBitMap::OptionalBlock(),
+                                         uint64_t const blocksExpected = 1);
 
         FileBlock buildFileBlock(SharedCoreIO const &io,
                                  uint64_t const index,
                                  OpenDisposition const &openDisposition,
                                  SharedImageStream &stream);
 
+        /**
+         * @brief  accesses the in-memory volume bitmap used for
+         *         allocating and deallocating blocks
+         * @return the volume bitmap
+         */
+        SharedVolumeBitMap getVolumeBitMap() const;
+
       private:
 
+        /// the in-memory volume bitmap from which m_blockDeque is populated
+        SharedVolumeBitMap m_volumeBitMap;
+
+        /// a bounded batch of free blocks, refilled from m_blockCursor
         BlockDeque m_blockDeque;
 
+        /// where the next batch of free blocks is searched for from
+        uint64_t m_blockCursor;
+
+        /// used instead of m_blockDeque when io->useExtentAllocation is set;
+        /// unlike the deque, allocating from it can be done on several threads
+        AllocationGroups m_allocationGroups;
+
+        /// guards m_blockDeque, m_blockCursor and m_blocksWritten
+        using BuilderMutex = std::mutex;
+        using BuilderLock = std::lock_guard<BuilderMutex>;
+        BuilderMutex m_mutex;
+
         /// store how many blocks have actually been written
         /// when we get a block to use if it is greater than the number
         /// of blocks written then image is probably sparse in which case
@@ -42,13 +42,22 @@ namespace knoxcrypt
       public:
 
         typedef char                                   char_type;
-        typedef boost::iostreams::seekable_device_tag  category;
+        struct category
+            : boost::iostreams::seekable_device_tag
+            , boost::iostreams::flushable_tag
+            , boost::iostreams::closable_tag
+        { };
 
         FileDevice() = delete;
         explicit FileDevice(SharedFile const &entry);
 
         std::streamsize read(char* s, std::streamsize n);
         std::streamsize write(const char* s, std::streamsize n);
+
+        /// writes are held in the file's write buffer until flushed; a
+        /// stream or boost::iostreams::copy flushes on close
+        bool flush();
+        void close();
         std::streampos seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way);
         std::streampos tellg() const;
         std::streampos tellp() const;
@@ -0,0 +1,126 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace knoxcrypt
+{
+
+    /**
+     * Keeps up to a queue depth of transfers in flight on a worker thread
+     * whilst the submitting thread carries on. Each transfer is an operation,
+     * run on the worker in the order submitted, and a completion, run on the
+     * submitting thread with the operation's result, also in order, as
+     * submit makes room or when wait is called. An exception thrown by an
+     * operation is thrown again from where its completion would have run.
+     *
+     * With a depth of zero, or if no thread can be started, each operation
+     * and its completion are simply run in turn by submit.
+     */
+    class IOQueue
+    {
+      public:
+        using Operation = std::function<std::streamsize()>;
+        using Completion = std::function<void(std::streamsize)>;
+
+        IOQueue() = delete;
+        IOQueue(IOQueue const &) = delete;
+        IOQueue& operator=(IOQueue const &) = delete;
+
+        /**
+         * @param depth the number of transfers that may be in flight
+         */
+        explicit IOQueue(size_t const depth);
+
+        /**
+         * @brief stops the worker once its current operation is done; the
+         * completions of anything not yet waited for are not run
+         */
+        ~IOQueue();
+
+        /**
+         * @brief queues a transfer, first completing as many of the earlier
+         * ones as needed to stay within the depth
+         * @param operation the transfer, returning the bytes moved
+         * @param completion called with what the operation returned
+         */
+        void submit(Operation const &operation, Completion const &completion);
+
+        /**
+         * @brief completes everything submitted
+         */
+        void wait();
+
+        /**
+         * @brief whether operations run on a worker rather than in submit
+         */
+        bool isAsynchronous() const;
+
+      private:
+        struct Request
+        {
+            Operation operation;
+            Completion completion;
+            std::streamsize result;
+            std::exception_ptr error;
+            bool done;
+        };
+        using SharedRequest = std::shared_ptr<Request>;
+
+        size_t m_depth;
+
+        // requests awaiting completion, in the order submitted
+        std::deque<SharedRequest> m_submitted;
+
+        // requests the worker has yet to run
+        std::deque<SharedRequest> m_pending;
+
+        std::mutex m_mutex;
+        std::condition_variable m_work;
+        std::condition_variable m_done;
+        bool m_stopping;
+        std::thread m_worker;
+
+        void run();
+
+        /**
+         * @brief waits for the oldest request and runs its completion
+         */
+        void completeOldest();
+    };
+
+}
@@ -0,0 +1,94 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <ios>
+#include <string>
+
+namespace knoxcrypt
+{
+
+    /**
+     * Tells the kernel to drop the image's pages from its page cache once
+     * they have been read, so that the ciphertext isn't cached as well as
+     * whatever plaintext is kept of it. Ranges read are gathered up and
+     * dropped together once enough has been read. Pages still waiting to be
+     * written can't be dropped; those go after a sync.
+     *
+     * Unlike opening the image with O_DIRECT this needs nothing of how the
+     * crypto stream opens and buffers the file, nor any alignment of the
+     * blocks in it.
+     *
+     * Where posix_fadvise isn't to be had this does nothing.
+     */
+    class ImageCacheAdvisor
+    {
+      public:
+        ImageCacheAdvisor() = delete;
+        ImageCacheAdvisor(ImageCacheAdvisor const &) = delete;
+        ImageCacheAdvisor& operator=(ImageCacheAdvisor const &) = delete;
+
+        /**
+         * @param path the path of the image
+         */
+        explicit ImageCacheAdvisor(std::string const &path);
+
+        /**
+         * @brief drops whatever has been read since the last drop
+         */
+        ~ImageCacheAdvisor();
+
+        /**
+         * @brief notes a range of the image as read
+         * @param offset the start of the range
+         * @param n the number of bytes read
+         */
+        void read(std::streamoff const offset, std::streamsize const n);
+
+        /**
+         * @brief drops the whole image from the cache; once synced, that
+         * includes anything written
+         * @param path the path of the image
+         */
+        static void drop(std::string const &path);
+
+      private:
+        int m_fd;
+
+        // the span read since the last drop, empty when m_low == m_high
+        std::streamoff m_low;
+        std::streamoff m_high;
+
+        // the pages read since the last drop, in bytes
+        std::streamoff m_bytes;
+
+        void dropRead();
+    };
+
+}
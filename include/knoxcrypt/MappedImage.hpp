@@ -0,0 +1,190 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ImageCacheAdvisor.hpp"
+#include "cryptostreampp/CryptoStreamPP.hpp"
+
+#include <ios>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace knoxcrypt
+{
+
+    /**
+     * A bounded cache of decrypted pages of an image. Pages are decrypted
+     * in to a slot through the crypto stream the first time they are
+     * touched and reads and writes are then copies to and from the slot.
+     * When every slot is taken the least recently used page, by a clock
+     * sweep, is encrypted back to the stream if written to and its slot
+     * reused. Written pages are also encrypted back by flush.
+     *
+     * The slots are locked in memory, kept out of core dumps and zeroed
+     * before they are unmapped, so plaintext is never swapped and is held
+     * for no more of the image than the capacity asked for.
+     *
+     * Only the bytes of the image that existed when the cache was made
+     * are covered; anything beyond them has to go through the stream.
+     */
+    class MappedImage
+    {
+      public:
+        MappedImage() = delete;
+        MappedImage(MappedImage const &) = delete;
+        MappedImage& operator=(MappedImage const &) = delete;
+
+        /**
+         * @brief caches the image read through the given stream
+         * @param stream the stream pages are decrypted from and encrypted to
+         * @param size the number of bytes of the image to cover
+         * @param capacity the most bytes of decrypted pages to hold, rounded
+         * down to whole pages but never less than one
+         * @param advisor if not null, told of the pages loaded
+         * @note throws std::bad_alloc if the slots could not be mapped or
+         * locked in memory
+         */
+        MappedImage(cryptostreampp::SharedCryptoStream const &stream,
+                    std::streamoff const size,
+                    uint64_t const capacity,
+                    std::shared_ptr<ImageCacheAdvisor> const &advisor);
+
+        /**
+         * @brief writes back any pages still written to, then zeroes,
+         * unlocks and unmaps the slots
+         */
+        ~MappedImage();
+
+        /**
+         * @brief whether the slots for a given capacity can be locked in
+         * memory, so that a caller can refuse to go on without them
+         * @param capacity the capacity as passed to the constructor
+         * @return true if they can
+         */
+        static bool canLock(uint64_t const capacity);
+
+        /**
+         * @brief whether a range of the image lies entirely in what is covered
+         * @param offset the start of the range
+         * @param n the number of bytes in the range
+         * @return true if covered
+         */
+        bool covers(std::streamoff const offset, std::streamsize const n) const;
+
+        /**
+         * @brief copies cached bytes, decrypting any pages not yet loaded
+         * @param buf where to store the data
+         * @param n the number of bytes to read
+         * @param offset where in the image to read from
+         * @return false if a page could not be loaded or one evicted for it
+         * could not be written back
+         */
+        bool read(char * const buf, std::streamsize const n, std::streamoff const offset);
+
+        /**
+         * @brief copies bytes in to the cache to be written back on flush
+         * or eviction
+         * @param buf the data to write
+         * @param n the number of bytes to write
+         * @param offset where in the image to write to
+         * @return false if a partly written page could not be loaded or one
+         * evicted for it could not be written back
+         */
+        bool write(char const * buf, std::streamsize const n, std::streamoff const offset);
+
+        /**
+         * @brief encrypts every page written to back to the stream, in
+         * order of offset
+         * @return false if the stream failed
+         */
+        bool flush();
+
+        /**
+         * @brief writes back and then drops the pages overlapping a range so
+         * that they are decrypted again from the stream when next used; for
+         * when the image has been written to by some other means
+         * @param offset the start of the range
+         * @param n the number of bytes in the range
+         */
+        void forget(std::streamoff const offset, std::streamsize const n);
+
+        /**
+         * @brief writes back and then drops every page
+         */
+        void forget();
+
+      private:
+        cryptostreampp::SharedCryptoStream m_stream;
+        std::shared_ptr<ImageCacheAdvisor> m_advisor;
+        std::streamoff m_size;
+        std::streamoff m_pageSize;
+        std::size_t m_slotCount;
+        char *m_slots;
+        std::unordered_map<uint64_t, std::size_t> m_slotOfPage;
+        std::vector<uint64_t> m_pageOfSlot;
+        std::vector<bool> m_referenced;
+        std::vector<bool> m_dirty;
+        std::size_t m_hand;
+
+        /**
+         * @brief the number of slots for a capacity
+         */
+        static std::size_t slotsFor(uint64_t const capacity, std::streamoff const pageSize);
+
+        /**
+         * @brief finds the slot holding a page, taking one for it if there is
+         * none
+         * @param page the page
+         * @param load whether a page newly given a slot is decrypted in to it;
+         * not needed when it is about to be overwritten in full
+         * @param slot set to the slot
+         * @return false if the page could not be loaded or the page evicted
+         * for it could not be written back
+         */
+        bool slotFor(uint64_t const page, bool const load, std::size_t &slot);
+
+        /**
+         * @brief encrypts a slot's page back to the stream if written to
+         * @return false if the stream failed
+         */
+        bool writeBack(std::size_t const slot);
+
+        /**
+         * @brief empties a slot
+         */
+        void drop(std::size_t const slot);
+
+        /**
+         * @brief the number of image bytes in a page
+         */
+        std::streamsize pageBytes(uint64_t const page) const;
+    };
+
+}
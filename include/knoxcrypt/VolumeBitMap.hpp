@@ -0,0 +1,316 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+
+#include <boost/optional.hpp>
+
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace knoxcrypt
+{
+
+    class VolumeBitMap;
+    using SharedVolumeBitMap = std::shared_ptr<VolumeBitMap>;
+
+    /**
+     * @brief an in-memory copy of the volume bitmap
+     *
+     * Rather than doing an encrypted read-modify-write-flush of the image
+     * for every block that is allocated or freed, bits are set and cleared
+     * in memory and the byte ranges that have been touched are recorded.
+     * These dirty ranges are then written back in one go when sync is called,
+     * when a write-back interval elapses or when the bitmap is destroyed.
+     *
+     * When io->useBlockCache is false, the image might be shared with other
+     * CoreIO instances in which case all queries re-read the bitmap from the
+     * image and all updates are written straight back.
+     *
+     * Searching and counting is done a word (or with AVX2, 32 bytes) at a
+     * time using the kernels in detail/DetailBitMap.hpp.
+     *
+     * On top of the bitmap sits a summary level that records the number of
+     * free blocks in each group of GROUP_BLOCKS blocks along with one bit per
+     * group that is set when the group has any free space. Searches use it to
+     * skip over full groups so that allocating on a large, mostly full volume
+     * doesn't mean scanning the bitmap from the start. The summary is derived
+     * from the bitmap whenever bytes are read in and kept up to date as bits
+     * are set and cleared, so it never needs to be written to the image.
+     *
+     * All public member functions take an internal lock so that writers on
+     * different threads can allocate (see AllocationGroups) at the same time.
+     */
+    class VolumeBitMap
+    {
+      public:
+        using OptionalBlock = boost::optional<uint64_t>;
+
+        /// a run of consecutive blocks; the first block and the number of blocks
+        using Extent = std::pair<uint64_t, uint64_t>;
+
+        /// the number of blocks summarised by each group
+        static uint64_t const GROUP_BLOCKS = 4096;
+
+        VolumeBitMap();
+
+        /// writes back any outstanding dirty ranges
+        ~VolumeBitMap();
+
+        /**
+         * @brief  determines whether a file block is in use
+         * @param  io the core knoxcrypt io
+         * @param  block the block to check
+         * @return true if allocated, false otherwise
+         */
+        bool isBlockInUse(SharedCoreIO const &io, uint64_t const block);
+
+        /**
+         * @brief  determines whether each of a set of file blocks is in use
+         * @param  io the core knoxcrypt io
+         * @param  blocks the blocks to check
+         * @return for each block in blocks, true if allocated
+         */
+        std::vector<bool> areBlocksInUse(SharedCoreIO const &io,
+                                         std::vector<uint64_t> const &blocks);
+
+        /**
+         * @brief  determines whether every block in a range is in use
+         * @param  io the core knoxcrypt io
+         * @param  first the first block of the range
+         * @param  count the number of blocks in the range
+         * @return true if all blocks in the range are allocated
+         */
+        bool isRangeInUse(SharedCoreIO const &io, uint64_t const first, uint64_t const count);
+
+        /**
+         * @brief  determines whether every block in a range is free
+         * @param  io the core knoxcrypt io
+         * @param  first the first block of the range
+         * @param  count the number of blocks in the range
+         * @return true if no block in the range is allocated
+         */
+        bool isRangeFree(SharedCoreIO const &io, uint64_t const first, uint64_t const count);
+
+        /**
+         * @brief sets (or clears) the in use bit of a block
+         * @param io the core knoxcrypt io
+         * @param block the block to update
+         * @param set true to mark as in use, false to mark as free
+         */
+        void setBlockInUse(SharedCoreIO const &io, uint64_t const block, bool const set = true);
+
+        /**
+         * @brief sets (or clears) the in use bits of several blocks
+         * @param io the core knoxcrypt io
+         * @param blocks the blocks to update
+         * @param set true to mark as in use, false to mark as free
+         */
+        void setBlocksInUse(SharedCoreIO const &io,
+                            std::vector<uint64_t> const &blocks,
+                            bool const set = true);
+
+        /**
+         * @brief  gets the next available block
+         * @param  io the core knoxcrypt io
+         * @return the next available block if there is one
+         */
+        OptionalBlock getNextAvailableBlock(SharedCoreIO const &io);
+
+        /**
+         * @brief  gets up to N available blocks
+         * @param  io the core knoxcrypt io
+         * @param  blocksRequired the number of blocks required
+         * @param  fromBlock the block to start searching from
+         * @return the available block indices; might be fewer than blocksRequired
+         */
+        std::vector<uint64_t> getNAvailableBlocks(SharedCoreIO const &io,
+                                                  uint64_t const blocksRequired,
+                                                  uint64_t const fromBlock = 0);
+
+        /**
+         * @brief  gets the first run of consecutive available blocks
+         * @param  io the core knoxcrypt io
+         * @param  runLength the number of consecutive blocks required
+         * @return the first block of the run if there is one
+         */
+        OptionalBlock getAvailableRun(SharedCoreIO const &io,
+                                      uint64_t const runLength);
+
+        /**
+         * @brief  gets every run of consecutive available blocks in a range
+         * @param  io the core knoxcrypt io
+         * @param  fromBlock the first block of the range
+         * @param  endBlock one past the last block of the range
+         * @return the free extents in block order, clipped to the range
+         */
+        std::vector<Extent> getFreeExtents(SharedCoreIO const &io,
+                                           uint64_t const fromBlock = 0,
+                                           uint64_t const endBlock = std::numeric_limits<uint64_t>::max());
+
+        /**
+         * @brief  counts the number of blocks currently allocated
+         * @param  io the core knoxcrypt io
+         * @return the number of allocated blocks
+         */
+        uint64_t getNumberOfAllocatedBlocks(SharedCoreIO const &io);
+
+        /**
+         * @brief  gets the number of free blocks in a group
+         * @param  io the core knoxcrypt io
+         * @param  group the group index; the group's first block over GROUP_BLOCKS
+         * @return the number of free blocks in the group
+         */
+        uint64_t getFreeBlocksInGroup(SharedCoreIO const &io, uint64_t const group);
+
+        /**
+         * @brief writes any dirty bitmap ranges back to the image
+         */
+        void sync();
+
+      private:
+
+        using BitMapMutex = std::mutex;
+        using BitMapLock = std::lock_guard<BitMapMutex>;
+        mutable BitMapMutex m_mutex;
+
+        // the decrypted bitmap bytes
+        std::vector<uint8_t> m_bitMap;
+
+        // byte ranges of m_bitMap that still need writing back;
+        // maps the first dirty byte to one past the last dirty byte
+        using DirtyRanges = std::map<uint64_t, uint64_t>;
+        DirtyRanges m_dirtyRanges;
+
+        // the summary level; the number of free blocks in each group and
+        // one bit per group, set when the group has any free blocks
+        std::vector<uint32_t> m_groupFreeCounts;
+        std::vector<uint8_t> m_groupsWithFree;
+
+        // the total number of set bits in m_bitMap
+        uint64_t m_allocatedBlocks;
+
+        // used for reading in and writing back the bitmap
+        SharedImageStream m_stream;
+
+        // has the full bitmap been read in yet?
+        bool m_loaded;
+
+        // when the dirty ranges were last written back
+        std::chrono::steady_clock::time_point m_lastWriteBack;
+
+        /**
+         * @brief reads in the bitmap if it hasn't been read in yet or
+         * if the image might be shared
+         * @param io the core knoxcrypt io
+         */
+        void checkAndLoad(SharedCoreIO const &io);
+
+        /**
+         * @brief makes sure that a byte range of the bitmap is current. When
+         * the image might be shared, only that range is re-read.
+         * @param io the core knoxcrypt io
+         * @param begin the first byte needed
+         * @param end one past the last byte needed
+         */
+        void checkAndLoadBytes(SharedCoreIO const &io, uint64_t const begin, uint64_t const end);
+
+        /**
+         * @brief re-reads a byte range of the bitmap from the image
+         * @param io the core knoxcrypt io
+         * @param begin the first byte to read
+         * @param end one past the last byte to read
+         */
+        void refreshBytes(SharedCoreIO const &io, uint64_t const begin, uint64_t const end);
+
+        /**
+         * @brief recomputes the summary of every group overlapping a byte range
+         * @param begin the first byte that changed
+         * @param end one past the last byte that changed
+         */
+        void summariseGroups(uint64_t const begin, uint64_t const end);
+
+        /**
+         * @brief updates a group's bit in m_groupsWithFree from its free count
+         * @param group the group index
+         */
+        void updateGroupWithFree(uint64_t const group);
+
+        /**
+         * @brief  gets the number of blocks in a group; the final group might
+         * be shorter than GROUP_BLOCKS
+         * @param  group the group index
+         * @return the number of blocks in the group
+         */
+        uint64_t groupSize(uint64_t const group) const;
+
+        /**
+         * @brief  finds the first set or unset bit at or after a given block,
+         * skipping groups that are known not to contain one
+         * @param  fromBlock the block to start searching from
+         * @param  set true to find an allocated block, false for a free one
+         * @return the block found or detail::NO_BIT
+         */
+        uint64_t findFirstBlock(uint64_t const fromBlock, bool const set) const;
+
+        /**
+         * @brief set or clear a bit in memory and record its byte as dirty
+         * @param block the block whose bit is to be updated
+         * @param set whether to set or clear the bit
+         */
+        void doSetBlockInUse(uint64_t const block, bool const set);
+
+        /**
+         * @brief records a byte as dirty, merging with neighbouring ranges
+         * @param byte the byte index
+         */
+        void markDirty(uint64_t const byte);
+
+        /**
+         * @brief writes back dirty ranges if not caching or if the write-back
+         * interval has elapsed
+         * @param io the core knoxcrypt io
+         */
+        void checkAndWriteBack(SharedCoreIO const &io);
+
+        /// writes back dirty ranges; the caller must hold m_mutex
+        void doSync();
+
+        /// initialize m_stream if not already done so
+        void initImageStream(SharedCoreIO const &io);
+    };
+
+}
@@ -0,0 +1,219 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace knoxcrypt { namespace detail
+{
+
+    /// returned by the bit scanning functions when no bit could be found
+    uint64_t const NO_BIT = std::numeric_limits<uint64_t>::max();
+
+    /**
+     * @brief loads 8 bitmap bytes as a word such that bit b of the word
+     * corresponds to bit b % 8 of byte b / 8
+     * @param bytes where to load the word from; needn't be aligned
+     * @return the word
+     */
+    inline uint64_t loadBitMapWord(uint8_t const *bytes)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        return word;
+    }
+
+    /**
+     * @brief counts the number of set bits in a word
+     * @param word the word to count the bits of
+     * @return the number of set bits
+     */
+    inline uint64_t popCount(uint64_t const word)
+    {
+        return __builtin_popcountll(word);
+    }
+
+    /**
+     * @brief counts the number of trailing zeros in a word
+     * @param word the word to count the trailing zeros of; must not be zero
+     * @return the index of the lowest set bit
+     */
+    inline uint64_t countTrailingZeros(uint64_t const word)
+    {
+        return __builtin_ctzll(word);
+    }
+
+    /**
+     * @brief counts the number of set bits in a bitmap
+     * @param bytes the bitmap
+     * @param count the number of bytes in the bitmap
+     * @return the number of set bits
+     */
+    inline uint64_t countSetBits(uint8_t const *bytes, uint64_t const count)
+    {
+        uint64_t setBits(0);
+        uint64_t i(0);
+#ifdef __AVX2__
+        // nibble lookup popcount; per-byte counts are summed in to four
+        // 64-bit lanes with sad so that the accumulators can't overflow
+        __m256i const lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        __m256i const lowMask = _mm256_set1_epi8(0x0F);
+        __m256i totals = _mm256_setzero_si256();
+        for (; i + 32 <= count; i += 32) {
+            __m256i const v = _mm256_loadu_si256((__m256i const*)(bytes + i));
+            __m256i const lo = _mm256_and_si256(v, lowMask);
+            __m256i const hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+            __m256i const perByte = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                                    _mm256_shuffle_epi8(lookup, hi));
+            totals = _mm256_add_epi64(totals, _mm256_sad_epu8(perByte, _mm256_setzero_si256()));
+        }
+        setBits += (uint64_t)_mm256_extract_epi64(totals, 0) + (uint64_t)_mm256_extract_epi64(totals, 1) +
+                   (uint64_t)_mm256_extract_epi64(totals, 2) + (uint64_t)_mm256_extract_epi64(totals, 3);
+#endif
+        for (; i + 8 <= count; i += 8) {
+            setBits += popCount(loadBitMapWord(bytes + i));
+        }
+        for (; i < count; ++i) {
+            setBits += popCount(bytes[i]);
+        }
+        return setBits;
+    }
+
+    /**
+     * @brief finds the first bit at or after a given bit that is either set or
+     * unset. Whole words (or 32 byte vectors with AVX2) that can't contain
+     * such a bit are skipped over.
+     * @param bytes the bitmap
+     * @param count the number of bytes in the bitmap
+     * @param fromBit the bit to start searching from
+     * @param set true to search for a set bit, false for an unset bit
+     * @return the index of the bit or NO_BIT if there isn't one
+     */
+    inline uint64_t findFirstBit(uint8_t const *bytes,
+                                 uint64_t const count,
+                                 uint64_t const fromBit,
+                                 bool const set)
+    {
+        uint64_t i = fromBit / 8;
+        if (i >= count) {
+            return NO_BIT;
+        }
+
+        // bytes are flipped when looking for an unset bit so that in
+        // either case we're looking for the first non-zero bit
+        uint8_t const flipByte = set ? 0x00 : 0xFF;
+        uint64_t const flipWord = set ? 0 : ~uint64_t(0);
+
+        // the first byte; bits before fromBit are ignored
+        uint8_t const first = (bytes[i] ^ flipByte) & uint8_t(0xFF << (fromBit % 8));
+        if (first) {
+            return (i * 8) + countTrailingZeros(first);
+        }
+        ++i;
+
+#ifdef __AVX2__
+        __m256i const skip = _mm256_set1_epi8((char)flipByte);
+        for (; i + 32 <= count; i += 32) {
+            __m256i const v = _mm256_loadu_si256((__m256i const*)(bytes + i));
+            uint32_t const skippable = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, skip));
+            if (skippable != 0xFFFFFFFF) {
+                uint64_t const byte = i + countTrailingZeros(~skippable);
+                return (byte * 8) + countTrailingZeros(uint8_t(bytes[byte] ^ flipByte));
+            }
+        }
+#endif
+        for (; i + 8 <= count; i += 8) {
+            uint64_t const word = loadBitMapWord(bytes + i) ^ flipWord;
+            if (word) {
+                return (i * 8) + countTrailingZeros(word);
+            }
+        }
+        for (; i < count; ++i) {
+            uint8_t const byte = bytes[i] ^ flipByte;
+            if (byte) {
+                return (i * 8) + countTrailingZeros(byte);
+            }
+        }
+        return NO_BIT;
+    }
+
+    /**
+     * @brief finds the first unset bit at or after a given bit
+     * @param bytes the bitmap
+     * @param count the number of bytes in the bitmap
+     * @param fromBit the bit to start searching from
+     * @return the index of the bit or NO_BIT if there isn't one
+     */
+    inline uint64_t findFirstUnsetBit(uint8_t const *bytes,
+                                      uint64_t const count,
+                                      uint64_t const fromBit = 0)
+    {
+        return findFirstBit(bytes, count, fromBit, false);
+    }
+
+    /**
+     * @brief finds the first run of consecutive unset bits
+     * @param bytes the bitmap
+     * @param count the number of bytes in the bitmap
+     * @param runLength the number of consecutive unset bits required
+     * @param fromBit the bit to start searching from
+     * @return the index of the first bit of the run or NO_BIT if there isn't one
+     */
+    inline uint64_t findFirstUnsetRun(uint8_t const *bytes,
+                                      uint64_t const count,
+                                      uint64_t const runLength,
+                                      uint64_t const fromBit = 0)
+    {
+        uint64_t const bits = count * 8;
+        uint64_t begin = findFirstBit(bytes, count, fromBit, false);
+        while (begin != NO_BIT) {
+            uint64_t end = findFirstBit(bytes, count, begin, true);
+            if (end == NO_BIT) {
+                end = bits;
+            }
+            if (end - begin >= runLength) {
+                return begin;
+            }
+            begin = findFirstBit(bytes, count, end, false);
+        }
+        return NO_BIT;
+    }
+
+}
+}
@@ -42,17 +42,20 @@ namespace knoxcrypt { namespace detail
     /**
      * @brief gets the offset of a given file block
      * @param block the file block that we want to get the offset of
+     * @param totalBlocks the total number of blocks in the knoxcrypt
+     * @param blockSize the size of each block in the knoxcrypt
      * @return the offset of the file block
      */
     inline uint64_t getOffsetOfFileBlock(uint64_t const block,
-                                         uint64_t const totalBlocks)
+                                         uint64_t const totalBlocks,
+                                         uint64_t const blockSize)
     {
         uint64_t const volumeBitMapBytes = totalBlocks / uint64_t(8);
         return beginning()                 // where main start after IV
             + 8                            // number of fs blocks
             + volumeBitMapBytes            // volume bit map
             + 8                            // total number of files
-            + (FILE_BLOCK_SIZE * block);   // file block
+            + (blockSize * block);         // file block
     }
 
     /**
@@ -60,16 +63,17 @@ namespace knoxcrypt { namespace detail
      * @param in the knoxcrypt image stream
      * @param n the file block to get the next index from
      * @param totalBlocks the total number of blocks in the knoxcrypt
+     * @param blockSize the size of each block in the knoxcrypt
      * @return the next file block index
      */
     inline uint64_t getIndexOfNextFileBlockFromFileBlockN(knoxcrypt::ContainerImageStream &in,
                                                           uint64_t const n,
-                                                          uint64_t const totalBlocks)
+                                                          uint64_t const totalBlocks,
+                                                          uint64_t const blockSize)
     {
-        auto offset = getOffsetOfFileBlock(n, totalBlocks) + 4;
-        (void)in.seekg(offset);
+        auto offset = getOffsetOfFileBlock(n, totalBlocks, blockSize) + 4;
         uint8_t dat[8];
-        (void)in.read((char*)dat, 8);
+        (void)in.readAt((char*)dat, 8, offset);
         return convertInt8ArrayToInt64(dat);
     }
 
@@ -78,16 +82,17 @@ namespace knoxcrypt { namespace detail
      * @param in the knoxcrypt image stream
      * @param n the file block to get the next index from
      * @param totalBlocks the total number of blocks in the knoxcrypt
+     * @param blockSize the size of each block in the knoxcrypt
      * @return the next file block index
      */
     inline uint32_t getNumberOfDataBytesWrittenToFileBlockN(knoxcrypt::ContainerImageStream &in,
                                                             uint64_t const n,
-                                                            uint64_t const totalBlocks)
+                                                            uint64_t const totalBlocks,
+                                                            uint64_t const blockSize)
     {
-        uint64_t offset = getOffsetOfFileBlock(n, totalBlocks);
-        (void)in.seekg(offset);
+        uint64_t offset = getOffsetOfFileBlock(n, totalBlocks, blockSize);
         uint8_t dat[4];
-        (void)in.read((char*)dat, 4);
+        (void)in.readAt((char*)dat, 4, offset);
         return convertInt4ArrayToInt32(dat);
     }
 
@@ -99,26 +104,19 @@ namespace knoxcrypt { namespace detail
      */
     inline void writeBlock(SharedCoreIO const &io, ContainerImageStream &out, uint64_t const block)
     {
+        // the metadata and zeroed data bytes go out in the one write
         std::vector<uint8_t> ints;
-        ints.assign(FILE_BLOCK_SIZE - FILE_BLOCK_META, 0);
-
-        // write out block metadata
-        uint64_t offset = getOffsetOfFileBlock(block, io->blocks);
-        (void)out.seekp(offset);
+        ints.assign(io->blockSize, 0);
 
-        // write m_bytesWritten; 0 to begin with
-        uint8_t sizeDat[4];
+        // m_bytesWritten; 0 to begin with
         uint32_t size = 0;
-        convertInt32ToInt4Array(size, sizeDat);
-        (void)out.write((char*)sizeDat, 4);
+        convertInt32ToInt4Array(size, &ints[0]);
 
-        // write m_next; begins as same as index
-        uint8_t nextDat[8];
-        convertUInt64ToInt8Array(block, nextDat);
-        (void)out.write((char*)nextDat, 8);
+        // m_next; begins as same as index
+        convertUInt64ToInt8Array(block, &ints[4]);
 
-        // write data bytes
-        (void)out.write((char*)&ints.front(), FILE_BLOCK_SIZE - FILE_BLOCK_META);
+        uint64_t offset = getOffsetOfFileBlock(block, io->blocks, io->blockSize);
+        (void)out.writeAt((char*)&ints.front(), io->blockSize, offset);
 
         assert(!out.bad());
     }
@@ -46,15 +46,13 @@ namespace knoxcrypt { namespace detail
                                    uint64_t const inc = 1)
     {
         //knoxcrypt::ContainerImageStream out(io, std::ios::in | std::ios::out | std::ios::binary);
-        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks);
-        (void)out.seekg(offset + FILE_BLOCK_META);
+        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks, io->blockSize);
         uint8_t buf[8];
-        (void)out.read((char*)buf, 8);
+        (void)out.readAt((char*)buf, 8, offset + FILE_BLOCK_META);
         uint64_t count = convertInt8ArrayToInt64(buf);
         count += inc;
-        (void)out.seekp(offset + FILE_BLOCK_META);
         convertUInt64ToInt8Array(count, buf);
-        (void)out.write((char*)buf, 8);
+        (void)out.writeAt((char*)buf, 8, offset + FILE_BLOCK_META);
     }
 
     /// for writing directly the entry count
@@ -64,11 +62,10 @@ namespace knoxcrypt { namespace detail
                                uint64_t const entryCount)
     {
         //knoxcrypt::ContainerImageStream out(io, std::ios::in | std::ios::out | std::ios::binary);
-        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks);
+        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks, io->blockSize);
         uint8_t buf[8];
-        (void)out.seekp(offset + FILE_BLOCK_META);
         convertUInt64ToInt8Array(entryCount, buf);
-        (void)out.write((char*)buf, 8);
+        (void)out.writeAt((char*)buf, 8, offset + FILE_BLOCK_META);
     }
 
     /// for reading entry count, decrementing it and then writing value back out again
@@ -77,15 +74,13 @@ namespace knoxcrypt { namespace detail
                                    uint64_t const dec = 1)
     {
         knoxcrypt::ContainerImageStream out(io, std::ios::in | std::ios::out | std::ios::binary);
-        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks);
-        (void)out.seekg(offset + FILE_BLOCK_META);
+        uint64_t const offset = getOffsetOfFileBlock(startBlock, io->blocks, io->blockSize);
         uint8_t buf[8];
-        (void)out.read((char*)buf, 8);
+        (void)out.readAt((char*)buf, 8, offset + FILE_BLOCK_META);
         uint64_t count = convertInt8ArrayToInt64(buf);
         count -= dec;
-        (void)out.seekp(offset + FILE_BLOCK_META);
         convertUInt64ToInt8Array(count, buf);
-        (void)out.write((char*)buf, 8);
+        (void)out.writeAt((char*)buf, 8, offset + FILE_BLOCK_META);
     }
 
 }
@@ -29,9 +29,12 @@
 #pragma once
 
 #include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "knoxcrypt/detail/DetailBitMap.hpp"
 
 #include <boost/optional.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <stdint.h>
 #include <vector>
@@ -43,13 +46,26 @@ namespace knoxcrypt { namespace detail
     uint64_t const METABLOCKS_BEGIN = 24;
     uint64_t const METABLOCK_SIZE = 25;
     uint64_t const MAX_FILENAME_LENGTH = 255;
-    uint64_t const FILE_BLOCK_SIZE = 4096;
+    uint64_t const FILE_BLOCK_SIZE = 4096; // the default; see CoreIO::blockSize
     uint64_t const FILE_BLOCK_META = 12;
+    uint64_t const MIN_FILE_BLOCK_SIZE = 4096;
+    uint64_t const MAX_FILE_BLOCK_SIZE = 1024 * 1024;
     uint64_t const IV_BYTES = 8;
     uint64_t const HEADER_BYTES = 8;
     long     const CIPHER_BUFFER_SIZE = 270000000;
     uint64_t const PASS_HASH_BYTES = 32;
 
+    /// the last header byte holds format feature flags when its top bit is
+    /// set; older images repeat the cipher byte there instead
+    uint64_t const FEATURES_OFFSET = (IV_BYTES * 4) + HEADER_BYTES - 1;
+    uint8_t  const FEATURES_PRESENT = 0x80;
+    uint8_t  const FEATURE_INDEXED_FILES = 0x01;
+    uint8_t  const FEATURE_BLOCK_SIZE = 0x02;
+
+    /// with FEATURE_BLOCK_SIZE set, the header byte before the features byte
+    /// holds the log2 of the image's block size in place of a cipher byte
+    uint64_t const BLOCK_SIZE_OFFSET = FEATURES_OFFSET - 1;
+
     inline void convertUInt64ToInt8Array(uint64_t const bigNum, uint8_t array[8])
     {
         array[0] = static_cast<uint8_t>((bigNum >> 56) & 0xFF);
@@ -101,8 +117,7 @@ namespace knoxcrypt { namespace detail
      */
     inline void getPassHash(knoxcrypt::ContainerImageStream &in, uint8_t hash[32])
     {
-        in.seekg(beginning() - PASS_HASH_BYTES);
-        (void)in.read((char*)hash, 32);
+        (void)in.readAt((char*)hash, 32, beginning() - PASS_HASH_BYTES);
     }
 
     /**
@@ -112,8 +127,7 @@ namespace knoxcrypt { namespace detail
      */
     inline uint64_t getImageSize(knoxcrypt::ContainerImageStream &in)
     {
-        in.seekg(0, std::ios::end);
-        uint64_t const bytes(in.tellg());
+        uint64_t const bytes(in.size());
         return bytes;
     }
 
@@ -124,9 +138,8 @@ namespace knoxcrypt { namespace detail
      */
     inline uint64_t getBlockCount(knoxcrypt::ContainerImageStream &in)
     {
-        in.seekg(beginning());
         uint8_t dat[8];
-        (void)in.read((char*)dat, 8);
+        (void)in.readAt((char*)dat, 8, beginning());
         return convertInt8ArrayToInt64(dat);
     }
 
@@ -137,9 +150,8 @@ namespace knoxcrypt { namespace detail
      */
     inline uint64_t getNumberOfBlocks(knoxcrypt::ContainerImageStream &in)
     {
-        (void)in.seekg(beginning());
         uint8_t dat[8];
-        (void)in.read((char*)dat, 8);
+        (void)in.readAt((char*)dat, 8, beginning());
         return convertInt8ArrayToInt64(dat);
     }
 
@@ -199,12 +211,10 @@ namespace knoxcrypt { namespace detail
         uint64_t byteThatStoresBit(0);
         if (block < 8) {
 
-            (void)in.seekg(beginning() + 8);
             uint8_t dat;
-            (void)in.read((char*)&dat, 1);
+            (void)in.readAt((char*)&dat, 1, beginning() + 8);
             setBitInByte(dat, block, set);
-            (void)in.seekp(beginning() + 8);
-            (void)in.write((char*)&dat, 1);
+            (void)in.writeAt((char*)&dat, 1, beginning() + 8);
 
         } else {
 
@@ -212,52 +222,59 @@ namespace knoxcrypt { namespace detail
             uint64_t withoutLeftOver = block - leftOver;
             byteThatStoresBit = (withoutLeftOver / 8) - 1;
             ++byteThatStoresBit;
-            (void)in.seekg(beginning() + 8 + byteThatStoresBit);
             uint8_t dat;
-            (void)in.read((char*)&dat, 1);
+            (void)in.readAt((char*)&dat, 1, beginning() + 8 + byteThatStoresBit);
             setBitInByte(dat, leftOver, set);
-            (void)in.seekp(beginning() + 8 + byteThatStoresBit);
-            (void)in.write((char*)&dat, 1);
+            (void)in.writeAt((char*)&dat, 1, beginning() + 8 + byteThatStoresBit);
         }
         in.flush();
     }
 
     /**
-     * @brief determines whether a file block is in use
+     * @brief determines whether a file block is in use. Only the byte
+     * that stores the block's bit is read.
      * @param block the block to determine if in use
      * @param blocks the total number of file blocks
      * @param in the stream to read from
      * @return true if allocated, false otherwise
      */
     inline bool isBlockInUse(uint64_t const block,
-                             uint64_t const blocks,
+                             uint64_t const,// blocks,
                              knoxcrypt::ContainerImageStream &in)
     {
-        uint64_t bytes = blocks / uint64_t(8);
+        uint8_t dat;
+        (void)in.readAt((char*)&dat, 1, beginning() + 8 + (block / uint64_t(8)));
+        return isBitSetInByte(dat, block % 8);
+    }
+
+    /**
+     * @brief determines whether each of a set of file blocks is in use. The
+     * span of bitmap bytes covering the blocks is read once.
+     * @param blocksToCheck the blocks to determine if in use
+     * @param in the stream to read from
+     * @return for each block in blocksToCheck, true if allocated
+     */
+    inline std::vector<bool> areBlocksInUse(std::vector<uint64_t> const &blocksToCheck,
+                                            knoxcrypt::ContainerImageStream &in)
+    {
+        std::vector<bool> inUse(blocksToCheck.size(), false);
+        if (blocksToCheck.empty()) {
+            return inUse;
+        }
+
+        auto minMax = std::minmax_element(blocksToCheck.begin(), blocksToCheck.end());
+        uint64_t const firstByte = *minMax.first / uint64_t(8);
+        uint64_t const bytes = (*minMax.second / uint64_t(8)) - firstByte + 1;
+
         // read the bytes in to a buffer
-        std::vector<uint8_t> buf;
-        buf.assign(bytes, 0);
-        (void)in.seekg(beginning() + 8);
-        (void)in.read((char*)&buf.front(), bytes);
+        std::vector<uint8_t> buf(bytes);
+        (void)in.readAt((char*)&buf.front(), bytes, beginning() + 8 + firstByte);
 
-        uint64_t byteThatStoresBit(0);
-        if (block < 8) {
-            uint8_t dat = buf[byteThatStoresBit];
-            if (dat == 0xFF) {
-                return true;
-            }
-            return isBitSetInByte(dat, block);
-        } else {
-            uint64_t const leftOver = block % 8;
-            uint64_t withoutLeftOver = block - leftOver;
-            byteThatStoresBit = (withoutLeftOver / 8) - 1;
-            ++byteThatStoresBit;
-            uint8_t &dat = buf[byteThatStoresBit];
-            if (dat == 0xFF) {
-                return true;
-            }
-            return isBitSetInByte(dat, leftOver);
+        for (size_t i = 0; i < blocksToCheck.size(); ++i) {
+            uint64_t const block = blocksToCheck[i];
+            inUse[i] = isBitSetInByte(buf[(block / uint64_t(8)) - firstByte], block % 8);
         }
+        return inUse;
     }
 
     /**
@@ -267,9 +284,8 @@ namespace knoxcrypt { namespace detail
      */
     inline uint64_t getNumberOfAllocatedBlocks(knoxcrypt::ContainerImageStream &in)
     {
-        (void)in.seekg(beginning());
         uint8_t dat[8];
-        (void)in.read((char*)dat, 8);
+        (void)in.readAt((char*)dat, 8, beginning());
 
         uint64_t blocks = convertInt8ArrayToInt64(dat);
         uint64_t bytes = blocks / uint64_t(8);
@@ -277,24 +293,10 @@ namespace knoxcrypt { namespace detail
         // read the bytes in to a buffer
         std::vector<uint8_t> buf;
         buf.assign(bytes, 0);
-        (void)in.read((char*)&buf.front(), bytes);
+        (void)in.readAt((char*)&buf.front(), bytes, beginning() + 8);
 
         // note this is quicker than calling isBlockInUse repeatedly
-        uint64_t allocatedBlocks(0);
-        for (uint64_t byte = 0; byte < bytes; ++byte) {
-            uint8_t dat = buf[byte];
-            if(dat == 0xFF) {
-                allocatedBlocks += 8;
-                continue;
-            } 
-            for(int i = 0; i < 8; ++i) {
-                if(isBitSetInByte(dat, i)) {
-                    ++allocatedBlocks;
-                }
-            }
-        }
-
-        return allocatedBlocks;
+        return countSetBits(&buf.front(), bytes);
     }
 
     /**
@@ -309,8 +311,6 @@ namespace knoxcrypt { namespace detail
         uint64_t blocks = blocks_;
         if (blocks == 0) {
             blocks = getNumberOfBlocks(in);
-        } else {
-            (void)in.seekg(beginning() + 8);
         }
 
         // how many bytes does this value fit in to?
@@ -318,33 +318,19 @@ namespace knoxcrypt { namespace detail
 
         // read the bytes in to a buffer
         std::vector<uint8_t> buf(bytes);
-        (void)in.read((char*)&buf.front(), bytes);
+        (void)in.readAt((char*)&buf.front(), bytes, beginning() + 8);
 
         // find out the next available bit
-        uint64_t bitCounter(0);
-
-        for (uint64_t i = 0; i < bytes; ++i) {
-            int availableBit = getNextAvailableBitInAByte(buf[i]);
-            if(availableBit > -1) {
-                bitCounter += availableBit;
-                break;
-            }
-            bitCounter += 8;
-        }
+        uint64_t const bit = findFirstUnsetBit(&buf.front(), bytes);
 
         // no available blocks found
-        if (bitCounter == blocks) {
+        if (bit == NO_BIT) {
             return OptionalBlock();
         }
 
-        // next available block == bitCounter
-        // derive offset from bit counter. Note blocks
+        // next available block == bit. Note blocks
         // to be stored starting at 0 index.
-        // Metadata starts at 8 (block count) + 8 (file count)
-        // + bytes (volume bit map size) + meta data size
-        //uint64_t const offset = 8 + 8 + bytes + getMetaDataSize(blocks) + (FILE_BLOCK_SIZE * bitCounter);
-
-        return OptionalBlock(bitCounter);
+        return OptionalBlock(bit);
     }
 
 
@@ -365,95 +351,192 @@ namespace knoxcrypt { namespace detail
 
         // read the bytes in to a buffer
         std::vector<uint8_t> buf(bytes);
-        (void)in.seekg(beginning() + 8);
-        (void)in.read((char*)&buf.front(), bytes);
+        (void)in.readAt((char*)&buf.front(), bytes, beginning() + 8);
 
 
         // find n available blocks
-        uint64_t eightCounter(0);
         std::vector<uint64_t> bitBuffer(blocksRequired);
         uint64_t filled(0);
-        for (uint64_t i = 0; i < bytes; ++i) {
-            // only continue if at least one bit available
-            if(buf[i] != 0xFF) {
-                for (int b = 0; b < 8; ++b) {
-                    if(!isBitSetInByte(buf[i], b)) {
-                        bitBuffer[filled] = b + eightCounter;
-                        ++filled;
-                        if (filled == blocksRequired) {
-                            return bitBuffer;
-                        }
-                    }
-                }
-            } 
-            
-            eightCounter += 8;
+        uint64_t bit = findFirstUnsetBit(&buf.front(), bytes);
+        while (filled < blocksRequired && bit != NO_BIT) {
+            bitBuffer[filled] = bit;
+            ++filled;
+            bit = findFirstUnsetBit(&buf.front(), bytes, bit + 1);
         }
         return bitBuffer; // return all blocks that could be found
     }
 
+    /// set in the allocation state when the container was cleanly unmounted
+    uint64_t const CLEAN_UNMOUNT_BIT = uint64_t(1) << 63;
+
+    /**
+     * @brief gets where the allocation state is stored; this is the 8 bytes
+     * following the volume bitmap that were originally reserved for a file count.
+     * The top bit is the clean unmount flag, the remaining bits hold the number
+     * of allocated blocks
+     * @param blocks the total number of blocks
+     * @return the offset of the allocation state
+     */
+    inline uint64_t getAllocationStateOffset(uint64_t const blocks)
+    {
+        return beginning() + 8 + (blocks / uint64_t(8));
+    }
+
+    /**
+     * @brief writes the allocation state
+     * @param out the image stream
+     * @param blocks the total number of blocks
+     * @param allocatedBlocks the number of allocated blocks
+     * @param clean true if the container is being cleanly unmounted
+     */
+    inline void writeAllocationState(knoxcrypt::ContainerImageStream &out,
+                                     uint64_t const blocks,
+                                     uint64_t const allocatedBlocks,
+                                     bool const clean)
+    {
+        uint8_t dat[8];
+        convertUInt64ToInt8Array(clean ? (allocatedBlocks | CLEAN_UNMOUNT_BIT) : allocatedBlocks, dat);
+        (void)out.writeAt((char*)dat, 8, getAllocationStateOffset(blocks));
+        out.flush();
+    }
+
+    /**
+     * @brief gets the number of allocated blocks recorded by the last clean unmount
+     * @param in the image stream
+     * @param blocks the total number of blocks
+     * @return the number of allocated blocks or nothing if the container
+     * wasn't cleanly unmounted (images predating the allocation state
+     * always fall in to this category)
+     */
+    inline OptionalBlock getCleanlyUnmountedAllocatedBlocks(knoxcrypt::ContainerImageStream &in,
+                                                            uint64_t const blocks)
+    {
+        uint8_t dat[8];
+        (void)in.readAt((char*)dat, 8, getAllocationStateOffset(blocks));
+        uint64_t const state = convertInt8ArrayToInt64(dat);
+        if (!(state & CLEAN_UNMOUNT_BIT)) {
+            return OptionalBlock();
+        }
+        return OptionalBlock(state & ~CLEAN_UNMOUNT_BIT);
+    }
+
+    /**
+     * @brief sets io->freeBlocks from the count recorded by the last clean
+     * unmount and marks the container as mounted so that a crash forces a
+     * recount. If the container wasn't cleanly unmounted, the count is left
+     * to be derived from the bitmap when it is first needed
+     * (see CoreFS::statvfs and CoreFS::unmount)
+     * @param io the core knoxcrypt io; io->blocks must already be set
+     * @return true if the container had been cleanly unmounted
+     */
+    inline bool initFreeBlocksOnMount(SharedCoreIO const &io)
+    {
+        knoxcrypt::ContainerImageStream stream(io, std::ios::in | std::ios::out | std::ios::binary);
+        auto allocatedBlocks = getCleanlyUnmountedAllocatedBlocks(stream, io->blocks);
+        if (allocatedBlocks) {
+            io->freeBlocks = io->blocks - *allocatedBlocks;
+            io->freeBlocksCounted = true;
+            writeAllocationState(stream, io->blocks, *allocatedBlocks, false);
+            return true;
+        }
+
+        // provisional; allocations and deallocations will adjust this
+        // but only a count of the bitmap can make it accurate
+        io->freeBlocks = io->blocks;
+        io->freeBlocksCounted = false;
+        return false;
+    }
+
     /**
      * @brief updates the volume bit map with newly allocated file blocks
-     * @param in the knoxcrypt image stream
+     * @param volumeBitMap the in-memory volume bitmap
+     * @param io the core knoxcrypt io
      * @param blocksUsed a vector of newly allocated file block indices
-     * @param totalBlocks total number of fs blocks
+     * @param set whether to set (allocate) or clear (deallocate) the blocks
      */
-    inline void updateVolumeBitmap(ContainerImageStream &in,
+    inline void updateVolumeBitmap(VolumeBitMap &volumeBitMap,
+                                   SharedCoreIO const &io,
                                    std::vector<uint64_t> const &blocksUsed,
-                                   uint64_t const totalBlocks)
+                                   bool const set = true)
     {
-        for (auto const & it : blocksUsed) {
-            setBlockToInUse(it, totalBlocks, in);
-        }
+        volumeBitMap.setBlocksInUse(io, blocksUsed, set);
+    }
+
+    /**
+     * @brief deallocates a batch of file blocks. Sorting the blocks means
+     * that blocks sharing a bitmap byte are cleared together; every dirty
+     * region of the bitmap then gets a single write and the image a single
+     * flush (deferred until the next write-back when caching)
+     * @param volumeBitMap the in-memory volume bitmap
+     * @param io the core knoxcrypt io
+     * @param blocks the blocks to deallocate
+     */
+    inline void deallocateBlocks(VolumeBitMap &volumeBitMap,
+                                 SharedCoreIO const &io,
+                                 std::vector<uint64_t> blocks)
+    {
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+        volumeBitMap.setBlocksInUse(io, blocks, false);
+        io->freeBlocks += blocks.size();
     }
 
     /**
      * @brief updates the volume bit map with newly allocated file blocks
-     * @param in the knoxcrypt image stream
+     * @param volumeBitMap the in-memory volume bitmap
+     * @param io the core knoxcrypt io
      * @param blockUsed the used block
-     * @param totalBlocks total number of fs blocks
+     * @param set whether to set (allocate) or clear (deallocate) the block
      */
-    inline void updateVolumeBitmapWithOne(ContainerImageStream &in,
+    inline void updateVolumeBitmapWithOne(VolumeBitMap &volumeBitMap,
+                                          SharedCoreIO const &io,
                                           uint64_t const &blockUsed,
-                                          uint64_t const totalBlocks,
                                           bool const set = true)
     {
-        setBlockToInUse(blockUsed, totalBlocks, in, set);
+        volumeBitMap.setBlockInUse(io, blockUsed, set);
     }
 
     /**
-     * @brief  checks the g position of the stream and updates if necessary
-     * @param  stream the stream to update
-     * @param  offset the position to seek to
-     * @return true seeking was successful, false otherwise
+     * @brief builds the header byte recording the image's format features
+     * @param io the core io whose features are to be recorded
+     * @return the features byte
      */
-    inline bool checkAndSeekG(ContainerImageStream &stream, std::streamoff offset)
+    inline uint8_t buildFeaturesByte(SharedCoreIO const &io)
     {
-        if(stream.tellg() != offset) {
-            bool bad = stream.seekg(offset).bad();
-            return (!bad);
-        }
-        return true;
+        return FEATURES_PRESENT | (io->indexedFiles ? FEATURE_INDEXED_FILES : 0)
+                                | (io->blockSize != FILE_BLOCK_SIZE ? FEATURE_BLOCK_SIZE : 0);
     }
 
     /**
-     * @brief checks the p position of the stream and updates if necessary
-     * @param stream the stream to update
-     * @param offset the position to seek to
-     * @return true seeking was successful, false otherwise
+     * @brief determines if a block size can be used for an image; it must be
+     * a power of two from MIN_FILE_BLOCK_SIZE to MAX_FILE_BLOCK_SIZE
+     * @param blockSize the block size including the block metadata
+     * @return true if the block size is valid
      */
-    inline bool checkAndSeekP(ContainerImageStream &stream, std::streamoff offset)
+    inline bool isValidBlockSize(uint64_t const blockSize)
     {
-        if(stream.tellp() != offset) {
-            bool bad = stream.seekp(offset).bad();
-            return (!bad);
+        return blockSize >= MIN_FILE_BLOCK_SIZE && blockSize <= MAX_FILE_BLOCK_SIZE &&
+            (blockSize & (blockSize - 1)) == 0;
+    }
+
+    /**
+     * @brief builds the header byte recording the image's block size
+     * @param io the core io whose block size is to be recorded
+     * @return the log2 of the block size
+     */
+    inline uint8_t buildBlockSizeByte(SharedCoreIO const &io)
+    {
+        uint8_t shift = 0;
+        while ((uint64_t(1) << shift) < io->blockSize) {
+            ++shift;
         }
-        return true;
+        return shift;
     }
 
     /**
      * @brief reads the initialization vector and number of encryption rounds
-     * from a knoxcrypt image and sets the io's iv and rounds fields accordingly
+     * from a knoxcrypt image and sets the io's iv and rounds fields accordingly.
+     * The image's format features and block size are read too
      * @param io the core io to be populated with the iv and rounds
      */
     inline void readImageIVAndRounds(SharedCoreIO &io)
@@ -476,6 +559,17 @@ namespace knoxcrypt { namespace detail
         char j;
         (void)in.read((char*)&j, 1);
         unsigned int cipher = (unsigned int)j;
+        (void)in.seekg(BLOCK_SIZE_OFFSET);
+        uint8_t blockSizeShift;
+        (void)in.read((char*)&blockSizeShift, 1);
+        uint8_t features;
+        (void)in.read((char*)&features, 1);
+        io->indexedFiles = (features & FEATURES_PRESENT) && (features & FEATURE_INDEXED_FILES);
+        io->blockSize = FILE_BLOCK_SIZE;
+        if ((features & FEATURES_PRESENT) && (features & FEATURE_BLOCK_SIZE) && blockSizeShift < 64 &&
+            isValidBlockSize(uint64_t(1) << blockSizeShift)) {
+            io->blockSize = uint64_t(1) << blockSizeShift;
+        }
         // note, i should always > 0 <= 255
         io->rounds = (unsigned int)i;
 
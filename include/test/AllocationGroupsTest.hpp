@@ -0,0 +1,148 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/AllocationGroups.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace simpletest;
+
+class AllocationGroupsTest
+{
+  public:
+    AllocationGroupsTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testGoalsStayInTheirGroup();
+        testFullGroupsAreSkipped();
+        testConcurrentWritersGetDistinctBlocks();
+    }
+
+    ~AllocationGroupsTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    // two and a half groups
+    static uint64_t const BLOCKS = (5 * knoxcrypt::AllocationGroups::GROUP_BLOCKS) / 2;
+
+    knoxcrypt::SharedCoreIO createGroupedIO()
+    {
+        boost::filesystem::path testPath = m_uniquePath / boost::filesystem::unique_path();
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->blocks = BLOCKS;
+        io->freeBlocks = BLOCKS;
+        knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        io->useBlockCache = true;
+        return io;
+    }
+
+    void testGoalsStayInTheirGroup()
+    {
+        knoxcrypt::SharedCoreIO io(createGroupedIO());
+        knoxcrypt::VolumeBitMap bitMap;
+        knoxcrypt::AllocationGroups groups;
+        uint64_t const goal = knoxcrypt::AllocationGroups::GROUP_BLOCKS + 100;
+        ASSERT_EQUAL(goal, *groups.allocate(io, bitMap, knoxcrypt::AllocationGroups::OptionalBlock(goal), 1),
+                     "AllocationGroupsTest::testGoalsStayInTheirGroup goal");
+
+        // a file crossing into the next group carries on where it left off
+        uint64_t const boundary = 2 * knoxcrypt::AllocationGroups::GROUP_BLOCKS;
+        ASSERT_EQUAL(boundary, *groups.allocate(io, bitMap, knoxcrypt::AllocationGroups::OptionalBlock(boundary), 1),
+                     "AllocationGroupsTest::testGoalsStayInTheirGroup boundary");
+    }
+
+    void testFullGroupsAreSkipped()
+    {
+        knoxcrypt::SharedCoreIO io(createGroupedIO());
+        knoxcrypt::VolumeBitMap bitMap;
+        std::vector<uint64_t> used;
+        for (uint64_t b = 1; b < 2 * knoxcrypt::AllocationGroups::GROUP_BLOCKS; ++b) {
+            used.push_back(b);
+        }
+        bitMap.setBlocksInUse(io, used);
+
+        knoxcrypt::AllocationGroups groups;
+        ASSERT_EQUAL(2 * knoxcrypt::AllocationGroups::GROUP_BLOCKS,
+                     *groups.allocate(io, bitMap, knoxcrypt::AllocationGroups::OptionalBlock(5), 1),
+                     "AllocationGroupsTest::testFullGroupsAreSkipped");
+    }
+
+    void testConcurrentWritersGetDistinctBlocks()
+    {
+        knoxcrypt::SharedCoreIO io(createGroupedIO());
+        knoxcrypt::VolumeBitMap bitMap;
+        knoxcrypt::AllocationGroups groups;
+
+        // each thread writes a file of 2000 blocks, one block at a time
+        int const threads = 4;
+        uint64_t const blocksPerThread = 2000;
+        std::vector<std::vector<uint64_t>> allocated(threads);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.emplace_back([&, t]{
+                knoxcrypt::AllocationGroups::OptionalBlock goal;
+                for (uint64_t i = 0; i < blocksPerThread; ++i) {
+                    uint64_t const block = *groups.allocate(io, bitMap, goal, blocksPerThread - i);
+                    bitMap.setBlockInUse(io, block);
+                    allocated[t].push_back(block);
+                    goal = knoxcrypt::AllocationGroups::OptionalBlock(block + 1);
+                }
+            });
+        }
+        for (auto & writer : writers) {
+            writer.join();
+        }
+
+        std::vector<uint64_t> all;
+        for (auto const & blocks : allocated) {
+            all.insert(all.end(), blocks.begin(), blocks.end());
+        }
+        std::sort(all.begin(), all.end());
+        ASSERT_EQUAL(true, std::adjacent_find(all.begin(), all.end()) == all.end(),
+                     "AllocationGroupsTest::testConcurrentWritersGetDistinctBlocks distinct");
+        ASSERT_EQUAL(threads * blocksPerThread + 1, bitMap.getNumberOfAllocatedBlocks(io),
+                     "AllocationGroupsTest::testConcurrentWritersGetDistinctBlocks allocated");
+    }
+};
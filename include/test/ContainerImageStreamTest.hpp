@@ -0,0 +1,440 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/detail/DetailFileBlock.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simpletest;
+
+class ContainerImageStreamTest
+{
+  public:
+    ContainerImageStreamTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testReadWriteStreamsShareWrites();
+        testOtherStreamsSeeBufferedWrites();
+        testSyncWritesOutSharedStream();
+        testWriteThroughFlushesUpdates();
+        testPositionalReadsAndWrites();
+        testPositionalWritesFromThreads();
+        testSeeksFromThreads();
+        testMappedImageReadsAndWrites();
+        testMappedImageSeesAppendedData();
+        testMappedImageFailedLoad();
+        testMappedImageEvicts();
+        testDropImageCache();
+    }
+
+    ~ContainerImageStreamTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    static std::ios::openmode readWrite()
+    {
+        return std::ios::in | std::ios::out | std::ios::binary;
+    }
+
+    uint64_t dataOffset(knoxcrypt::SharedCoreIO const &io)
+    {
+        return knoxcrypt::detail::getOffsetOfFileBlock(2, io->blocks, io->blockSize) + knoxcrypt::detail::FILE_BLOCK_META;
+    }
+
+    // mapped only as far as the image goes so written out in full
+    boost::filesystem::path buildFullImage()
+    {
+        boost::filesystem::path testPath = m_uniquePath / boost::filesystem::unique_path();
+        knoxcrypt::MakeKnoxCrypt(createTestIO(testPath)).buildImage();
+        return testPath;
+    }
+
+    std::string readAt(knoxcrypt::ContainerImageStream &stream, uint64_t const offset, size_t const bytes)
+    {
+        std::vector<char> buffer(bytes);
+        (void)stream.seekg(offset);
+        (void)stream.read(&buffer.front(), bytes);
+        return std::string(buffer.begin(), buffer.end());
+    }
+
+    void testReadWriteStreamsShareWrites()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        std::string const data("shared!!");
+
+        // neither stream is flushed; the second reads from the same buffer
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        knoxcrypt::ContainerImageStream reader(io, readWrite());
+        (void)writer.seekp(dataOffset(io));
+        (void)writer.write(data.c_str(), data.length());
+        ASSERT_EQUAL(data, readAt(reader, dataOffset(io), data.length()),
+                     "ContainerImageStreamTest::testReadWriteStreamsShareWrites() read back");
+
+        // closing a shared stream leaves it open for its other users
+        writer.close();
+        ASSERT_EQUAL(true, reader.is_open(), "ContainerImageStreamTest::testReadWriteStreamsShareWrites() still open");
+        ASSERT_EQUAL(data, readAt(reader, dataOffset(io), data.length()),
+                     "ContainerImageStreamTest::testReadWriteStreamsShareWrites() read after close");
+    }
+
+    void testOtherStreamsSeeBufferedWrites()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        std::string const data("buffered");
+
+        // a read only stream has a buffer of its own so the shared stream
+        // is flushed when it is opened
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        (void)writer.seekp(dataOffset(io));
+        (void)writer.write(data.c_str(), data.length());
+        knoxcrypt::ContainerImageStream reader(io, std::ios::in | std::ios::binary);
+        ASSERT_EQUAL(data, readAt(reader, dataOffset(io), data.length()),
+                     "ContainerImageStreamTest::testOtherStreamsSeeBufferedWrites()");
+    }
+
+    void testSyncWritesOutSharedStream()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        std::string const data("synced!!");
+
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        (void)writer.seekp(dataOffset(io));
+        (void)writer.write(data.c_str(), data.length());
+        knoxcrypt::ContainerImageStream::sync(io);
+
+        // seen through another io whilst the writer is still open
+        knoxcrypt::SharedCoreIO other(createTestIO(testPath));
+        knoxcrypt::ContainerImageStream reader(other, readWrite());
+        ASSERT_EQUAL(data, readAt(reader, dataOffset(other), data.length()),
+                     "ContainerImageStreamTest::testSyncWritesOutSharedStream()");
+    }
+
+    void testWriteThroughFlushesUpdates()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->writeThrough = true;
+        std::string const data("through!");
+
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        (void)writer.seekp(dataOffset(io));
+        (void)writer.write(data.c_str(), data.length());
+        writer.flushUnlessBuffered();
+
+        knoxcrypt::SharedCoreIO other(createTestIO(testPath));
+        knoxcrypt::ContainerImageStream reader(other, readWrite());
+        ASSERT_EQUAL(data, readAt(reader, dataOffset(other), data.length()),
+                     "ContainerImageStreamTest::testWriteThroughFlushesUpdates()");
+    }
+
+    void testPositionalReadsAndWrites()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        uint64_t const offset = dataOffset(io);
+
+        // the shared stream is moved by the other stream in between so
+        // each write has to find its own offset
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        knoxcrypt::ContainerImageStream other(io, readWrite());
+        (void)writer.writeAt("first...", 8, offset);
+        (void)other.seekg(offset + 100);
+        (void)writer.writeAt("second..", 8, offset + 8);
+        (void)other.writeAt("third...", 8, offset + 200);
+        ASSERT_EQUAL(std::streamoff(offset + 208), std::streamoff(writer.tellp()),
+                     "ContainerImageStreamTest::testPositionalReadsAndWrites() position");
+
+        std::vector<char> buffer(16);
+        (void)other.readAt(&buffer.front(), 16, offset);
+        ASSERT_EQUAL(std::string("first...second.."), std::string(buffer.begin(), buffer.end()),
+                     "ContainerImageStreamTest::testPositionalReadsAndWrites() read back");
+        (void)writer.readAt(&buffer.front(), 8, offset + 200);
+        ASSERT_EQUAL(std::string("third..."), std::string(buffer.begin(), buffer.begin() + 8),
+                     "ContainerImageStreamTest::testPositionalReadsAndWrites() other read back");
+
+        // the known position agrees with where the stream itself is
+        ASSERT_EQUAL(std::string("first..."), readAt(writer, offset, 8),
+                     "ContainerImageStreamTest::testPositionalReadsAndWrites() seek and read");
+    }
+
+    void testPositionalWritesFromThreads()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        uint64_t const offset = dataOffset(io);
+        int const threads = 4;
+        int const writes = 200;
+
+        // each thread has a stream of its own on the one shared stream and
+        // writes its own letter to every other slot of its own range
+        std::vector<knoxcrypt::SharedImageStream> streams;
+        for (int t = 0; t < threads; ++t) {
+            streams.push_back(std::make_shared<knoxcrypt::ContainerImageStream>(io, readWrite()));
+        }
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; ++t) {
+            writers.emplace_back([&streams, offset, t, writes] {
+                char const letter = char('a' + t);
+                for (int w = 0; w < writes; ++w) {
+                    (void)streams[t]->writeAt(&letter, 1, offset + (t * writes * 2) + (w * 2));
+                }
+            });
+        }
+        for (auto &writer : writers) {
+            writer.join();
+        }
+
+        knoxcrypt::ContainerImageStream reader(io, readWrite());
+        bool matched = true;
+        for (int t = 0; t < threads; ++t) {
+            for (int w = 0; w < writes; ++w) {
+                char c;
+                (void)reader.readAt(&c, 1, offset + (t * writes * 2) + (w * 2));
+                matched = matched && (c == char('a' + t));
+            }
+        }
+        ASSERT_EQUAL(true, matched, "ContainerImageStreamTest::testPositionalWritesFromThreads()");
+    }
+
+    void testSeeksFromThreads()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        uint64_t const offset = dataOffset(io);
+        int const reads = 500;
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        (void)writer.writeAt("abcdefgh", 8, offset);
+
+        // one thread keeps moving the shared stream while others read
+        // from it at their own offsets
+        knoxcrypt::ContainerImageStream seeker(io, readWrite());
+        std::thread seeking([&seeker, offset, reads] {
+            for (int r = 0; r < reads; ++r) {
+                (void)seeker.seekg(offset + 100 + r);
+                (void)seeker.tellg();
+                (void)seeker.size();
+            }
+        });
+        std::atomic<bool> matched(true);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 2; ++t) {
+            readers.emplace_back([&io, &matched, offset, reads, t] {
+                knoxcrypt::ContainerImageStream reader(io, std::ios::in | std::ios::out | std::ios::binary);
+                for (int r = 0; r < reads; ++r) {
+                    char c;
+                    (void)reader.readAt(&c, 1, offset + t + (r % 4) * 2);
+                    if (c != "abcdefgh"[t + (r % 4) * 2]) {
+                        matched = false;
+                    }
+                }
+            });
+        }
+        seeking.join();
+        for (auto &reader : readers) {
+            reader.join();
+        }
+        ASSERT_EQUAL(true, matched.load(), "ContainerImageStreamTest::testSeeksFromThreads()");
+    }
+
+    void testMappedImageReadsAndWrites()
+    {
+        boost::filesystem::path testPath = buildFullImage();
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->mapImage = true;
+
+        // straddle a page so that two partly written pages are loaded
+        uint64_t const offset = (dataOffset(io) / 4096 + 2) * 4096 - 4;
+        knoxcrypt::ContainerImageStream writer(io, readWrite());
+        knoxcrypt::ContainerImageStream reader(io, readWrite());
+        std::string const before(readAt(reader, offset - 8, 24));
+        (void)writer.writeAt("mapped!!", 8, offset);
+        ASSERT_EQUAL(before.substr(0, 8) + "mapped!!" + before.substr(16), readAt(reader, offset - 8, 24),
+                     "ContainerImageStreamTest::testMappedImageReadsAndWrites() read back");
+        ASSERT_EQUAL(std::streamoff(offset + 16), std::streamoff(reader.tellg()),
+                     "ContainerImageStreamTest::testMappedImageReadsAndWrites() position");
+
+        // written back to the image when a stream of its own is opened
+        knoxcrypt::ContainerImageStream other(io, std::ios::in | std::ios::binary);
+        ASSERT_EQUAL(std::string("mapped!!"), readAt(other, offset, 8),
+                     "ContainerImageStreamTest::testMappedImageReadsAndWrites() written back");
+
+        // and by sync, for another io
+        (void)writer.writeAt("synced!!", 8, offset);
+        knoxcrypt::ContainerImageStream::sync(io);
+        knoxcrypt::SharedCoreIO otherIO(createTestIO(testPath));
+        knoxcrypt::ContainerImageStream otherReader(otherIO, readWrite());
+        ASSERT_EQUAL(std::string("synced!!"), readAt(otherReader, offset, 8),
+                     "ContainerImageStreamTest::testMappedImageReadsAndWrites() synced");
+    }
+
+    void testMappedImageSeesAppendedData()
+    {
+        boost::filesystem::path testPath = buildFullImage();
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->mapImage = true;
+        uint64_t const imageBytes = boost::filesystem::file_size(testPath);
+
+        // what is appended lies beyond the map and is read from the stream
+        knoxcrypt::ContainerImageStream shared(io, readWrite());
+        (void)shared.writeAt("inmap...", 8, dataOffset(io));
+        {
+            knoxcrypt::ContainerImageStream appender(io, std::ios::in | std::ios::out | std::ios::app | std::ios::binary);
+            (void)appender.seekp(0, std::ios::end);
+            (void)appender.write("appended", 8);
+        }
+        ASSERT_EQUAL(std::string("appended"), readAt(shared, imageBytes, 8),
+                     "ContainerImageStreamTest::testMappedImageSeesAppendedData() past map");
+        ASSERT_EQUAL(std::string("inmap..."), readAt(shared, dataOffset(io), 8),
+                     "ContainerImageStreamTest::testMappedImageSeesAppendedData() in map");
+        (void)shared.seekg(0, std::ios::end);
+        ASSERT_EQUAL(std::streamoff(imageBytes + 8), std::streamoff(shared.tellg()),
+                     "ContainerImageStreamTest::testMappedImageSeesAppendedData() end");
+    }
+
+    void testMappedImageFailedLoad()
+    {
+        boost::filesystem::path testPath = buildFullImage();
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->mapImage = true;
+
+        // pages that can no longer be decrypted in to the map show as bad
+        knoxcrypt::ContainerImageStream shared(io, readWrite());
+        boost::filesystem::resize_file(testPath, 0);
+        std::vector<char> buffer(8);
+        (void)shared.readAt(&buffer.front(), 8, dataOffset(io));
+        ASSERT_EQUAL(true, shared.bad(), "ContainerImageStreamTest::testMappedImageFailedLoad() read");
+        shared.clear();
+        (void)shared.writeAt("partial", 7, dataOffset(io) + 1);
+        ASSERT_EQUAL(true, shared.bad(), "ContainerImageStreamTest::testMappedImageFailedLoad() write");
+    }
+
+    void testMappedImageEvicts()
+    {
+        boost::filesystem::path testPath = buildFullImage();
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->mapImage = true;
+        io->mapImageBytes = 2 * 4096;
+
+        // more pages are written than there are slots so that some are
+        // written back and decrypted again before being read
+        uint64_t const first = (dataOffset(io) / 4096 + 1) * 4096;
+        knoxcrypt::ContainerImageStream shared(io, readWrite());
+        std::vector<std::string> befores;
+        for (int page = 0; page < 5; ++page) {
+            befores.push_back(readAt(shared, first + page * 8192 - 4, 16));
+            (void)shared.writeAt("evicted!", 8, first + page * 8192);
+        }
+        bool matched = true;
+        for (int page = 0; page < 5; ++page) {
+            matched = matched && readAt(shared, first + page * 8192 - 4, 16) ==
+                befores[page].substr(0, 4) + "evicted!" + befores[page].substr(12);
+        }
+        ASSERT_EQUAL(true, matched, "ContainerImageStreamTest::testMappedImageEvicts() read back");
+        ASSERT_EQUAL(false, shared.bad(), "ContainerImageStreamTest::testMappedImageEvicts() good");
+
+        knoxcrypt::ContainerImageStream other(io, std::ios::in | std::ios::binary);
+        ASSERT_EQUAL(std::string("evicted!"), readAt(other, first + 4 * 8192, 8),
+                     "ContainerImageStreamTest::testMappedImageEvicts() written back");
+    }
+
+    // the pages of the first bytes of a file that are in the page cache
+    size_t residentPages(boost::filesystem::path const &path, size_t const bytes)
+    {
+        size_t const page = ::sysconf(_SC_PAGESIZE);
+        std::vector<unsigned char> residency((bytes + page - 1) / page);
+        int const fd = ::open(path.string().c_str(), O_RDONLY);
+        void *map = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        (void)::mincore(map, bytes, &residency.front());
+        (void)::munmap(map, bytes);
+        (void)::close(fd);
+        size_t resident = 0;
+        for (auto const r : residency) {
+            resident += r & 1;
+        }
+        return resident;
+    }
+
+    void testDropImageCache()
+    {
+        boost::filesystem::path testPath = buildFullImage();
+        size_t const bytes = 2 * 1024 * 1024;
+        std::vector<char> buffer(64 * 1024);
+        for (bool const drop : {false, true}) {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->dropImageCache = true;
+            knoxcrypt::ContainerImageStream::sync(io);
+            io->dropImageCache = drop;
+            {
+                knoxcrypt::ContainerImageStream reader(io, std::ios::in | std::ios::binary);
+                for (size_t offset = 0; offset < bytes; offset += buffer.size()) {
+                    (void)reader.readAt(&buffer.front(), buffer.size(), offset);
+                }
+            }
+            size_t const resident = residentPages(testPath, bytes);
+            if (drop) {
+                ASSERT_EQUAL(size_t(0), resident, "ContainerImageStreamTest::testDropImageCache() dropped");
+            } else {
+                ASSERT_EQUAL(true, resident > 0, "ContainerImageStreamTest::testDropImageCache() cached");
+            }
+        }
+    }
+};
@@ -71,6 +71,10 @@ class ContentFolderTest
         testRemoveFile();
         testRemoveEmptySubFolder();
         testRemoveNonEmptySubFolder();
+        testFileSizeIsRecordedInEntryMetaData();
+        testRecordedFileSizeSurvivesRename();
+        testFileSizeOfLongNameIsNotRecorded();
+        testFileSizeIsRecordedWithoutFlush();
     }
 
     ~ContentFolderTest()
@@ -327,11 +331,11 @@ class ContentFolderTest
     {
         boost::filesystem::path testPath = buildImage(m_uniquePath);
         knoxcrypt::ContentFolder folder = createTestFolder(testPath);
-        knoxcrypt::ContentFolder subFolder = *folder.getContentFolder("folderA");
-        subFolder.addFile("subFileA");
-        subFolder.addFile("subFileB");
-        subFolder.addFile("subFileC");
-        subFolder.addFile("subFileD");
+        auto subFolder(folder.getContentFolder("folderA"));
+        subFolder->addFile("subFileA");
+        subFolder->addFile("subFileB");
+        subFolder->addFile("subFileC");
+        subFolder->addFile("subFileD");
 
         // test root entries still intact
         {
@@ -346,7 +350,7 @@ class ContentFolderTest
         }
         // test sub folder entries exist
         {
-            auto entries = subFolder.listAllEntries();
+            auto entries = subFolder->listAllEntries();
             ASSERT_EQUAL(entries.size(), 4, "testContentFolderRetrievalAddEntries: subfolder number of entries");
             ASSERT_UNEQUAL(entries.find("subFileA"), (entries.end()), "testContentFolderRetrievalAddEntries: subFolder filename A");
             ASSERT_UNEQUAL(entries.find("subFileB"), (entries.end()), "testContentFolderRetrievalAddEntries: subFolder filename B");
@@ -359,14 +363,14 @@ class ContentFolderTest
     {
         boost::filesystem::path testPath = buildImage(m_uniquePath);
         knoxcrypt::ContentFolder folder = createTestFolder(testPath);
-        knoxcrypt::ContentFolder subFolder = *folder.getContentFolder("folderA");
-        subFolder.addFile("subFileA");
-        subFolder.addFile("subFileB");
-        subFolder.addFile("subFileC");
-        subFolder.addFile("subFileD");
+        auto subFolder(folder.getContentFolder("folderA"));
+        subFolder->addFile("subFileA");
+        subFolder->addFile("subFileB");
+        subFolder->addFile("subFileC");
+        subFolder->addFile("subFileD");
 
         std::string testData("some test data!");
-        knoxcrypt::File entry = *subFolder.getFile("subFileB", knoxcrypt::OpenDisposition::buildAppendDisposition());
+        knoxcrypt::File entry = *subFolder->getFile("subFileB", knoxcrypt::OpenDisposition::buildAppendDisposition());
         std::vector<uint8_t> vec(testData.begin(), testData.end());
         entry.write((char*)&vec.front(), testData.length());
         entry.flush();
@@ -400,14 +404,14 @@ class ContentFolderTest
         {
             boost::filesystem::path testPath = buildImage(m_uniquePath);
             knoxcrypt::ContentFolder folder = createTestFolder(testPath);
-            knoxcrypt::ContentFolder subFolder = *folder.getContentFolder("folderA");
-            subFolder.addFile("subFileA");
-            subFolder.addFile("subFileB");
-            subFolder.addFile("subFileC");
-            subFolder.addFile("subFileD");
+            auto subFolder(folder.getContentFolder("folderA"));
+            subFolder->addFile("subFileA");
+            subFolder->addFile("subFileB");
+            subFolder->addFile("subFileC");
+            subFolder->addFile("subFileD");
 
             std::string testData("some test data!");
-            knoxcrypt::File entry = *subFolder.getFile("subFileB", knoxcrypt::OpenDisposition::buildAppendDisposition());
+            knoxcrypt::File entry = *subFolder->getFile("subFileB", knoxcrypt::OpenDisposition::buildAppendDisposition());
             std::vector<uint8_t> vec(testData.begin(), testData.end());
             entry.write((char*)&vec.front(), testData.length());
             entry.flush();
@@ -421,4 +425,97 @@ class ContentFolderTest
         }
     }
 
+    /// checks the size-recorded bit of the metadata of the entry with given index
+    bool entrySizeBitIsSet(knoxcrypt::SharedCoreIO const &io, uint64_t const n)
+    {
+        knoxcrypt::File folderData(io, "root", 0, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        folderData.seek(8 + n * (1 + knoxcrypt::detail::MAX_FILENAME_LENGTH + 8));
+        uint8_t byte;
+        folderData.read((char*)&byte, 1);
+        return knoxcrypt::detail::isBitSetInByte(byte, 2);
+    }
+
+    void writeToEntry(knoxcrypt::ContentFolder &folder, std::string const &name, std::size_t const bytes)
+    {
+        knoxcrypt::File entry = *folder.getFile(name, knoxcrypt::OpenDisposition::buildAppendDisposition());
+        std::vector<uint8_t> vec(bytes, 'a');
+        entry.write((char*)&vec.front(), bytes);
+        entry.flush();
+    }
+
+    void testFileSizeIsRecordedInEntryMetaData()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        uint64_t blockCount;
+        {
+            knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+            folder.addFile("test.txt");
+            folder.addFile("some.log");
+            writeToEntry(folder, "some.log", 5000);
+            blockCount = folder.getFile("some.log", knoxcrypt::OpenDisposition::buildReadOnlyDisposition())->blockCount();
+        }
+        ASSERT_EQUAL(entrySizeBitIsSet(io, 1), true,
+                     "testFileSizeIsRecordedInEntryMetaData: size bit set");
+        knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+        auto info(folder.getEntryInfo("some.log"));
+        ASSERT_EQUAL(info->size(), 5000u, "testFileSizeIsRecordedInEntryMetaData: size");
+        ASSERT_EQUAL(info->blockCount(), blockCount, "testFileSizeIsRecordedInEntryMetaData: block count");
+        ASSERT_EQUAL(folder.getEntryInfo("test.txt")->size(), 0u, "testFileSizeIsRecordedInEntryMetaData: empty");
+    }
+
+    void testRecordedFileSizeSurvivesRename()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        {
+            knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+            folder.addFile("some.log");
+            writeToEntry(folder, "some.log", 3000);
+            folder.updateMetaDataWithNewFilename("some.log", "renamed.log");
+        }
+        ASSERT_EQUAL(entrySizeBitIsSet(io, 0), true,
+                     "testRecordedFileSizeSurvivesRename: size bit set");
+        knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+        ASSERT_EQUAL(folder.getEntryInfo("renamed.log")->size(), 3000u, "testRecordedFileSizeSurvivesRename");
+    }
+
+    void testFileSizeOfLongNameIsNotRecorded()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        std::string const longName(250, 'x');
+        {
+            knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+            folder.addFile(longName);
+            writeToEntry(folder, longName, 3000);
+        }
+        ASSERT_EQUAL(entrySizeBitIsSet(io, 0), false,
+                     "testFileSizeOfLongNameIsNotRecorded: size bit unset");
+        knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+        ASSERT_EQUAL(folder.getEntryInfo(longName)->size(), 3000u, "testFileSizeOfLongNameIsNotRecorded: size");
+        ASSERT_EQUAL(folder.getEntryInfo(longName)->filename(), longName, "testFileSizeOfLongNameIsNotRecorded: name");
+    }
+
+    void testFileSizeIsRecordedWithoutFlush()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        {
+            knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+            folder.addFile("some.log");
+            {
+                auto entry(folder.getFile("some.log", knoxcrypt::OpenDisposition::buildAppendDisposition()));
+                std::vector<uint8_t> vec(5000, 'a');
+                (void)entry->write((char*)&vec.front(), vec.size());
+            }
+            ASSERT_EQUAL(folder.getEntryInfo("some.log")->size(), 5000u,
+                         "testFileSizeIsRecordedWithoutFlush: cached size");
+        }
+        ASSERT_EQUAL(entrySizeBitIsSet(io, 0), true,
+                     "testFileSizeIsRecordedWithoutFlush: size bit set");
+        knoxcrypt::ContentFolder folder(io, 0, std::string("root"));
+        ASSERT_EQUAL(folder.getEntryInfo("some.log")->size(), 5000u, "testFileSizeIsRecordedWithoutFlush: size");
+    }
+
 };
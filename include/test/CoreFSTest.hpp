@@ -29,6 +29,7 @@
 #include "knoxcrypt/CompoundFolder.hpp"
 #include "knoxcrypt/CoreIO.hpp"
 #include "knoxcrypt/CoreFS.hpp"
+#include "knoxcrypt/detail/DetailKnoxCrypt.hpp"
 #include "test/SimpleTest.hpp"
 #include "test/TestHelpers.hpp"
 
@@ -68,6 +69,9 @@ class CoreFSTest
         testMoveFileToSubFolder();
         testMoveFileFromSubFolderToParentFolder();
         testThatDeletingEverythingDeallocatesEverything();
+        testCleanUnmountRecordsAllocatedBlocks();
+        testUncleanMountCountsAllocatedBlocks();
+        testFlushFileRecordsSize();
         //testDebugging();
     }
 
@@ -556,6 +560,85 @@ class CoreFSTest
     }
 
     // in the context of debugging on branch debuggingSeek
+    void testCleanUnmountRecordsAllocatedBlocks()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+
+        // a freshly built image only has its root block allocated
+        ASSERT_EQUAL(true, knoxcrypt::detail::initFreeBlocksOnMount(io),
+                     "CoreFSTest::testCleanUnmountRecordsAllocatedBlocks() fresh image clean");
+        ASSERT_EQUAL(io->blocks - 1, io->freeBlocks,
+                     "CoreFSTest::testCleanUnmountRecordsAllocatedBlocks() fresh image free blocks");
+        {
+            // whilst mounted, a crash must force a recount
+            knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::binary);
+            ASSERT_EQUAL(false, !!knoxcrypt::detail::getCleanlyUnmountedAllocatedBlocks(in, io->blocks),
+                         "CoreFSTest::testCleanUnmountRecordsAllocatedBlocks() mounted is unclean");
+        }
+
+        {
+            knoxcrypt::CoreFS kc(io);
+            kc.addFile("/test.txt");
+            std::string const &testString(createLargeStringToWrite());
+            knoxcrypt::FileDevice device = kc.openFile("/test.txt", knoxcrypt::OpenDisposition::buildAppendDisposition());
+            (void)device.write(testString.c_str(), testString.length());
+            kc.unmount();
+        }
+
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::binary);
+        auto recorded = knoxcrypt::detail::getCleanlyUnmountedAllocatedBlocks(in, io->blocks);
+        ASSERT_EQUAL(true, !!recorded, "CoreFSTest::testCleanUnmountRecordsAllocatedBlocks() unmount is clean");
+        ASSERT_EQUAL(knoxcrypt::detail::getNumberOfAllocatedBlocks(in), *recorded,
+                     "CoreFSTest::testCleanUnmountRecordsAllocatedBlocks() recorded count");
+    }
+
+    void testUncleanMountCountsAllocatedBlocks()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        (void)createTestFolder(testPath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+
+        // emulate a crash whilst mounted
+        ASSERT_EQUAL(true, knoxcrypt::detail::initFreeBlocksOnMount(io),
+                     "CoreFSTest::testUncleanMountCountsAllocatedBlocks() clean first time");
+        ASSERT_EQUAL(false, knoxcrypt::detail::initFreeBlocksOnMount(io),
+                     "CoreFSTest::testUncleanMountCountsAllocatedBlocks() unclean second time");
+
+        knoxcrypt::CoreFS kc(io);
+        struct statvfs buf;
+        kc.statvfs(&buf);
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::binary);
+        ASSERT_EQUAL(io->blocks - knoxcrypt::detail::getNumberOfAllocatedBlocks(in), buf.f_bfree,
+                     "CoreFSTest::testUncleanMountCountsAllocatedBlocks() counted");
+    }
+
+    void testFlushFileRecordsSize()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        knoxcrypt::CoreFS kc(io);
+        kc.addFile("/test.txt");
+        std::string const &testString(createLargeStringToWrite());
+        {
+            knoxcrypt::FileDevice device = kc.openFile("/test.txt", knoxcrypt::OpenDisposition::buildAppendDisposition());
+            (void)device.write(testString.c_str(), testString.length());
+        }
+
+        // the open file's size is reported before it is flushed
+        ASSERT_EQUAL(testString.length(), kc.getInfo("/test.txt").size(),
+                     "CoreFSTest::testFlushFileRecordsSize() open");
+
+        // and is in its entry for everyone else once it is
+        kc.flushFile("/test.txt");
+        knoxcrypt::CoreFS other(io);
+        ASSERT_EQUAL(testString.length(), other.getInfo("/test.txt").size(),
+                     "CoreFSTest::testFlushFileRecordsSize() recorded");
+    }
+
     void testDebugging()
     {
         boost::filesystem::path testPath = buildImage(m_uniquePath);
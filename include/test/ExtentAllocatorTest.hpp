@@ -0,0 +1,186 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/ExtentAllocator.hpp"
+#include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/FileBlockIterator.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "knoxcrypt/detail/DetailFileBlock.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace simpletest;
+
+class ExtentAllocatorTest
+{
+  public:
+    ExtentAllocatorTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testBestFitAndGoals();
+        testInterleavedWritersAreLaidOutInRuns();
+        testSkippedBlocksOfSparseImageAreWritten();
+    }
+
+    ~ExtentAllocatorTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    knoxcrypt::SharedCoreIO createCachingIO(boost::filesystem::path const &testPath)
+    {
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    void testBestFitAndGoals()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createCachingIO(testPath));
+
+        // blocks 0 to 99 are in use other than a hole of 20 at 10 and a hole of 17 at 40
+        knoxcrypt::VolumeBitMap bitMap;
+        std::vector<uint64_t> used;
+        for (uint64_t b = 1; b < 100; ++b) {
+            if ((b < 10 || b >= 30) && (b < 40 || b >= 57)) {
+                used.push_back(b);
+            }
+        }
+        bitMap.setBlocksInUse(io, used);
+
+        knoxcrypt::ExtentAllocator allocator;
+        knoxcrypt::ExtentAllocator::OptionalBlock none;
+        ASSERT_EQUAL(40u, *allocator.allocate(io, bitMap, none, 1), "ExtentAllocatorTest::testBestFitAndGoals smallest fit");
+        ASSERT_EQUAL(41u, *allocator.allocate(io, bitMap, knoxcrypt::ExtentAllocator::OptionalBlock(41), 1),
+                     "ExtentAllocatorTest::testBestFitAndGoals goal from reservation");
+
+        // the rest of the small hole is reserved so another writer goes elsewhere
+        ASSERT_EQUAL(10u, *allocator.allocate(io, bitMap, none, 1), "ExtentAllocatorTest::testBestFitAndGoals reserved skipped");
+        ASSERT_EQUAL(100u, *allocator.allocate(io, bitMap, none, 500), "ExtentAllocatorTest::testBestFitAndGoals big write");
+        ASSERT_EQUAL(101u, *allocator.allocate(io, bitMap, knoxcrypt::ExtentAllocator::OptionalBlock(101), 500),
+                     "ExtentAllocatorTest::testBestFitAndGoals big write continued");
+    }
+
+    std::vector<uint64_t> getBlocks(knoxcrypt::SharedCoreIO const &io, knoxcrypt::File &file)
+    {
+        std::vector<uint64_t> blocks;
+        knoxcrypt::FileBlockIterator it(io, file.getStartVolumeBlockIndex(),
+                                        knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        knoxcrypt::FileBlockIterator end;
+        for (; it != end; ++it) {
+            blocks.push_back(it->getIndex());
+        }
+        return blocks;
+    }
+
+    size_t countFragments(std::vector<uint64_t> const &blocks)
+    {
+        size_t fragments(blocks.empty() ? 0 : 1);
+        for (size_t i = 1; i < blocks.size(); ++i) {
+            if (blocks[i] != blocks[i - 1] + 1) {
+                ++fragments;
+            }
+        }
+        return fragments;
+    }
+
+    void testInterleavedWritersAreLaidOutInRuns()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createCachingIO(testPath));
+
+        // blocks are to be allocated as each write needs them
+        io->useDelayedAllocation = false;
+
+        std::string const chunkA(createLargeStringToWrite("a").substr(0, 5000));
+        std::string const chunkB(createLargeStringToWrite("b").substr(0, 5000));
+        knoxcrypt::File fileA(io, "a.txt");
+        knoxcrypt::File fileB(io, "b.txt");
+        for (int i = 0; i < 20; ++i) {
+            (void)fileA.write(chunkA.c_str(), chunkA.length());
+            (void)fileB.write(chunkB.c_str(), chunkB.length());
+        }
+        fileA.flush();
+        fileB.flush();
+
+        std::vector<uint64_t> blocksA(getBlocks(io, fileA));
+        std::vector<uint64_t> blocksB(getBlocks(io, fileB));
+        ASSERT_EQUAL(25u, blocksA.size(), "ExtentAllocatorTest::testInterleavedWritersAreLaidOutInRuns block count");
+
+        // each writer's reservations are at least as big as the file so far so
+        // the number of fragments grows logarithmically with file size
+        ASSERT_EQUAL(2u, countFragments(blocksA), "ExtentAllocatorTest::testInterleavedWritersAreLaidOutInRuns A");
+        ASSERT_EQUAL(2u, countFragments(blocksB), "ExtentAllocatorTest::testInterleavedWritersAreLaidOutInRuns B");
+
+        knoxcrypt::File readBack(io, "b.txt", fileB.getStartVolumeBlockIndex(),
+                                 knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        std::vector<char> buffer(chunkB.length() * 20);
+        (void)readBack.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(std::string(20 * chunkB.length(), 'b'), std::string(buffer.begin(), buffer.end()),
+                     "ExtentAllocatorTest::testInterleavedWritersAreLaidOutInRuns content");
+    }
+
+    void testSkippedBlocksOfSparseImageAreWritten()
+    {
+        // note test images are sparse
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createCachingIO(testPath));
+
+        // force the first allocation to skip over blocks never written to the image
+        std::vector<uint64_t> used;
+        for (uint64_t b = 1; b < 50; ++b) {
+            used.push_back(b);
+        }
+        io->blockBuilder->getVolumeBitMap()->setBlocksInUse(io, used);
+
+        knoxcrypt::File file(io, "test.txt");
+        (void)file.write("hello", 5);
+        file.flush();
+        ASSERT_EQUAL(50u, file.getStartVolumeBlockIndex(), "ExtentAllocatorTest::testSkippedBlocksOfSparseImageAreWritten block");
+        ASSERT_EQUAL(knoxcrypt::detail::getOffsetOfFileBlock(51, io->blocks, io->blockSize), boost::filesystem::file_size(testPath),
+                     "ExtentAllocatorTest::testSkippedBlocksOfSparseImageAreWritten image size");
+    }
+
+};
@@ -0,0 +1,91 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/FileBlock.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/OpenDisposition.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <vector>
+
+using namespace simpletest;
+
+class FileBlockBuilderTest
+{
+  public:
+    FileBlockBuilderTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testBlockDequeIsFilledInBatches();
+    }
+
+    ~FileBlockBuilderTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    void testBlockDequeIsFilledInBatches()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->useExtentAllocation = false;
+        knoxcrypt::FileBlockBuilder builder(io);
+        knoxcrypt::SharedImageStream stream;
+
+        // blocks are handed out in order across batch boundaries; none are
+        // registered with the bitmap so every block after the root is free
+        std::vector<uint64_t> blocks;
+        for (uint64_t i = 1; i < io->blocks; ++i) {
+            blocks.push_back(builder.buildWritableFileBlock(io, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                                                            stream).getIndex());
+        }
+        bool inOrder(true);
+        for (uint64_t i = 0; i < blocks.size(); ++i) {
+            inOrder &= (blocks[i] == i + 1);
+        }
+        ASSERT_EQUAL(true, inOrder, "FileBlockBuilderTest::testBlockDequeIsFilledInBatches in order");
+
+        // once the cursor reaches the end of the volume, it wraps around
+        ASSERT_EQUAL(1u, builder.buildWritableFileBlock(io, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                                                       stream).getIndex(),
+                     "FileBlockBuilderTest::testBlockDequeIsFilledInBatches wraps");
+    }
+};
@@ -28,6 +28,7 @@
 
 #include "knoxcrypt/ContainerImageStream.hpp"
 #include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
 #include "knoxcrypt/FileDevice.hpp"
 #include "knoxcrypt/FileStreamPtr.hpp"
 #include "knoxcrypt/OpenDisposition.hpp"
@@ -54,6 +55,7 @@ class FileDeviceTest
         boost::filesystem::create_directories(m_uniquePath);
         testWriteReportsCorrectFileSize();
         testWriteFollowedByRead();
+        testCopyIsBufferedUntilClose();
     }
 
     ~FileDeviceTest()
@@ -108,6 +110,43 @@ class FileDeviceTest
         }
     }
 
+    void testCopyIsBufferedUntilClose()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        std::string const testData(createLargeStringToWrite());
+        uint64_t startBlock;
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->useBlockCache = true;
+            io->writeBufferBytes = 16 * 1024;
+            io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+            uint64_t const freeBlocks = io->freeBlocks;
+            knoxcrypt::SharedFile entry(std::make_shared<knoxcrypt::File>(io, "test.txt"));
+            knoxcrypt::FileDevice device(entry);
+
+            // less than the write buffer holds isn't written until flushed
+            (void)device.write(testData.c_str(), 1000);
+            ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileStreamTest::testCopyIsBufferedUntilClose held back");
+
+            // boost::iostreams::copy writes 4K at a time, filling the buffer
+            // several times over, and closes the device when done
+            std::istringstream in(testData.substr(1000));
+            (void)boost::iostreams::copy(in, device);
+            ASSERT_EQUAL(freeBlocks - ((BIG_SIZE + 4083) / 4084), io->freeBlocks,
+                         "FileStreamTest::testCopyIsBufferedUntilClose blocks");
+            startBlock = entry->getStartVolumeBlockIndex();
+        }
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            knoxcrypt::File entry(io, "entry", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+            ASSERT_EQUAL(uint64_t(BIG_SIZE), entry.fileSize(), "FileStreamTest::testCopyIsBufferedUntilClose size");
+            std::vector<char> buffer(entry.fileSize());
+            (void)entry.read(&buffer.front(), buffer.size());
+            ASSERT_EQUAL(testData, std::string(buffer.begin(), buffer.end()),
+                         "FileStreamTest::testCopyIsBufferedUntilClose content");
+        }
+    }
+
   private:
 
     boost::filesystem::path m_uniquePath;
@@ -28,6 +28,8 @@
 
 #include "knoxcrypt/ContainerImageStream.hpp"
 #include "knoxcrypt/File.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
+#include "knoxcrypt/FileBlockIterator.hpp"
 #include "knoxcrypt/FileEntryException.hpp"
 #include "knoxcrypt/detail/Detailknoxcrypt.hpp"
 #include "knoxcrypt/detail/DetailFileBlock.hpp"
@@ -40,8 +42,11 @@
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/stream.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
 
 using namespace simpletest;
 
@@ -54,6 +59,7 @@ class FileTest
         testFileSizeReportedCorrectly();
         testBlocksAllocated();
         testFileUnlink();
+        testBlocksInUseQueriedTogether();
         testReadingFromNonReadableThrows();
         testWritingToNonWritableThrows();
         testBigWriteFollowedByRead();
@@ -72,6 +78,21 @@ class FileTest
         testSeekingFromCurrentPositive_bigSeek();
         testEdgeCaseEndOfBlockOverWrite();
         testEdgeCaseEndOfBlockAppend();
+        testDelayedAllocationWritesContiguousBatches();
+        testDelayedAllocationBeforeRead();
+        testMovedFileWritesPendingDataOnce();
+        testPendingDataOnFullImage();
+        testTruncateDeallocatesTrailingBlocks();
+        testUnlinkedBlocksAreReused();
+        testSeekAfterAppendAndTruncate();
+        testIndexedFileIsReadBackFromIndex();
+        testIndexedFileWithOverflowIndexBlocks();
+        testAppendFromRecordedTail();
+        testStaleTailRecordIsIgnored();
+        testLargerBlockSize();
+        testReadsSpanningBlockRuns();
+        testSparseIndexedFile();
+        testOverwritePastEndReadsBack();
     }
 
     ~FileTest()
@@ -191,6 +212,39 @@ class FileTest
         }
     }
 
+    void testBlocksInUseQueriedTogether()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::File entry(io, "test.txt");
+        std::string testData(createLargeStringToWrite());
+        (void)entry.write(testData.c_str(), testData.length());
+        entry.flush();
+
+        // the file's blocks with a block that was never allocated in amongst them
+        std::vector<uint64_t> blockIndices(getFileBlocks(io, entry.getStartVolumeBlockIndex()));
+        blockIndices.insert(blockIndices.begin() + 1, io->blocks - 1);
+        {
+            knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::out | std::ios::binary);
+            std::vector<bool> const inUse(knoxcrypt::detail::areBlocksInUse(blockIndices, in));
+            ASSERT_EQUAL(blockIndices.size(), inUse.size(), "FileTest::testBlocksInUseQueriedTogether count");
+            bool same(true);
+            for (size_t i = 0; i < blockIndices.size(); ++i) {
+                same &= (inUse[i] == knoxcrypt::detail::isBlockInUse(blockIndices[i], io->blocks, in));
+            }
+            ASSERT_EQUAL(true, same, "FileTest::testBlocksInUseQueriedTogether matches single queries");
+            ASSERT_EQUAL(false, inUse[1], "FileTest::testBlocksInUseQueriedTogether unallocated");
+            in.close();
+        }
+
+        entry.unlink();
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<bool> const inUse(knoxcrypt::detail::areBlocksInUse(blockIndices, in));
+        in.close();
+        ASSERT_EQUAL(true, std::find(inUse.begin(), inUse.end(), true) == inUse.end(),
+                     "FileTest::testBlocksInUseQueriedTogether deallocated");
+    }
+
     void testReadingFromNonReadableThrows()
     {
         boost::filesystem::path testPath = buildImage(m_uniquePath);
@@ -540,7 +594,7 @@ class FileTest
             std::string const testString("Hello and goodbye!");
             std::string testData(testString);
             std::vector<uint8_t> vec(testData.begin(), testData.end());
-            entry.write((char*)&vec.front(), BIG_SIZE);
+            entry.write((char*)&vec.front(), vec.size());
             entry.flush();
         }
 
@@ -827,4 +881,625 @@ class FileTest
             ASSERT_EQUAL(recovered, testData, "FileTest:: testEdgeCaseEndOfBlockAppend() content");
         }
     }
+
+    knoxcrypt::SharedCoreIO createDelayedAllocationIO(boost::filesystem::path const &testPath)
+    {
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
+        return io;
+    }
+
+    std::vector<uint64_t> getFileBlocks(knoxcrypt::SharedCoreIO const &io, uint64_t const startBlock)
+    {
+        std::vector<uint64_t> blocks;
+        knoxcrypt::FileBlockIterator it(io, startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        knoxcrypt::FileBlockIterator end;
+        for (; it != end; ++it) {
+            blocks.push_back(it->getIndex());
+        }
+        return blocks;
+    }
+
+    void testDelayedAllocationWritesContiguousBatches()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createDelayedAllocationIO(testPath));
+        uint64_t const freeBlocks = io->freeBlocks;
+
+        // two files written a chunk at a time but only flushed at the end
+        std::string const chunkA(5000, 'a');
+        std::string const chunkB(5000, 'b');
+        knoxcrypt::File fileA(io, "a.txt");
+        knoxcrypt::File fileB(io, "b.txt");
+        for (int i = 0; i < 20; ++i) {
+            (void)fileA.write(chunkA.c_str(), chunkA.length());
+            (void)fileB.write(chunkB.c_str(), chunkB.length());
+        }
+        ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileTest::testDelayedAllocationWritesContiguousBatches nothing allocated yet");
+        fileA.flush();
+        fileB.flush();
+        ASSERT_EQUAL(freeBlocks - 50, io->freeBlocks, "FileTest::testDelayedAllocationWritesContiguousBatches allocated");
+
+        std::vector<uint64_t> blocksA(getFileBlocks(io, fileA.getStartVolumeBlockIndex()));
+        ASSERT_EQUAL(25u, blocksA.size(), "FileTest::testDelayedAllocationWritesContiguousBatches block count");
+        bool contiguous(true);
+        for (size_t i = 1; i < blocksA.size(); ++i) {
+            contiguous &= (blocksA[i] == blocksA[i - 1] + 1);
+        }
+        ASSERT_EQUAL(true, contiguous, "FileTest::testDelayedAllocationWritesContiguousBatches contiguous");
+        ASSERT_EQUAL(true, io->blockBuilder->getVolumeBitMap()->isRangeInUse(io, blocksA.front(), blocksA.size()),
+                     "FileTest::testDelayedAllocationWritesContiguousBatches registered");
+
+        // a further append carries on from the batch
+        (void)fileA.write(chunkA.c_str(), chunkA.length());
+        fileA.flush();
+        ASSERT_EQUAL(chunkA.length() * 21, fileA.fileSize(), "FileTest::testDelayedAllocationWritesContiguousBatches append size");
+
+        knoxcrypt::File readBack(io, "a.txt", fileA.getStartVolumeBlockIndex(),
+                                 knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        std::vector<char> buffer(chunkA.length() * 21);
+        ASSERT_EQUAL(std::streamsize(buffer.size()), readBack.read(&buffer.front(), buffer.size()),
+                     "FileTest::testDelayedAllocationWritesContiguousBatches read size");
+        ASSERT_EQUAL(std::string(buffer.size(), 'a'), std::string(buffer.begin(), buffer.end()),
+                     "FileTest::testDelayedAllocationWritesContiguousBatches content");
+    }
+
+    void testDelayedAllocationBeforeRead()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createDelayedAllocationIO(testPath));
+
+        // seeking back over data that hasn't been given blocks yet
+        knoxcrypt::File entry(io, "test.txt");
+        std::string testData(createLargeStringToWrite());
+        (void)entry.write(testData.c_str(), testData.length());
+        (void)entry.seek(0);
+        std::vector<char> buffer(testData.length());
+        (void)entry.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(testData, std::string(buffer.begin(), buffer.end()), "FileTest::testDelayedAllocationBeforeRead content");
+    }
+
+    void testMovedFileWritesPendingDataOnce()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createDelayedAllocationIO(testPath));
+        uint64_t const freeBlocks = io->freeBlocks;
+
+        std::string const chunk(5000, 'a');
+        {
+            knoxcrypt::File source(io, "a.txt");
+            for (int i = 0; i < 20; ++i) {
+                (void)source.write(chunk.c_str(), chunk.length());
+            }
+            {
+                knoxcrypt::File target(std::move(source));
+                ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileTest::testMovedFileWritesPendingDataOnce nothing allocated yet");
+            }
+            ASSERT_EQUAL(freeBlocks - 25, io->freeBlocks, "FileTest::testMovedFileWritesPendingDataOnce moved to");
+        }
+        ASSERT_EQUAL(freeBlocks - 25, io->freeBlocks, "FileTest::testMovedFileWritesPendingDataOnce moved from");
+
+        // a file assigned to writes out what it was holding first
+        knoxcrypt::File target(io, "b.txt");
+        (void)target.write(chunk.c_str(), chunk.length());
+        target = knoxcrypt::File(io, "c.txt");
+        ASSERT_EQUAL(freeBlocks - 27, io->freeBlocks, "FileTest::testMovedFileWritesPendingDataOnce assigned to");
+    }
+
+    void testPendingDataOnFullImage()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createDelayedAllocationIO(testPath));
+        io->writeBufferBytes = 16 * 1024 * 1024;
+
+        // more data than there are blocks for; the file going out of scope
+        // without a flush mustn't take the process with it
+        std::string const chunk(io->blockSize * 64, 'a');
+        bool caught = false;
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            for (uint64_t i = 0; i < io->blocks / 64 + 1; ++i) {
+                (void)entry.write(chunk.c_str(), chunk.length());
+            }
+            try {
+                entry.flush();
+            } catch (std::runtime_error const &) {
+                caught = true;
+            }
+        }
+        ASSERT_EQUAL(true, caught, "FileTest::testPendingDataOnFullImage flush throws");
+    }
+
+    void testTruncateDeallocatesTrailingBlocks()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        knoxcrypt::File entry(io, "test.txt");
+        std::string const testData(25000, 'a');
+        (void)entry.write(testData.c_str(), testData.length());
+        entry.flush();
+        std::vector<uint64_t> blocks(getFileBlocks(io, entry.getStartVolumeBlockIndex()));
+        ASSERT_EQUAL(7u, blocks.size(), "FileTest::testTruncateDeallocatesTrailingBlocks block count");
+        uint64_t const freeBlocks = io->freeBlocks;
+
+        // shrinking to within the second block frees the five after it
+        entry.truncate(5000);
+        ASSERT_EQUAL(5000u, entry.fileSize(), "FileTest::testTruncateDeallocatesTrailingBlocks size");
+        ASSERT_EQUAL(freeBlocks + 5, io->freeBlocks, "FileTest::testTruncateDeallocatesTrailingBlocks free count");
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::out | std::ios::binary);
+        std::vector<bool> const inUse(knoxcrypt::detail::areBlocksInUse(blocks, in));
+        in.close();
+        bool trailingFree(true);
+        for (size_t i = 2; i < inUse.size(); ++i) {
+            trailingFree &= !inUse[i];
+        }
+        ASSERT_EQUAL(true, inUse[0] && inUse[1], "FileTest::testTruncateDeallocatesTrailingBlocks kept");
+        ASSERT_EQUAL(true, trailingFree, "FileTest::testTruncateDeallocatesTrailingBlocks freed");
+
+        // appending carries on from the truncated end
+        std::string const appended(3000, 'b');
+        (void)entry.write(appended.c_str(), appended.length());
+        entry.flush();
+
+        knoxcrypt::File readBack(io, "test.txt", entry.getStartVolumeBlockIndex(),
+                                 knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        ASSERT_EQUAL(8000u, readBack.fileSize(), "FileTest::testTruncateDeallocatesTrailingBlocks append size");
+        std::vector<char> buffer(8000);
+        (void)readBack.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(std::string(5000, 'a') + appended, std::string(buffer.begin(), buffer.end()),
+                     "FileTest::testTruncateDeallocatesTrailingBlocks content");
+    }
+
+    void testUnlinkedBlocksAreReused()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        uint64_t const freeBlocks = io->freeBlocks;
+
+        knoxcrypt::File first(io, "first.txt");
+        std::string const firstData(30000, 'a');
+        (void)first.write(firstData.c_str(), firstData.length());
+        first.flush();
+        first.unlink();
+        ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileTest::testUnlinkedBlocksAreReused all freed");
+
+        // a smaller file written over the freed blocks mustn't pick up
+        // any of the old block headers
+        knoxcrypt::File second(io, "second.txt");
+        std::string const secondData(10000, 'b');
+        (void)second.write(secondData.c_str(), secondData.length());
+        second.flush();
+
+        knoxcrypt::File readBack(io, "second.txt", second.getStartVolumeBlockIndex(),
+                                 knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        ASSERT_EQUAL(secondData.length(), readBack.fileSize(), "FileTest::testUnlinkedBlocksAreReused size");
+        std::vector<char> buffer(secondData.length());
+        (void)readBack.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(secondData, std::string(buffer.begin(), buffer.end()), "FileTest::testUnlinkedBlocksAreReused content");
+        ASSERT_EQUAL(3u, getFileBlocks(io, second.getStartVolumeBlockIndex()).size(),
+                     "FileTest::testUnlinkedBlocksAreReused block count");
+    }
+
+    void testSeekAfterAppendAndTruncate()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        // each block's worth of data is a different letter
+        std::string testData;
+        for (int i = 0; i < 6; ++i) {
+            testData.append(4084, char('a' + i));
+        }
+        uint64_t startBlock;
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            (void)entry.write(testData.c_str(), testData.length());
+            entry.flush();
+            startBlock = entry.getStartVolumeBlockIndex();
+        }
+
+        // reopened, the block map is built from the chain on disk
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition());
+        char c;
+        (void)entry.seek(4084 * 4 + 10);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('e', c, "FileTest::testSeekAfterAppendAndTruncate seek into reopened file");
+
+        // blocks given up by a truncate can't be seeked to
+        entry.truncate(4084 * 2 + 5);
+        ASSERT_EQUAL(-1, entry.seek(4084 * 4), "FileTest::testSeekAfterAppendAndTruncate seek past truncation");
+
+        // and blocks added by an append can
+        (void)entry.seek(0, std::ios::end);
+        std::string const appended(4084 * 2, 'z');
+        (void)entry.write(appended.c_str(), appended.length());
+        entry.flush();
+        (void)entry.seek(-1, std::ios::end);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('z', c, "FileTest::testSeekAfterAppendAndTruncate seek from end after append");
+        (void)entry.seek(4084 * 2 + 2);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('c', c, "FileTest::testSeekAfterAppendAndTruncate seek before append");
+    }
+
+    void testIndexedFileIsReadBackFromIndex()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        uint64_t const freeBlocks = io->freeBlocks;
+
+        // the index root comes first and the data follows it
+        std::string testData;
+        for (int i = 0; i < 6; ++i) {
+            testData.append(4084, char('a' + i));
+        }
+        testData.append(100, 'z');
+        uint64_t startBlock;
+        {
+            knoxcrypt::File entry(io, "test.txt", false, knoxcrypt::FileLayout::Indexed);
+            (void)entry.write(testData.c_str(), testData.length());
+            entry.flush();
+            startBlock = entry.getStartVolumeBlockIndex();
+        }
+        ASSERT_EQUAL(freeBlocks - 8, io->freeBlocks, "FileTest::testIndexedFileIsReadBackFromIndex allocated");
+
+        // the root holds a single extent rather than a chain of blocks
+        knoxcrypt::FileBlock root(io, startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        ASSERT_EQUAL(12u, root.getDataBytesWritten(), "FileTest::testIndexedFileIsReadBackFromIndex one extent");
+        ASSERT_EQUAL(startBlock, root.getNextIndex(), "FileTest::testIndexedFileIsReadBackFromIndex no overflow");
+
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                              knoxcrypt::FileLayout::Indexed);
+        ASSERT_EQUAL(testData.length(), entry.fileSize(), "FileTest::testIndexedFileIsReadBackFromIndex size");
+        char c;
+        (void)entry.seek(4084 * 3 + 1);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('d', c, "FileTest::testIndexedFileIsReadBackFromIndex seek");
+        (void)entry.seek(0);
+        std::vector<char> buffer(testData.length());
+        (void)entry.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(testData, std::string(buffer.begin(), buffer.end()), "FileTest::testIndexedFileIsReadBackFromIndex content");
+
+        // unlinking gives back the root along with the data
+        entry.unlink();
+        ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileTest::testIndexedFileIsReadBackFromIndex unlink");
+    }
+
+    void testIndexedFileWithOverflowIndexBlocks()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        // two files grown a block at a time take turns at the next free
+        // block so every extent is a single block long; more extents than
+        // fit in the root are needed
+        std::string const blockA(4084, 'a');
+        std::string const blockB(4084, 'b');
+        int const blocks = 400;
+        uint64_t startA;
+        uint64_t startB;
+        {
+            knoxcrypt::File fileA(io, "a.txt", false, knoxcrypt::FileLayout::Indexed);
+            knoxcrypt::File fileB(io, "b.txt", false, knoxcrypt::FileLayout::Indexed);
+            for (int i = 0; i < blocks; ++i) {
+                (void)fileA.write(blockA.c_str(), blockA.length());
+                (void)fileB.write(blockB.c_str(), blockB.length());
+            }
+            fileA.flush();
+            fileB.flush();
+            startA = fileA.getStartVolumeBlockIndex();
+            startB = fileB.getStartVolumeBlockIndex();
+        }
+        knoxcrypt::FileBlock root(io, startA, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        ASSERT_EQUAL(true, root.getNextIndex() != startA, "FileTest::testIndexedFileWithOverflowIndexBlocks overflow");
+
+        uint64_t const freeBlocks = io->freeBlocks;
+        {
+            knoxcrypt::File fileA(io, "a.txt", startA, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                                  knoxcrypt::FileLayout::Indexed);
+            ASSERT_EQUAL(blockA.length() * blocks, fileA.fileSize(), "FileTest::testIndexedFileWithOverflowIndexBlocks size");
+            (void)fileA.seek(blockA.length() * (blocks - 1));
+            std::vector<char> buffer(blockA.length());
+            (void)fileA.read(&buffer.front(), buffer.size());
+            ASSERT_EQUAL(blockA, std::string(buffer.begin(), buffer.end()),
+                         "FileTest::testIndexedFileWithOverflowIndexBlocks last block");
+
+            // back within the root; the overflow block is given back too
+            fileA.truncate(blockA.length() * 100);
+        }
+        ASSERT_EQUAL(freeBlocks + 301, io->freeBlocks, "FileTest::testIndexedFileWithOverflowIndexBlocks truncate");
+
+        knoxcrypt::File fileA(io, "a.txt", startA, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(),
+                              knoxcrypt::FileLayout::Indexed);
+        ASSERT_EQUAL(blockA.length() * 100, fileA.fileSize(), "FileTest::testIndexedFileWithOverflowIndexBlocks truncated size");
+        knoxcrypt::File fileB(io, "b.txt", startB, knoxcrypt::OpenDisposition::buildReadOnlyDisposition(),
+                              knoxcrypt::FileLayout::Indexed);
+        (void)fileB.seek(blockB.length() * 350);
+        char c;
+        (void)fileB.read(&c, 1);
+        ASSERT_EQUAL('b', c, "FileTest::testIndexedFileWithOverflowIndexBlocks other file");
+    }
+
+    void testAppendFromRecordedTail()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        std::string testData;
+        for (int i = 0; i < 3; ++i) {
+            testData.append(4084, char('a' + i));
+        }
+        testData.append(100, 'd');
+        uint64_t startBlock;
+        knoxcrypt::FileSizeRecord record;
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            (void)entry.write(testData.c_str(), testData.length());
+            entry.flush();
+            startBlock = entry.getStartVolumeBlockIndex();
+            record = entry.sizeRecord();
+        }
+        ASSERT_EQUAL(4u, record.blockCount, "FileTest::testAppendFromRecordedTail block count");
+
+        // the append starts at the recorded tail and carries on the chain
+        std::string const more(5000, 'e');
+        {
+            knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                                  knoxcrypt::FileLayout::Chained, record);
+            ASSERT_EQUAL(std::streamoff(testData.length()), entry.tell(), "FileTest::testAppendFromRecordedTail position");
+            (void)entry.write(more.c_str(), more.length());
+            entry.flush();
+            ASSERT_EQUAL(5u, entry.blockCount(), "FileTest::testAppendFromRecordedTail appended block count");
+
+            // seeking back needs the blocks that were skipped
+            char c;
+            (void)entry.seek(4084 + 10);
+            (void)entry.read(&c, 1);
+            ASSERT_EQUAL('b', c, "FileTest::testAppendFromRecordedTail seek back");
+        }
+        testData.append(more);
+
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        std::vector<char> buffer(entry.fileSize());
+        (void)entry.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(testData, std::string(buffer.begin(), buffer.end()), "FileTest::testAppendFromRecordedTail content");
+    }
+
+    void testStaleTailRecordIsIgnored()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        std::string testData(10000, 'a');
+        uint64_t startBlock;
+        knoxcrypt::FileSizeRecord record;
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            (void)entry.write(testData.c_str(), testData.length());
+            entry.flush();
+            startBlock = entry.getStartVolumeBlockIndex();
+            record = entry.sizeRecord();
+            entry.truncate(100);
+        }
+
+        // the recorded tail block has been deallocated so the chain is
+        // walked instead
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildAppendDisposition(),
+                              knoxcrypt::FileLayout::Chained, record);
+        ASSERT_EQUAL(100u, entry.fileSize(), "FileTest::testStaleTailRecordIsIgnored size");
+        ASSERT_EQUAL(100, entry.tell(), "FileTest::testStaleTailRecordIsIgnored position");
+        ASSERT_EQUAL(1u, entry.blockCount(), "FileTest::testStaleTailRecordIsIgnored block count");
+    }
+
+    void testLargerBlockSize()
+    {
+        std::string testImage(boost::filesystem::unique_path().string());
+        boost::filesystem::path testPath = m_uniquePath / testImage;
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->blockSize = 65536;
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->blockSize = 65536;
+
+        // each block holds the block size less its metadata
+        uint64_t const blockData = 65536 - 12;
+        std::string testData;
+        for (int i = 0; i < 3; ++i) {
+            testData.append(blockData, char('a' + i));
+        }
+        testData.append(100, 'd');
+        uint64_t startBlock;
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            (void)entry.write(testData.c_str(), testData.length());
+            entry.flush();
+            startBlock = entry.getStartVolumeBlockIndex();
+            ASSERT_EQUAL(4u, entry.blockCount(), "FileTest::testLargerBlockSize block count");
+        }
+
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        ASSERT_EQUAL(testData.length(), entry.fileSize(), "FileTest::testLargerBlockSize size");
+        char c;
+        (void)entry.seek(blockData * 2 + 1);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('c', c, "FileTest::testLargerBlockSize seek from beginning");
+        (void)entry.seek(-101, std::ios::end);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('c', c, "FileTest::testLargerBlockSize seek from end");
+        (void)entry.seek(-(blockData + 1), std::ios::cur);
+        (void)entry.read(&c, 1);
+        ASSERT_EQUAL('b', c, "FileTest::testLargerBlockSize seek from current");
+        (void)entry.seek(0);
+        std::vector<char> buffer(testData.length());
+        (void)entry.read(&buffer.front(), buffer.size());
+        ASSERT_EQUAL(testData, std::string(buffer.begin(), buffer.end()), "FileTest::testLargerBlockSize content");
+    }
+
+    void testReadsSpanningBlockRuns()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        // two files written in turns have their blocks laid out in runs
+        // of three with the other file's blocks in between
+        std::string dataA;
+        std::string dataB;
+        for (int i = 0; i < 4084 * 12; ++i) {
+            dataA.push_back(char(i % 251));
+            dataB.push_back(char(i % 241));
+        }
+        uint64_t startA;
+        {
+            knoxcrypt::File fileA(io, "a.txt");
+            knoxcrypt::File fileB(io, "b.txt");
+            for (size_t offset = 0; offset < dataA.length(); offset += 4084 * 3) {
+                (void)fileA.write(dataA.c_str() + offset, 4084 * 3);
+                (void)fileB.write(dataB.c_str() + offset, 4084 * 3);
+            }
+            fileA.flush();
+            fileB.flush();
+            startA = fileA.getStartVolumeBlockIndex();
+        }
+
+        // reads of differing sizes from differing offsets cross both the
+        // runs and the gaps between them
+        knoxcrypt::File entry(io, "a.txt", startA, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+        bool matched = true;
+        for (size_t chunk : {size_t(4084 * 2), size_t(4084 * 5 + 17), size_t(30000)}) {
+            for (size_t start : {size_t(0), size_t(100), size_t(4084 * 2)}) {
+                (void)entry.seek(start);
+                std::vector<char> buffer(chunk);
+                size_t const expected = std::min(chunk, dataA.length() - start);
+                auto const read = entry.read(&buffer.front(), chunk);
+                matched = matched && (size_t(read) == expected) &&
+                    std::equal(buffer.begin(), buffer.begin() + expected, dataA.begin() + start);
+            }
+        }
+        ASSERT_EQUAL(true, matched, "FileTest::testReadsSpanningBlockRuns chunks");
+
+        // sequential reads carry on from where the previous one finished
+        (void)entry.seek(50);
+        std::string sequential;
+        std::vector<char> buffer(10000);
+        std::streamsize read;
+        while ((read = entry.read(&buffer.front(), buffer.size())) > 0) {
+            sequential.append(buffer.begin(), buffer.begin() + read);
+        }
+        ASSERT_EQUAL(dataA.substr(50), sequential, "FileTest::testReadsSpanningBlockRuns sequential");
+    }
+
+    void testSparseIndexedFile()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        uint64_t const freeBlocks = io->freeBlocks;
+        uint64_t const space = 4084;
+
+        // writing beyond the end leaves a hole that takes up no blocks; the
+        // index root and the two blocks written to are all that's allocated
+        uint64_t const end = (space * 5) + 13;
+        uint64_t startBlock;
+        {
+            knoxcrypt::File entry(io, "test.txt", false, knoxcrypt::FileLayout::Indexed);
+            (void)entry.write("abc", 3);
+            ASSERT_EQUAL(std::streamoff(space * 5 + 10), entry.seek(space * 5 + 10), "FileTest::testSparseIndexedFile seek beyond end");
+            (void)entry.write("xyz", 3);
+            entry.flush();
+            ASSERT_EQUAL(end, entry.fileSize(), "FileTest::testSparseIndexedFile size");
+            startBlock = entry.getStartVolumeBlockIndex();
+        }
+        ASSERT_EQUAL(freeBlocks - 3, io->freeBlocks, "FileTest::testSparseIndexedFile allocated");
+
+        // reopened, the hole is found from the index and reads back as zeros
+        knoxcrypt::File entry(io, "test.txt", startBlock, knoxcrypt::OpenDisposition::buildOverwriteDisposition(),
+                              knoxcrypt::FileLayout::Indexed);
+        ASSERT_EQUAL(end, entry.fileSize(), "FileTest::testSparseIndexedFile reopened size");
+        ASSERT_EQUAL(3u, entry.blockCount(), "FileTest::testSparseIndexedFile block count");
+        std::string expected(end, '\0');
+        expected.replace(0, 3, "abc");
+        expected.replace(space * 5 + 10, 3, "xyz");
+        std::vector<char> buffer(end);
+        ASSERT_EQUAL(std::streamoff(end), entry.read(&buffer.front(), end), "FileTest::testSparseIndexedFile read");
+        ASSERT_EQUAL(expected, std::string(buffer.begin(), buffer.end()), "FileTest::testSparseIndexedFile content");
+
+        // the data and holes are found as with SEEK_DATA and SEEK_HOLE
+        ASSERT_EQUAL(std::streamoff(space), entry.nextHoleOffset(0), "FileTest::testSparseIndexedFile hole");
+        ASSERT_EQUAL(std::streamoff(space * 5), entry.nextDataOffset(space + 1), "FileTest::testSparseIndexedFile data");
+        ASSERT_EQUAL(std::streamoff(end), entry.nextHoleOffset(space * 5), "FileTest::testSparseIndexedFile end is a hole");
+        ASSERT_EQUAL(-1, entry.nextDataOffset(end), "FileTest::testSparseIndexedFile nothing beyond end");
+
+        // writing in to the hole allocates just the block written to
+        (void)entry.seek(space * 2 + 7);
+        (void)entry.write("hole", 4);
+        entry.flush();
+        expected.replace(space * 2 + 7, 4, "hole");
+        ASSERT_EQUAL(freeBlocks - 4, io->freeBlocks, "FileTest::testSparseIndexedFile filled");
+        ASSERT_EQUAL(end, entry.fileSize(), "FileTest::testSparseIndexedFile filled size");
+        (void)entry.seek(0);
+        (void)entry.read(&buffer.front(), end);
+        ASSERT_EQUAL(expected, std::string(buffer.begin(), buffer.end()), "FileTest::testSparseIndexedFile filled content");
+        ASSERT_EQUAL(std::streamoff(space * 2), entry.nextDataOffset(space), "FileTest::testSparseIndexedFile filled data");
+        ASSERT_EQUAL(std::streamoff(space * 3), entry.nextHoleOffset(space * 2), "FileTest::testSparseIndexedFile filled hole");
+
+        // a truncate in to the hole allocates the new last block and one
+        // growing the file adds to the hole
+        entry.truncate(space * 3 + 5);
+        ASSERT_EQUAL(freeBlocks - 4, io->freeBlocks, "FileTest::testSparseIndexedFile truncated");
+        entry.truncate(space * 8);
+        ASSERT_EQUAL(space * 8, entry.fileSize(), "FileTest::testSparseIndexedFile grown");
+        ASSERT_EQUAL(freeBlocks - 5, io->freeBlocks, "FileTest::testSparseIndexedFile grown allocated");
+        ASSERT_EQUAL(std::streamoff(space * 4), entry.nextHoleOffset(space * 3), "FileTest::testSparseIndexedFile grown hole");
+        ASSERT_EQUAL(std::streamoff(space * 7), entry.nextDataOffset(space * 4), "FileTest::testSparseIndexedFile grown data");
+        (void)entry.seek(space * 2 + 7);
+        std::vector<char> tail(space * 6);
+        ASSERT_EQUAL(std::streamoff(space * 6 - 7), entry.read(&tail.front(), tail.size()), "FileTest::testSparseIndexedFile grown read");
+        ASSERT_EQUAL(std::string("hole") + std::string(space * 6 - 11, '\0'), std::string(tail.begin(), tail.end() - 7),
+                     "FileTest::testSparseIndexedFile grown content");
+
+        // unlinking gives back every block
+        entry.unlink();
+        ASSERT_EQUAL(freeBlocks, io->freeBlocks, "FileTest::testSparseIndexedFile unlink");
+
+        // however far in to the file a write is, only its block is needed
+        {
+            knoxcrypt::File big(io, "big.txt", false, knoxcrypt::FileLayout::Indexed);
+            (void)big.seek(uint64_t(1) << 30);
+            (void)big.write("z", 1);
+            big.flush();
+            ASSERT_EQUAL((uint64_t(1) << 30) + 1, big.fileSize(), "FileTest::testSparseIndexedFile big size");
+            ASSERT_EQUAL(freeBlocks - 2, io->freeBlocks, "FileTest::testSparseIndexedFile big allocated");
+            char c = 'a';
+            (void)big.seek(-2, std::ios::end);
+            ASSERT_EQUAL(2, big.read(&c, 1) + big.read(&c, 1), "FileTest::testSparseIndexedFile big read");
+            ASSERT_EQUAL('z', c, "FileTest::testSparseIndexedFile big content");
+        }
+    }
+
+    void testOverwritePastEndReadsBack()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        {
+            knoxcrypt::File entry(io, "test.txt");
+            (void)entry.write("hello", 5);
+            entry.flush();
+        }
+
+        // the same file reads back what an overwrite added past its end
+        // without being opened again
+        knoxcrypt::File entry(io, "test.txt", 1, knoxcrypt::OpenDisposition::buildOverwriteDisposition());
+        (void)entry.seek(0, std::ios_base::end);
+        (void)entry.write(" world", 6);
+        entry.flush();
+        ASSERT_EQUAL(uint64_t(11), entry.fileSize(), "FileTest::testOverwritePastEndReadsBack size");
+        std::vector<char> readBack(11);
+        (void)entry.seek(0);
+        ASSERT_EQUAL(std::streamsize(11), entry.read(&readBack.front(), readBack.size()), "FileTest::testOverwritePastEndReadsBack read");
+        ASSERT_EQUAL(std::string("hello world"), std::string(readBack.begin(), readBack.end()),
+                     "FileTest::testOverwritePastEndReadsBack content");
+    }
 };
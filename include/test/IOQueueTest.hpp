@@ -0,0 +1,168 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/CoreFS.hpp"
+#include "knoxcrypt/IOQueue.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+#include "utility/PipelinedCopy.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simpletest;
+
+class IOQueueTest
+{
+  public:
+    IOQueueTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testCompletionsInOrder();
+        testDepthIsRespected();
+        testZeroDepthRunsInline();
+        testOperationErrorThrownOnCompletion();
+        testPipelinedCopyRoundTrip();
+    }
+
+    ~IOQueueTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    void testCompletionsInOrder()
+    {
+        knoxcrypt::IOQueue queue(4);
+        std::vector<std::streamsize> completed;
+        std::thread::id operationThread;
+        for (std::streamsize i = 0; i < 20; ++i) {
+            queue.submit([i, &operationThread] {
+                operationThread = std::this_thread::get_id();
+                return i;
+            }, [&completed](std::streamsize const n) {
+                completed.push_back(n);
+            });
+        }
+        queue.wait();
+        bool inOrder = completed.size() == 20;
+        for (size_t i = 0; inOrder && i < completed.size(); ++i) {
+            inOrder = completed[i] == std::streamsize(i);
+        }
+        ASSERT_EQUAL(true, inOrder, "IOQueueTest::testCompletionsInOrder() order");
+        ASSERT_EQUAL(true, queue.isAsynchronous() && operationThread != std::this_thread::get_id(),
+                     "IOQueueTest::testCompletionsInOrder() on worker");
+    }
+
+    void testDepthIsRespected()
+    {
+        // no more than the depth submitted without having been completed
+        size_t const depth = 3;
+        knoxcrypt::IOQueue queue(depth);
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t mostOutstanding = 0;
+        for (int i = 0; i < 50; ++i) {
+            queue.submit([] { return std::streamsize(1); },
+                         [&completed](std::streamsize const) { ++completed; });
+            ++submitted;
+            mostOutstanding = std::max(mostOutstanding, submitted - completed);
+        }
+        queue.wait();
+        ASSERT_EQUAL(depth, mostOutstanding, "IOQueueTest::testDepthIsRespected() outstanding");
+        ASSERT_EQUAL(submitted, completed, "IOQueueTest::testDepthIsRespected() all completed");
+    }
+
+    void testZeroDepthRunsInline()
+    {
+        knoxcrypt::IOQueue queue(0);
+        std::thread::id operationThread;
+        std::streamsize result = 0;
+        queue.submit([&operationThread] {
+            operationThread = std::this_thread::get_id();
+            return std::streamsize(7);
+        }, [&result](std::streamsize const n) {
+            result = n;
+        });
+        ASSERT_EQUAL(false, queue.isAsynchronous(), "IOQueueTest::testZeroDepthRunsInline() synchronous");
+        ASSERT_EQUAL(std::streamsize(7), result, "IOQueueTest::testZeroDepthRunsInline() completed in submit");
+        ASSERT_EQUAL(true, operationThread == std::this_thread::get_id(),
+                     "IOQueueTest::testZeroDepthRunsInline() same thread");
+    }
+
+    void testOperationErrorThrownOnCompletion()
+    {
+        knoxcrypt::IOQueue queue(2);
+        bool completed = false;
+        queue.submit([]() -> std::streamsize { throw std::runtime_error("bad read"); },
+                     [&completed](std::streamsize const) { completed = true; });
+        bool caught = false;
+        try {
+            queue.wait();
+        } catch (std::runtime_error const &) {
+            caught = true;
+        }
+        ASSERT_EQUAL(true, caught, "IOQueueTest::testOperationErrorThrownOnCompletion() thrown");
+        ASSERT_EQUAL(false, completed, "IOQueueTest::testOperationErrorThrownOnCompletion() not completed");
+    }
+
+    void testPipelinedCopyRoundTrip()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::CoreFS theBfs(io);
+
+        // several chunks and a bit, then something well under a chunk
+        for (size_t const bytes : {size_t(knoxcrypt::utility::COPY_CHUNK_BYTES * 3 + 1000), size_t(5000)}) {
+            std::string content(bytes, 0);
+            for (size_t i = 0; i < bytes; ++i) {
+                content[i] = char(i * 7 + (i >> 12));
+            }
+            std::string const path("/copied" + std::to_string(bytes));
+            theBfs.addFile(path);
+            {
+                std::istringstream in(content);
+                knoxcrypt::FileDevice device = theBfs.openFile(path, knoxcrypt::OpenDisposition::buildWriteOnlyDisposition());
+                knoxcrypt::utility::copyToContainer(in, device, bytes);
+            }
+            std::ostringstream out;
+            knoxcrypt::FileDevice device = theBfs.openFile(path, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
+            knoxcrypt::utility::copyFromContainer(device, out);
+            ASSERT_EQUAL(true, content == out.str(), "IOQueueTest::testPipelinedCopyRoundTrip() content");
+        }
+    }
+};
@@ -38,6 +38,7 @@
 #include <boost/filesystem/operations.hpp>
 
 #include <cassert>
+#include <fstream>
 
 using namespace simpletest;
 
@@ -51,6 +52,9 @@ class MakeKnoxCryptTest
         firstBlockIsReportedAsBeingFree();
         blocksCanBeSetAndCleared();
         testThatRootFolderContainsZeroEntries();
+        freshImageIsCleanlyUnmounted();
+        formatFeaturesAreReadBack();
+        blockSizeIsReadBack();
     }
 
     ~MakeKnoxCryptTest()
@@ -130,9 +134,9 @@ class MakeKnoxCryptTest
     {
         boost::filesystem::path testPath = buildImage(m_uniquePath);
         uint64_t blocks(2048);
-        uint64_t offset = knoxcrypt::detail::getOffsetOfFileBlock(0, blocks);
         // open a stream and read the first byte which signifies number of entries
         knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        uint64_t offset = knoxcrypt::detail::getOffsetOfFileBlock(0, blocks, io->blockSize);
         knoxcrypt::ContainerImageStream is(io, std::ios::in | std::ios::out | std::ios::binary);
         is.seekg(offset + knoxcrypt::detail::FILE_BLOCK_META);
         uint8_t bytes[8];
@@ -141,6 +145,86 @@ class MakeKnoxCryptTest
         ASSERT_EQUAL(count, 0, "testThatRootFolderContainsZeroEntries");
     }
 
+    void freshImageIsCleanlyUnmounted()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::ContainerImageStream is(io, std::ios::in | std::ios::binary);
+        knoxcrypt::detail::OptionalBlock allocated = knoxcrypt::detail::getCleanlyUnmountedAllocatedBlocks(is, io->blocks);
+        ASSERT_EQUAL(true, !!allocated, "MakeKnoxCryptTest::freshImageIsCleanlyUnmounted clean");
+        ASSERT_EQUAL(1u, *allocated, "MakeKnoxCryptTest::freshImageIsCleanlyUnmounted root block allocated");
+    }
+
+    void formatFeaturesAreReadBack()
+    {
+        // default images chain their file blocks
+        {
+            boost::filesystem::path testPath = buildImage(m_uniquePath);
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->indexedFiles = true;
+            knoxcrypt::detail::readImageIVAndRounds(io);
+            ASSERT_EQUAL(false, io->indexedFiles, "MakeKnoxCryptTest::formatFeaturesAreReadBack chained");
+        }
+
+        // the feature byte records indexed files
+        std::string testImage(boost::filesystem::unique_path().string());
+        boost::filesystem::path testPath = m_uniquePath / testImage;
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->indexedFiles = true;
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::detail::readImageIVAndRounds(io);
+        ASSERT_EQUAL(true, io->indexedFiles, "MakeKnoxCryptTest::formatFeaturesAreReadBack indexed");
+        ASSERT_EQUAL(true, io->encProps.cipher == cryptostreampp::Algorithm::AES,
+                     "MakeKnoxCryptTest::formatFeaturesAreReadBack cipher");
+
+        // images from before the feature byte repeat the cipher byte there
+        {
+            std::fstream header(testPath.string().c_str(), std::ios::in | std::ios::out | std::ios::binary);
+            (void)header.seekp(knoxcrypt::detail::FEATURES_OFFSET);
+            char const cipher = 1;
+            (void)header.write(&cipher, 1);
+        }
+        knoxcrypt::detail::readImageIVAndRounds(io);
+        ASSERT_EQUAL(false, io->indexedFiles, "MakeKnoxCryptTest::formatFeaturesAreReadBack old image");
+    }
+
+    void blockSizeIsReadBack()
+    {
+        // default images use the default block size
+        {
+            boost::filesystem::path testPath = buildImage(m_uniquePath);
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->blockSize = 65536;
+            knoxcrypt::detail::readImageIVAndRounds(io);
+            ASSERT_EQUAL(knoxcrypt::detail::FILE_BLOCK_SIZE, io->blockSize, "MakeKnoxCryptTest::blockSizeIsReadBack default");
+        }
+
+        std::string testImage(boost::filesystem::unique_path().string());
+        boost::filesystem::path testPath = m_uniquePath / testImage;
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->blockSize = 262144;
+            io->indexedFiles = true;
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::detail::readImageIVAndRounds(io);
+        ASSERT_EQUAL(262144u, io->blockSize, "MakeKnoxCryptTest::blockSizeIsReadBack larger");
+        ASSERT_EQUAL(true, io->indexedFiles, "MakeKnoxCryptTest::blockSizeIsReadBack other features");
+        ASSERT_EQUAL(true, io->encProps.cipher == cryptostreampp::Algorithm::AES,
+                     "MakeKnoxCryptTest::blockSizeIsReadBack cipher");
+
+        // the root folder is found at the larger block's offset
+        knoxcrypt::ContainerImageStream is(io, std::ios::in | std::ios::binary);
+        is.seekg(knoxcrypt::detail::getOffsetOfFileBlock(0, io->blocks, io->blockSize) + knoxcrypt::detail::FILE_BLOCK_META);
+        uint8_t bytes[8];
+        (void)is.read((char*)bytes, 8);
+        ASSERT_EQUAL(0u, knoxcrypt::detail::convertInt8ArrayToInt64(bytes), "MakeKnoxCryptTest::blockSizeIsReadBack root folder");
+    }
+
     boost::filesystem::path m_uniquePath;
 
 };
@@ -0,0 +1,255 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/ContainerImageStream.hpp"
+#include "knoxcrypt/CoreIO.hpp"
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "knoxcrypt/detail/DetailBitMap.hpp"
+#include "knoxcrypt/detail/DetailKnoxCrypt.hpp"
+#include "test/SimpleTest.hpp"
+#include "test/TestHelpers.hpp"
+#include "utility/MakeKnoxCrypt.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <vector>
+
+using namespace simpletest;
+
+class VolumeBitMapTest
+{
+  public:
+    VolumeBitMapTest() : m_uniquePath(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_uniquePath);
+        testCachedUpdatesAreDeferredUntilSync();
+        testCachedUpdatesWrittenBackOnDestruction();
+        testUncachedUpdatesAreWrittenThrough();
+        testScanningAndCounting();
+        testScanKernelsMatchByteLoops();
+        testRangeAndBatchQueries();
+        testSummarySkipsFullGroups();
+    }
+
+    ~VolumeBitMapTest()
+    {
+        boost::filesystem::remove_all(m_uniquePath);
+    }
+
+  private:
+
+    boost::filesystem::path m_uniquePath;
+
+    bool blockInUseOnDisk(knoxcrypt::SharedCoreIO const &io, uint64_t const block)
+    {
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::binary);
+        return knoxcrypt::detail::isBlockInUse(block, io->blocks, in);
+    }
+
+    void testCachedUpdatesAreDeferredUntilSync()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+
+        knoxcrypt::VolumeBitMap bitMap;
+        bitMap.setBlocksInUse(io, {1, 2, 3, 9, 700});
+        ASSERT_EQUAL(true, bitMap.isBlockInUse(io, 9), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync in memory");
+        ASSERT_EQUAL(4u, *bitMap.getNextAvailableBlock(io), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync next available");
+        ASSERT_EQUAL(false, blockInUseOnDisk(io, 9), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync not on disk");
+
+        bitMap.sync();
+        ASSERT_EQUAL(true, blockInUseOnDisk(io, 9), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync on disk A");
+        ASSERT_EQUAL(true, blockInUseOnDisk(io, 700), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync on disk B");
+
+        bitMap.setBlockInUse(io, 9, false);
+        bitMap.sync();
+        ASSERT_EQUAL(false, blockInUseOnDisk(io, 9), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync cleared on disk");
+        ASSERT_EQUAL(true, blockInUseOnDisk(io, 3), "VolumeBitMapTest::testCachedUpdatesAreDeferredUntilSync neighbour kept");
+    }
+
+    void testCachedUpdatesWrittenBackOnDestruction()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+        {
+            knoxcrypt::VolumeBitMap bitMap;
+            bitMap.setBlockInUse(io, 42);
+        }
+        ASSERT_EQUAL(true, blockInUseOnDisk(io, 42), "VolumeBitMapTest::testCachedUpdatesWrittenBackOnDestruction");
+    }
+
+    void testUncachedUpdatesAreWrittenThrough()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        knoxcrypt::SharedCoreIO otherIo(createTestIO(testPath));
+
+        knoxcrypt::VolumeBitMap bitMap;
+        knoxcrypt::VolumeBitMap otherBitMap;
+        bitMap.setBlockInUse(io, 5);
+        ASSERT_EQUAL(true, blockInUseOnDisk(io, 5), "VolumeBitMapTest::testUncachedUpdatesAreWrittenThrough on disk");
+
+        // the other bitmap must see the update made through the first
+        otherBitMap.setBlockInUse(otherIo, 6);
+        ASSERT_EQUAL(true, otherBitMap.isBlockInUse(otherIo, 5), "VolumeBitMapTest::testUncachedUpdatesAreWrittenThrough shared A");
+        ASSERT_EQUAL(true, bitMap.isBlockInUse(io, 6), "VolumeBitMapTest::testUncachedUpdatesAreWrittenThrough shared B");
+    }
+
+    void testScanningAndCounting()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->useBlockCache = true;
+
+        // block 0 is taken by the root folder
+        knoxcrypt::VolumeBitMap bitMap;
+        bitMap.setBlocksInUse(io, {1, 2, 3, 5, 70, 130});
+        ASSERT_EQUAL(7u, bitMap.getNumberOfAllocatedBlocks(io), "VolumeBitMapTest::testScanningAndCounting allocated");
+        std::vector<uint64_t> available = bitMap.getNAvailableBlocks(io, 3);
+        ASSERT_EQUAL(3u, available.size(), "VolumeBitMapTest::testScanningAndCounting N available size");
+        ASSERT_EQUAL(4u, available[0], "VolumeBitMapTest::testScanningAndCounting N available A");
+        ASSERT_EQUAL(6u, available[1], "VolumeBitMapTest::testScanningAndCounting N available B");
+        ASSERT_EQUAL(7u, available[2], "VolumeBitMapTest::testScanningAndCounting N available C");
+        available = bitMap.getNAvailableBlocks(io, 2, 129);
+        ASSERT_EQUAL(true, available == std::vector<uint64_t>({129, 131}), "VolumeBitMapTest::testScanningAndCounting N available from");
+        ASSERT_EQUAL(6u, *bitMap.getAvailableRun(io, 64), "VolumeBitMapTest::testScanningAndCounting run fits");
+        ASSERT_EQUAL(131u, *bitMap.getAvailableRun(io, 65), "VolumeBitMapTest::testScanningAndCounting run skips");
+        ASSERT_EQUAL(false, !!bitMap.getAvailableRun(io, io->blocks), "VolumeBitMapTest::testScanningAndCounting run too long");
+    }
+
+    void testScanKernelsMatchByteLoops()
+    {
+        // a mostly full bitmap that isn't a multiple of a word or a vector in size
+        std::vector<uint8_t> bytes(203, 0xFF);
+        bytes[0] = 0x7F;
+        bytes[40] = 0x0F;
+        bytes[41] = 0x00;
+        bytes[42] = 0x00;
+        bytes[202] = 0xFE;
+
+        uint64_t expectedCount(0);
+        std::vector<uint64_t> expectedUnset;
+        for (uint64_t i = 0; i < bytes.size(); ++i) {
+            for (int b = 0; b < 8; ++b) {
+                if (knoxcrypt::detail::isBitSetInByte(bytes[i], b)) {
+                    ++expectedCount;
+                } else {
+                    expectedUnset.push_back((i * 8) + b);
+                }
+            }
+        }
+
+        ASSERT_EQUAL(expectedCount, knoxcrypt::detail::countSetBits(bytes.data(), bytes.size()),
+                     "VolumeBitMapTest::testScanKernelsMatchByteLoops count");
+        std::vector<uint64_t> unset;
+        uint64_t bit = knoxcrypt::detail::findFirstUnsetBit(bytes.data(), bytes.size());
+        while (bit != knoxcrypt::detail::NO_BIT) {
+            unset.push_back(bit);
+            bit = knoxcrypt::detail::findFirstUnsetBit(bytes.data(), bytes.size(), bit + 1);
+        }
+        ASSERT_EQUAL(true, unset == expectedUnset, "VolumeBitMapTest::testScanKernelsMatchByteLoops unset bits");
+        ASSERT_EQUAL(324u, knoxcrypt::detail::findFirstUnsetRun(bytes.data(), bytes.size(), 20),
+                     "VolumeBitMapTest::testScanKernelsMatchByteLoops run");
+        ASSERT_EQUAL(knoxcrypt::detail::NO_BIT, knoxcrypt::detail::findFirstUnsetRun(bytes.data(), bytes.size(), 21),
+                     "VolumeBitMapTest::testScanKernelsMatchByteLoops no run");
+    }
+
+    void testRangeAndBatchQueries()
+    {
+        boost::filesystem::path testPath = buildImage(m_uniquePath);
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+
+        knoxcrypt::VolumeBitMap bitMap;
+        bitMap.setBlocksInUse(io, {10, 11, 12, 13, 14, 15, 16, 17, 18, 300});
+        ASSERT_EQUAL(true, bitMap.isRangeInUse(io, 10, 9), "VolumeBitMapTest::testRangeAndBatchQueries range in use");
+        ASSERT_EQUAL(false, bitMap.isRangeInUse(io, 10, 10), "VolumeBitMapTest::testRangeAndBatchQueries range partly in use");
+        ASSERT_EQUAL(true, bitMap.isRangeFree(io, 19, 281), "VolumeBitMapTest::testRangeAndBatchQueries range free");
+        ASSERT_EQUAL(false, bitMap.isRangeFree(io, 19, 282), "VolumeBitMapTest::testRangeAndBatchQueries range partly free");
+
+        std::vector<bool> expected{true, false, true, false, true};
+        std::vector<uint64_t> blocks{300, 301, 10, 2047, 0};
+        ASSERT_EQUAL(true, bitMap.areBlocksInUse(io, blocks) == expected,
+                     "VolumeBitMapTest::testRangeAndBatchQueries batch in memory");
+        knoxcrypt::ContainerImageStream in(io, std::ios::in | std::ios::binary);
+        ASSERT_EQUAL(true, knoxcrypt::detail::areBlocksInUse(blocks, in) == expected,
+                     "VolumeBitMapTest::testRangeAndBatchQueries batch on disk");
+    }
+
+    void testSummarySkipsFullGroups()
+    {
+        // three and a half groups; the default test image is only half of one
+        uint64_t const blocks = (3 * knoxcrypt::VolumeBitMap::GROUP_BLOCKS) + 2048;
+        boost::filesystem::path testPath = m_uniquePath / boost::filesystem::unique_path();
+        {
+            knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+            io->blocks = blocks;
+            io->freeBlocks = blocks;
+            knoxcrypt::MakeKnoxCrypt(io, true).buildImage();
+        }
+        knoxcrypt::SharedCoreIO io(createTestIO(testPath));
+        io->blocks = blocks;
+        io->useBlockCache = true;
+
+        // fill the first two groups apart from block 5000
+        std::vector<uint64_t> toSet;
+        for (uint64_t b = 1; b < 2 * knoxcrypt::VolumeBitMap::GROUP_BLOCKS; ++b) {
+            if (b != 5000) {
+                toSet.push_back(b);
+            }
+        }
+        knoxcrypt::VolumeBitMap bitMap;
+        bitMap.setBlocksInUse(io, toSet);
+        ASSERT_EQUAL(0u, bitMap.getFreeBlocksInGroup(io, 0), "VolumeBitMapTest::testSummarySkipsFullGroups group 0");
+        ASSERT_EQUAL(1u, bitMap.getFreeBlocksInGroup(io, 1), "VolumeBitMapTest::testSummarySkipsFullGroups group 1");
+        ASSERT_EQUAL(4096u, bitMap.getFreeBlocksInGroup(io, 2), "VolumeBitMapTest::testSummarySkipsFullGroups group 2");
+        ASSERT_EQUAL(2048u, bitMap.getFreeBlocksInGroup(io, 3), "VolumeBitMapTest::testSummarySkipsFullGroups short group");
+        ASSERT_EQUAL(5000u, *bitMap.getNextAvailableBlock(io), "VolumeBitMapTest::testSummarySkipsFullGroups next in group 1");
+
+        bitMap.setBlockInUse(io, 5000);
+        ASSERT_EQUAL(8192u, *bitMap.getNextAvailableBlock(io), "VolumeBitMapTest::testSummarySkipsFullGroups next in group 2");
+        ASSERT_EQUAL(8192u, bitMap.getNumberOfAllocatedBlocks(io), "VolumeBitMapTest::testSummarySkipsFullGroups allocated");
+
+        bitMap.setBlockInUse(io, 10, false);
+        ASSERT_EQUAL(10u, *bitMap.getNextAvailableBlock(io), "VolumeBitMapTest::testSummarySkipsFullGroups freed");
+        std::vector<knoxcrypt::VolumeBitMap::Extent> expected{{10, 1}, {8192, blocks - 8192}};
+        ASSERT_EQUAL(true, bitMap.getFreeExtents(io) == expected, "VolumeBitMapTest::testSummarySkipsFullGroups extents");
+        bitMap.sync();
+
+        // a summary built from the image matches the one built up by updates
+        knoxcrypt::SharedCoreIO otherIo(createTestIO(testPath));
+        otherIo->blocks = blocks;
+        knoxcrypt::VolumeBitMap otherBitMap;
+        ASSERT_EQUAL(8191u, otherBitMap.getNumberOfAllocatedBlocks(otherIo), "VolumeBitMapTest::testSummarySkipsFullGroups reloaded allocated");
+        ASSERT_EQUAL(1u, otherBitMap.getFreeBlocksInGroup(otherIo, 0), "VolumeBitMapTest::testSummarySkipsFullGroups reloaded group 0");
+        ASSERT_EQUAL(4096u, otherBitMap.getFreeBlocksInGroup(otherIo, 2), "VolumeBitMapTest::testSummarySkipsFullGroups reloaded group 2");
+    }
+
+};
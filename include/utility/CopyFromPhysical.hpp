@@ -31,12 +31,14 @@
 #pragma once
 
 #include "knoxcrypt/CoreFS.hpp"
+#include "utility/PipelinedCopy.hpp"
 #include "utility/RecursiveFolderAdder.hpp"
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
-#include <boost/iostreams/copy.hpp>
+#include <fstream>
 #include <functional>
+#include <sstream>
 
 namespace knoxcrypt
 {
@@ -73,7 +75,7 @@ namespace knoxcrypt
                 // create a stream to read resource from and a device to write to
                 std::ifstream in(fsPath.c_str(), std::ios_base::binary);
                 knoxcrypt::FileDevice device = theBfs.openFile(addPath, knoxcrypt::OpenDisposition::buildWriteOnlyDisposition());
-                boost::iostreams::copy(in, device);
+                copyToContainer(in, device, boost::filesystem::file_size(p));
             }
         }
     }
@@ -34,10 +34,10 @@
 #include "utility/ContentFolderVisitor.hpp"
 #include "utility/RecursiveFolderExtractor.hpp"
 #include "utility/FolderExtractionVisitor.hpp"
+#include "utility/PipelinedCopy.hpp"
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
-#include <boost/iostreams/copy.hpp>
 
 #include <fstream>
 #include <sstream>
@@ -78,9 +78,8 @@ namespace knoxcrypt
                 ss << "Extracting file "<<dstPath<<"...";
                 callback(dstPath);
                 knoxcrypt::FileDevice device = theBfs.openFile(srcPath, knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
-                device.seek(0, std::ios_base::beg);
                 std::ofstream out(dstPath.c_str(), std::ios_base::binary);
-                boost::iostreams::copy(device, out);
+                copyFromContainer(device, out);
             } else if(theBfs.folderExists(srcPath)) {
                 boost::filesystem::create_directory(dstPath);
                 FolderExtractionVisitor visitor(theBfs, srcPath, dstPath, callback);
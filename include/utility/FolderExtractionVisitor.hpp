@@ -34,12 +34,13 @@
 #include "knoxcrypt/CoreFS.hpp"
 #include "knoxcrypt/FileDevice.hpp"
 #include "utility/ContentFolderVisitor.hpp"
+#include "utility/PipelinedCopy.hpp"
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
-#include <boost/iostreams/copy.hpp>
 #include <functional>
 
+#include <fstream>
 #include <sstream>
 
 namespace knoxcrypt
@@ -91,9 +92,8 @@ namespace knoxcrypt
                 ss << "Extracting file "<<fsLoc<<"...";
                 m_callback(ss.str());
                 knoxcrypt::FileDevice device = m_theBfs.openFile(teaLoc.string(), knoxcrypt::OpenDisposition::buildReadOnlyDisposition());
-                device.seek(0, std::ios_base::beg);
                 std::ofstream out(fsLoc.string().c_str(), std::ios_base::binary);
-                boost::iostreams::copy(device, out);
+                copyFromContainer(device, out);
             }
 
             virtual void exitFolder(EntryInfo const &)
@@ -148,10 +148,12 @@ namespace knoxcrypt
          *
          * The first 8 bytes will represent the number of blocks in the FS
          * The next blocks bits will represent the volume bit map
-         * The next 8 bytes will represent the total number of files
+         * The next 8 bytes will represent the allocation state (clean unmount
+         * flag and number of allocated blocks; see detail::writeAllocationState)
          * The next data will be metadata computed as a fraction of the fs
          * size and number of blocks
-         * The remaining bytes will be reserved for actual file data 512 byte blocks
+         * The remaining bytes will be reserved for actual file data blocks
+         * of io->blockSize bytes
          *
          * @param imageName the name of the image
          * @param blocks the number of blocks in the file system
@@ -221,10 +223,18 @@ namespace knoxcrypt
                     cipher = 0;
                 }
 
-                for(int i = 0; i < 7; ++i) {
+                for(int i = 0; i < 5; ++i) {
                     (void)ivout.write((char*)&cipher, 1);
                 }
 
+                // the block size is recorded in place of the last cipher byte
+                uint8_t const blockSize = detail::buildBlockSizeByte(io);
+                (void)ivout.write((char*)&blockSize, 1);
+
+                // the last header byte records the format features used
+                uint8_t const features = detail::buildFeaturesByte(io);
+                (void)ivout.write((char*)&features, 1);
+
                 ivout.flush();
                 ivout.close();
             }
@@ -250,7 +260,7 @@ namespace knoxcrypt
             out.write((char*)sizeBytes, 8);
             createVolumeBitMap(io->blocks, out);
 
-            // file count will always be 0 upon initialization
+            // allocation state is written properly once the root folder exists
             uint64_t fileCount(0);
             uint8_t countBytes[8];
             buildFileCountBytes(fileCount, countBytes);
@@ -284,6 +294,14 @@ namespace knoxcrypt
                 CompoundFolder magicDir(magicIo, "root", setRoot);
             }
 
+            // a freshly built image counts as cleanly unmounted so that its
+            // first mount needn't count the allocated blocks
+            {
+                ContainerImageStream stateOut(io, std::ios::in | std::ios::out | std::ios::binary);
+                detail::writeAllocationState(stateOut, io->blocks, io->blocks - io->freeBlocks, true);
+                stateOut.close();
+            }
+
             broadcastEvent(EventType::ImageBuildEnd);
         }
     };
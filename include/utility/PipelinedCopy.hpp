@@ -0,0 +1,129 @@
+/*
+  Copyright (c) <2014-2015>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/// Copies between a container file and a physical stream, reading ahead on
+/// an IOQueue worker whilst what was already read is written
+
+#pragma once
+
+#include "knoxcrypt/FileDevice.hpp"
+#include "knoxcrypt/IOQueue.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace knoxcrypt
+{
+
+    namespace utility
+    {
+
+        // bytes read per transfer and transfers kept in flight
+        std::streamsize const COPY_CHUNK_BYTES = 256 * 1024;
+        size_t const COPY_DEPTH = 4;
+
+        /**
+         * @brief copies until read gives back less than a whole chunk. Each
+         * read runs on the queue's worker and is written by the calling
+         * thread once done, so the two sides are only ever used from one
+         * thread each
+         * @param read fills a buffer, returning the bytes read
+         * @param write writes out what was read
+         * @param bytes how much is expected, so that something no bigger
+         * than a chunk is copied without a worker
+         */
+        inline
+        void pipelinedCopy(std::function<std::streamsize(char*, std::streamsize)> const &read,
+                           std::function<void(char const*, std::streamsize)> const &write,
+                           std::streamsize const bytes)
+        {
+            size_t const depth = bytes > COPY_CHUNK_BYTES ? COPY_DEPTH : 0;
+            std::vector<std::vector<char>> buffers(std::max(depth, size_t(1)));
+            bool ended = false;
+            IOQueue queue(depth);
+            for (size_t chunk = 0; !ended; ++chunk) {
+
+                // completing the transfer depth back is what makes room in
+                // the queue, so its buffer is free again
+                auto &buffer = buffers[chunk % buffers.size()];
+                buffer.resize(COPY_CHUNK_BYTES);
+                queue.submit([&read, &buffer] {
+                    return read(&buffer.front(), COPY_CHUNK_BYTES);
+                }, [&write, &buffer, &ended](std::streamsize const n) {
+                    if (ended) {
+                        return;
+                    }
+                    if (n > 0) {
+                        write(&buffer.front(), n);
+                    }
+                    ended = n < COPY_CHUNK_BYTES;
+                });
+            }
+            queue.wait();
+        }
+
+        /**
+         * @brief copies a physical stream in to a container file
+         * @param in the stream to copy from
+         * @param device the file to copy to; it is flushed at the end
+         * @param bytes the size of what is being copied, if known
+         */
+        inline
+        void copyToContainer(std::istream &in, FileDevice &device, std::streamsize const bytes)
+        {
+            pipelinedCopy([&in](char *buf, std::streamsize const n) {
+                (void)in.read(buf, n);
+                return in.gcount();
+            }, [&device](char const *buf, std::streamsize const n) {
+                (void)device.write(buf, n);
+            }, bytes);
+            device.close();
+        }
+
+        /**
+         * @brief copies a container file out to a physical stream
+         * @param device the file to copy from, read from its start
+         * @param out the stream to copy to
+         */
+        inline
+        void copyFromContainer(FileDevice &device, std::ostream &out)
+        {
+            std::streamsize const bytes = device.seek(0, std::ios_base::end);
+            (void)device.seek(0, std::ios_base::beg);
+            pipelinedCopy([&device](char *buf, std::streamsize const n) {
+                return device.read(buf, n);
+            }, [&out](char const *buf, std::streamsize const n) {
+                (void)out.write(buf, n);
+            }, bytes);
+            (void)out.flush();
+        }
+    }
+}
@@ -32,10 +32,10 @@
 
 #include "knoxcrypt/CoreFS.hpp"
 #include "knoxcrypt/EntryType.hpp"
+#include "utility/PipelinedCopy.hpp"
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
-#include <boost/iostreams/copy.hpp>
 
 #include <fstream>
 #include <sstream>
@@ -74,7 +74,7 @@ namespace knoxcrypt
                     theBfs.addFile(tp.string());
                     knoxcrypt::FileDevice device = theBfs.openFile(tp.string(), knoxcrypt::OpenDisposition::buildWriteOnlyDisposition());
                     std::ifstream in(fs.string().c_str(), std::ios_base::binary);
-                    boost::iostreams::copy(in, device);
+                    copyToContainer(in, device, boost::filesystem::file_size(fs));
                 }
             }
         }
@@ -0,0 +1,80 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bench/AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // the replacement operators below are used throughout the bench binary
+    // and from every thread, hence the atomics
+    std::atomic<int> g_counters(0);
+    std::atomic<uint64_t> g_allocations(0);
+}
+
+void *operator new(std::size_t const bytes)
+{
+    if (g_counters.load(std::memory_order_relaxed) > 0) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void * const p = std::malloc(bytes ? bytes : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * const p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * const p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+AllocationCounter::AllocationCounter()
+    : m_start(0)
+{
+    g_counters.fetch_add(1);
+    m_start = g_allocations.load();
+}
+
+AllocationCounter::~AllocationCounter()
+{
+    g_counters.fetch_sub(1);
+}
+
+uint64_t
+AllocationCounter::count() const
+{
+    return g_allocations.load() - m_start;
+}
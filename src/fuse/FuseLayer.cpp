@@ -37,6 +37,7 @@
 #include "knoxcrypt/FileBlockBuilder.hpp"
 #include "knoxcrypt/CoreFS.hpp"
 #include "knoxcrypt/KnoxCryptException.hpp"
+#include "knoxcrypt/MappedImage.hpp"
 #include "utility/CipherCallback.hpp"
 #include "utility/EcholessPasswordPrompt.hpp"
 #include "utility/EventType.hpp"
@@ -92,13 +93,14 @@ namespace fuselayer
                     if (info.type() == knoxcrypt::EntryType::FolderType) {
                         stbuf->st_mode = S_IFDIR | 0777;
                         stbuf->st_nlink = 3;
-                        stbuf->st_blksize = knoxcrypt::detail::FILE_BLOCK_SIZE - knoxcrypt::detail::FILE_BLOCK_META;
+                        stbuf->st_blksize = knoxcrypt_DATA->blockSize() - knoxcrypt::detail::FILE_BLOCK_META;
                         return 0;
                     } else if (info.type() == knoxcrypt::EntryType::FileType) {
                         stbuf->st_mode = S_IFREG | 0777;
                         stbuf->st_nlink = 1;
                         stbuf->st_size = info.size();
-                        stbuf->st_blksize = knoxcrypt::detail::FILE_BLOCK_SIZE - knoxcrypt::detail::FILE_BLOCK_META;
+                        stbuf->st_blocks = info.blockCount() * knoxcrypt_DATA->blockSize() / 512;
+                        stbuf->st_blksize = knoxcrypt_DATA->blockSize() - knoxcrypt::detail::FILE_BLOCK_META;
                         return 0;
                     } else {
                         return -ENOENT;
@@ -259,6 +261,15 @@ namespace fuselayer
             return knoxcrypt_DATA;
         }
 
+        // called on unmount; make sure the in-memory volume bitmap
+        // is written back to the image and the unmount recorded as clean
+        static
+        void
+        knoxcrypt_destroy(void *)
+        {
+            knoxcrypt_DATA->unmount();
+        }
+
         // create file; comment for git test
         static
         int
@@ -314,6 +325,7 @@ namespace fuselayer
                         stbuf.st_mode = S_IFREG | 0755;
                         stbuf.st_nlink = 1;
                         stbuf.st_size = it.second->size();
+                        stbuf.st_blocks = it.second->blockCount() * knoxcrypt_DATA->blockSize() / 512;
                     } else {
                         stbuf.st_mode = S_IFDIR | 0744;
                         stbuf.st_nlink = 3;
@@ -363,15 +375,60 @@ namespace fuselayer
             return 0;
         }
 
-        // to shut-up 'function not implemented warnings'
-        // not presently required
+        // called on each close; writes are otherwise left buffered in the
+        // open file, which records the file's size when flushed
         static
         int
-        knoxcrypt_flush(const char *, struct fuse_file_info *)
+        knoxcrypt_flush(const char *path, struct fuse_file_info *)
         {
+            try {
+                knoxcrypt_DATA->flushFile(path);
+            } catch (knoxcrypt::KnoxCryptException const &e) {
+                return detail::exceptionDispatch(e);
+            }
             return 0;
         }
 
+        // called once the last descriptor of a file is closed
+        static
+        int
+        knoxcrypt_release(const char *path, struct fuse_file_info *fi)
+        {
+            return knoxcrypt_flush(path, fi);
+        }
+
+        // image writes are buffered until synced
+        static
+        int
+        knoxcrypt_fsync(const char *, int, struct fuse_file_info *)
+        {
+            try {
+                knoxcrypt_DATA->sync();
+            } catch (knoxcrypt::KnoxCryptException const &e) {
+                return detail::exceptionDispatch(e);
+            }
+            return 0;
+        }
+
+#if FUSE_MAJOR_VERSION > 3 || (FUSE_MAJOR_VERSION == 3 && FUSE_MINOR_VERSION >= 8)
+        // only called for SEEK_DATA and SEEK_HOLE; unwritten parts of a
+        // sparse file take up no blocks in the container
+        static
+        off_t
+        knoxcrypt_lseek(const char *path, off_t offset, int whence, struct fuse_file_info *)
+        {
+            try {
+                auto const found = knoxcrypt_DATA->findDataOrHole(path, offset, whence == SEEK_HOLE);
+                if (found < 0) {
+                    return -ENXIO;
+                }
+                return found;
+            } catch (knoxcrypt::KnoxCryptException const &e) {
+                return detail::exceptionDispatch(e);
+            }
+        }
+#endif
+
         // to shut-up 'function not implemented warnings'
         // not presently required
         static
@@ -422,12 +479,18 @@ void initOperations(struct fuse_operations &ops, fuselayer::FuseLayer &fuseLayer
     ops.ftruncate = fuseLayer.knoxcrypt_ftruncate;
     ops.opendir   = fuseLayer.knoxcrypt_opendir;
     ops.init      = fuseLayer.knoxcrypt_init;
+    ops.destroy   = fuseLayer.knoxcrypt_destroy;
     ops.readdir   = fuseLayer.knoxcrypt_readdir;
     ops.getattr   = fuseLayer.knoxcrypt_getattr;
     ops.rename    = fuseLayer.knoxcrypt_rename;
     ops.statfs    = fuseLayer.knoxcrypt_statfs;
     ops.setxattr  = fuseLayer.knoxcrypt_setxattr;
     ops.flush     = fuseLayer.knoxcrypt_flush;
+    ops.release   = fuseLayer.knoxcrypt_release;
+    ops.fsync     = fuseLayer.knoxcrypt_fsync;
+#if FUSE_MAJOR_VERSION > 3 || (FUSE_MAJOR_VERSION == 3 && FUSE_MINOR_VERSION >= 8)
+    ops.lseek     = fuseLayer.knoxcrypt_lseek;
+#endif
     ops.chmod     = fuseLayer.knoxcrypt_chmod;
     ops.chown     = fuseLayer.knoxcrypt_chown;
     ops.utimens   = fuseLayer.knoxcrypt_utimens;
@@ -440,6 +503,9 @@ int main(int argc, char *argv[])
     // parse the program options
     bool debug = true;
     bool magic = false;
+    bool mapImage = false;
+    uint64_t mapImageBytes = 4 * 1024 * 1024;
+    bool dropImageCache = false;
     namespace po = boost::program_options;
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -448,6 +514,9 @@ int main(int argc, char *argv[])
         ("mountPoint", po::value<std::string>(), "mountPoint path")
         ("debug", po::value<bool>(&debug)->default_value(true), "fuse debug")
         ("coffee", po::value<bool>(&magic)->default_value(false), "mount alternative sub-volume")
+        ("mapImage", po::value<bool>(&mapImage)->default_value(false), "keep recently used decrypted pages of the image locked in memory")
+        ("mapImageBytes", po::value<uint64_t>(&mapImageBytes)->default_value(mapImageBytes), "with mapImage, the most decrypted bytes to keep")
+        ("dropImageCache", po::value<bool>(&dropImageCache)->default_value(false), "keep the image out of the page cache")
         ;
 
     po::positional_options_description positionalOptions;
@@ -482,10 +551,20 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // decrypted pages are only kept if they can't be swapped out
+    if (mapImage && !knoxcrypt::MappedImage::canLock(mapImageBytes)) {
+        std::cout<<"Could not lock "<<mapImageBytes<<" bytes in memory for mapImage; "
+                 <<"raise the locked memory limit or lower mapImageBytes"<<std::endl;
+        return 1;
+    }
+
     // Setup a core knoxcrypt io object which stores highlevel info about accessing
     // the knoxcrypt image
     knoxcrypt::SharedCoreIO io(std::make_shared<knoxcrypt::CoreIO>());
     io->useBlockCache = true;
+    io->mapImage = mapImage;
+    io->mapImageBytes = mapImageBytes;
+    io->dropImageCache = dropImageCache;
     io->path = vm["imageName"].as<std::string>().c_str();
     io->encProps.password = knoxcrypt::utility::getPassword("knoxcrypt password: ");
     io->rootBlock = magic ? atoi(knoxcrypt::utility::getPassword("magic number: ").c_str()) : 0;
@@ -514,15 +593,15 @@ int main(int argc, char *argv[])
 
     io->blocks = knoxcrypt::detail::getBlockCount(stream);
 
-    printf("Counting allocated blocks. Please wait...\n");
+    stream.close();
 
-    io->freeBlocks = io->blocks - knoxcrypt::detail::getNumberOfAllocatedBlocks(stream);
+    // a container that wasn't cleanly unmounted has its allocated blocks
+    // counted when the bitmap is first needed rather than up front
+    if (!knoxcrypt::detail::initFreeBlocksOnMount(io)) {
+        printf("Container was not cleanly unmounted; allocated blocks will be recounted.\n");
+    }
     io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
 
-    printf("Finished counting allocated blocks.\n");
-
-    stream.close();
-
     // Create the basic file system
     knoxcrypt::CoreFS theBfs(io);
 
@@ -0,0 +1,94 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/AllocationGroups.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace knoxcrypt
+{
+
+    uint64_t const AllocationGroups::GROUP_BLOCKS;
+
+    AllocationGroups::Group::Group(uint64_t const firstBlock, uint64_t const endBlock)
+        : mutex()
+        , allocator(firstBlock, endBlock)
+    {
+    }
+
+    AllocationGroups::AllocationGroups()
+        : m_groups()
+        , m_groupsCreated()
+    {
+    }
+
+    void
+    AllocationGroups::createGroups(uint64_t const blocks)
+    {
+        for (uint64_t first = 0; first < blocks; first += GROUP_BLOCKS) {
+            m_groups.emplace_back(new Group(first, std::min(first + GROUP_BLOCKS, blocks)));
+        }
+    }
+
+    uint64_t
+    AllocationGroups::getHomeGroup() const
+    {
+        return std::hash<std::thread::id>()(std::this_thread::get_id()) % m_groups.size();
+    }
+
+    AllocationGroups::OptionalBlock
+    AllocationGroups::allocate(SharedCoreIO const &io,
+                               VolumeBitMap &volumeBitMap,
+                               OptionalBlock const &goal,
+                               uint64_t const blocksExpected)
+    {
+        std::call_once(m_groupsCreated, [&]{ createGroups(io->blocks); });
+        if (m_groups.empty()) {
+            return OptionalBlock();
+        }
+
+        uint64_t const groups = m_groups.size();
+        bool const goalInVolume = goal && (*goal / GROUP_BLOCKS) < groups;
+        uint64_t const start = goalInVolume ? (*goal / GROUP_BLOCKS) : getHomeGroup();
+        for (uint64_t i = 0; i < groups; ++i) {
+            Group &group = *m_groups[(start + i) % groups];
+            GroupLock lock(group.mutex);
+
+            // the goal only means something in its own group
+            OptionalBlock const groupGoal = (i == 0 && goalInVolume) ? goal : OptionalBlock();
+            OptionalBlock const block = group.allocator.allocate(io, volumeBitMap, groupGoal, blocksExpected);
+            if (block) {
+                return block;
+            }
+        }
+        return OptionalBlock();
+    }
+
+}
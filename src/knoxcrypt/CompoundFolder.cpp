@@ -32,6 +32,7 @@
 
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 
 namespace knoxcrypt
 {
@@ -159,7 +160,7 @@ namespace knoxcrypt
                 if(index < m_contentFolders.size()) {
                     auto file = m_contentFolders[index]->getFile(name, openDisposition);
                     if(file) {
-                        return *file;
+                        return std::move(*file);
                     }
                 } else {
                     // stale cache
@@ -173,7 +174,7 @@ namespace knoxcrypt
         for(auto & f : boost::adaptors::reverse(m_contentFolders)) {
             auto file(f->getFile(name, openDisposition));
             if(file) {
-                return *file;
+                return std::move(*file);
             }
         }
         throw std::runtime_error("File not found");
@@ -388,14 +389,15 @@ namespace knoxcrypt
     void
     CompoundFolder::writeNewMetaDataForEntry(std::string const &name,
                                              EntryType const &entryType,
-                                             uint64_t startBlock)
+                                             uint64_t startBlock,
+                                             OptionalSizeRecord const &sizeRecord)
     {
         // each leaf folder can have CONTENT_SIZE entries
         bool wasAdded = false;
 
         for(auto & f : boost::adaptors::reverse(m_contentFolders)) {
             if(f->getAliveEntryCount() < CONTENT_SIZE) {
-                f->writeNewMetaDataForEntry(name, entryType, startBlock);
+                f->writeNewMetaDataForEntry(name, entryType, startBlock, sizeRecord);
                 wasAdded = true;
                 break;
             }
@@ -405,7 +407,7 @@ namespace knoxcrypt
         // another leaf folder
         if(!wasAdded) {
             doAddContentFolder();
-            m_contentFolders.back()->writeNewMetaDataForEntry(name, entryType, startBlock);
+            m_contentFolders.back()->writeNewMetaDataForEntry(name, entryType, startBlock, sizeRecord);
         }
     }
 }
@@ -29,6 +29,12 @@
 
 #include "knoxcrypt/ContainerImageStream.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <new>
+
 /// Since these are statics need to make sure they're instantiated here!
 bool cryptostreampp::IByteTransformer::m_init = false;
 uint8_t cryptostreampp::IByteTransformer::g_bigKey[32]; 
@@ -37,100 +43,380 @@ uint8_t cryptostreampp::IByteTransformer::g_bigIV[32];
 namespace knoxcrypt
 {
     ContainerImageStream::ContainerImageStream(SharedCoreIO const &io, std::ios::openmode mode)
-        : m_cryptoStream(std::make_shared<cryptostreampp::CryptoStreamPP>(io->path, 
-                                                                          io->encProps, 
-                                                                          io->firstTimeInit,
-                                                                          mode))
+        : m_handle()
+        , m_shared(io->useBlockCache &&
+                   (mode & std::ios::in) && (mode & std::ios::out) &&
+                   !(mode & (std::ios::app | std::ios::trunc)))
+        , m_buffered(io->useBlockCache && !io->writeThrough)
+        , m_mapped()
     {
+        auto shared(io->imageStream.lock());
+        if (m_shared && shared) {
+            m_handle = shared;
+            return;
+        }
+
+        // a stream of its own only sees what the shared stream has flushed
+        if (shared) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            flushHandle(*shared);
+            if (shared->map && (mode & std::ios::out)) {
+                m_mapped = shared;
+            }
+        }
+        m_handle = std::make_shared<ImageStreamHandle>(std::make_shared<cryptostreampp::CryptoStreamPP>(io->path,
+                                                                                                        io->encProps,
+                                                                                                        io->firstTimeInit,
+                                                                                                        mode),
+                                                       (mode & std::ios::app) != 0);
         io->firstTimeInit = false;
+        if (io->dropImageCache) {
+            m_handle->advisor = std::make_shared<ImageCacheAdvisor>(io->path);
+        }
+        if (m_shared) {
+            mapImage(io);
+            io->imageStream = m_handle;
+        }
+    }
+
+    void
+    ContainerImageStream::mapImage(SharedCoreIO const &io)
+    {
+        if (!io->mapImage) {
+            return;
+        }
+        struct stat st;
+        if (::stat(io->path.c_str(), &st) != 0 || st.st_size <= 0) {
+            return;
+        }
+        try {
+            m_handle->map.reset(new MappedImage(m_handle->stream, st.st_size, io->mapImageBytes, m_handle->advisor));
+        } catch (std::bad_alloc const &) {
+            // carry on with the stream alone rather than with unlocked plaintext
+            return;
+        }
+        m_handle->position = 0;
     }
 
     ContainerImageStream&
     ContainerImageStream::read(char * const buf, std::streamsize const n)
     {
-        (void)m_cryptoStream->read(buf, n);
-        return *this;
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doRead(buf, n);
     }
 
     ContainerImageStream&
     ContainerImageStream::write(char const * buf, std::streamsize const n)
     {
-        (void)m_cryptoStream->write(buf, n);
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doWrite(buf, n);
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::doRead(char * const buf, std::streamsize const n)
+    {
+        auto const &map = m_handle->map;
+        if (map && !m_handle->stream->fail() && map->covers(m_handle->position, n)) {
+            if (!map->read(buf, n, m_handle->position)) {
+                m_handle->stream->setstate(std::ios::badbit);
+            }
+            advance(n);
+            return *this;
+        }
+        if (map) {
+            bypassMap(n);
+        }
+        std::streamoff const offset = m_handle->position;
+        (void)m_handle->stream->read(buf, n);
+        advance(n);
+        if (m_handle->advisor) {
+            m_handle->advisor->read(offset, n);
+        }
         return *this;
     }
 
     ContainerImageStream&
-    ContainerImageStream::seekg(std::streampos pos)
+    ContainerImageStream::doWrite(char const * buf, std::streamsize const n)
     {
-        (void)m_cryptoStream->seekg(pos);
+        auto const &map = m_handle->map;
+        if (map && !m_handle->stream->fail() && map->covers(m_handle->position, n)) {
+            if (!map->write(buf, n, m_handle->position)) {
+                m_handle->stream->setstate(std::ios::badbit);
+            }
+            advance(n);
+            return *this;
+        }
+        if (map) {
+            bypassMap(n);
+        }
+        std::streamoff const offset = m_handle->position;
+        (void)m_handle->stream->write(buf, n);
+        advance(n);
+
+        // the shared stream's map has to see the write when next used
+        if (auto mapped = m_mapped.lock()) {
+            m_handle->stream->flush();
+            std::lock_guard<std::mutex> lock(mapped->mutex);
+            if (offset >= 0) {
+                mapped->map->forget(offset, n);
+            } else {
+                mapped->map->forget();
+            }
+        }
         return *this;
     }
+
+    void
+    ContainerImageStream::bypassMap(std::streamsize const n)
+    {
+        if (m_handle->position >= 0) {
+            m_handle->map->forget(m_handle->position, n);
+            (void)m_handle->stream->seekg(m_handle->position);
+        }
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::readAt(char * const buf, std::streamsize const n, std::streamoff const offset)
+    {
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        if (m_handle->position != offset) {
+            (void)doSeekg(offset);
+        }
+        return doRead(buf, n);
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::writeAt(char const * buf, std::streamsize const n, std::streamoff const offset)
+    {
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        if (m_handle->position != offset) {
+            (void)doSeekp(offset);
+        }
+        return doWrite(buf, n);
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::seekg(std::streampos pos)
+    {
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doSeekg(pos);
+    }
+
     ContainerImageStream&
     ContainerImageStream::seekg(std::streamoff off, std::ios_base::seekdir way)
     {
-        (void)m_cryptoStream->seekg(off, way);
-        return *this;
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doSeekg(off, way);
     }
 
     ContainerImageStream&
     ContainerImageStream::seekp(std::streampos pos)
     {
-        (void)m_cryptoStream->seekp(pos);
-        return *this;
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doSeekp(pos);
     }
 
     ContainerImageStream&
     ContainerImageStream::seekp(std::streamoff off, std::ios_base::seekdir way)
     {
-        (void)m_cryptoStream->seekp(off, way);
-        return *this;
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doSeekp(off, way);
     }
 
+    // a file stream has the one position for reading and writing
     std::streampos
     ContainerImageStream::tellg()
     {
-        return m_cryptoStream->tellg();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return doTellg();
     }
     std::streampos
     ContainerImageStream::tellp()
     {
-        return m_cryptoStream->tellp();
+        return tellg();
+    }
+
+    std::streampos
+    ContainerImageStream::size()
+    {
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        (void)doSeekg(0, std::ios_base::end);
+        return doTellg();
+    }
+
+    // with a map the stream is only put in place when actually used
+    ContainerImageStream&
+    ContainerImageStream::doSeekg(std::streampos pos)
+    {
+        if (!m_handle->map) {
+            (void)m_handle->stream->seekg(pos);
+        }
+        seeked(pos);
+        return *this;
+    }
+    ContainerImageStream&
+    ContainerImageStream::doSeekg(std::streamoff off, std::ios_base::seekdir way)
+    {
+        if (m_handle->map && way != std::ios_base::beg) {
+            std::streamoff base = doTellg();
+            if (way == std::ios_base::end) {
+                (void)m_handle->stream->seekg(0, std::ios_base::end);
+                base = m_handle->stream->tellg();
+            }
+            if (base < 0) {
+                m_handle->position = -1;
+                return *this;
+            }
+            return doSeekg(base + off);
+        }
+        (void)m_handle->stream->seekg(off, way);
+        if (way == std::ios_base::beg) {
+            seeked(off);
+        } else {
+            m_handle->position = -1;
+        }
+        return *this;
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::doSeekp(std::streampos pos)
+    {
+        if (!m_handle->map) {
+            (void)m_handle->stream->seekp(pos);
+        }
+        seeked(pos);
+        return *this;
+    }
+
+    ContainerImageStream&
+    ContainerImageStream::doSeekp(std::streamoff off, std::ios_base::seekdir way)
+    {
+        if (m_handle->map) {
+            return doSeekg(off, way);
+        }
+        (void)m_handle->stream->seekp(off, way);
+        if (way == std::ios_base::beg) {
+            seeked(off);
+        } else {
+            m_handle->position = -1;
+        }
+        return *this;
+    }
+
+    std::streampos
+    ContainerImageStream::doTellg()
+    {
+        if (m_handle->position < 0) {
+            m_handle->position = m_handle->stream->tellg();
+        }
+        return m_handle->position;
+    }
+
+    void
+    ContainerImageStream::advance(std::streamsize const n)
+    {
+        if (m_handle->position < 0 || m_handle->stream->fail() || m_handle->appending) {
+            m_handle->position = -1;
+        } else {
+            m_handle->position += n;
+        }
+    }
+
+    void
+    ContainerImageStream::seeked(std::streamoff const offset)
+    {
+        m_handle->position = m_handle->stream->fail() ? -1 : offset;
     }
 
     void
     ContainerImageStream::close()
     {
-        m_cryptoStream->close();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        if (m_shared) {
+            flushHandle(*m_handle);
+            return;
+        }
+        m_handle->stream->close();
+        m_handle->position = -1;
     }
 
     void
     ContainerImageStream::flush()
     {
-        m_cryptoStream->flush();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        flushHandle(*m_handle);
+    }
+
+    void
+    ContainerImageStream::flushUnlessBuffered()
+    {
+        if (!m_buffered) {
+            std::lock_guard<std::mutex> lock(m_handle->mutex);
+            flushHandle(*m_handle);
+        }
     }
 
     bool
     ContainerImageStream::is_open() const
     {
-        return m_cryptoStream->is_open();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return m_handle->stream->is_open();
     }
 
     void
     ContainerImageStream::open(SharedCoreIO const &io,
                              std::ios::openmode mode)
     {
-        m_cryptoStream->open(io->path, mode);
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        if (m_shared && m_handle->stream->is_open()) {
+            return;
+        }
+        m_handle->stream->open(io->path, mode);
+        m_handle->position = -1;
+        m_handle->appending = (mode & std::ios::app) != 0;
+    }
+
+    void
+    ContainerImageStream::sync(SharedCoreIO const &io)
+    {
+        if (auto shared = io->imageStream.lock()) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            flushHandle(*shared);
+        }
+
+        // syncing any descriptor of the image writes out all of its data
+        int const fd = ::open(io->path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            (void)::fsync(fd);
+            (void)::close(fd);
+        }
+
+        // what was written can only be dropped now it is on the disk
+        if (io->dropImageCache) {
+            ImageCacheAdvisor::drop(io->path);
+        }
+    }
+
+    void
+    ContainerImageStream::flushHandle(ImageStreamHandle &handle)
+    {
+        if (handle.map) {
+            (void)handle.map->flush();
+        }
+        (void)handle.stream->flush();
     }
 
     bool
     ContainerImageStream::bad() const
     {
-        return m_cryptoStream->bad();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        return m_handle->stream->bad();
     }
 
     void
     ContainerImageStream::clear()
     {
-        m_cryptoStream->clear();
+        std::lock_guard<std::mutex> lock(m_handle->mutex);
+        m_handle->stream->clear();
     }
 }
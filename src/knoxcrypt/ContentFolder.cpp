@@ -29,6 +29,7 @@
 #include "knoxcrypt/CompoundFolder.hpp"
 #include "knoxcrypt/ContainerImageStream.hpp"
 #include "knoxcrypt/ContentFolder.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
 #include "knoxcrypt/detail/Detailknoxcrypt.hpp"
 #include "knoxcrypt/detail/DetailFolder.hpp"
 
@@ -36,17 +37,43 @@
 #include <iterator>
 #include <functional>
 #include <stdexcept>
+#include <utility>
 
 namespace knoxcrypt
 {
 
     namespace {
+
+        /// bit of the first metadata byte indicating a recorded file size
+        /// and block count
+        uint8_t const SIZE_RECORDED_BIT = 2;
+
+        /// bit of the first metadata byte indicating that the tail block
+        /// is recorded along with the size
+        uint8_t const TAIL_RECORDED_BIT = 3;
+
+        /// a size record is stored in the final bytes of the filename field
+        /// as the tail block, the size and the block count. Entries written
+        /// before tail blocks were recorded only have the last two
+        uint32_t const SIZE_RECORD_BYTES = 24;
+
+        /**
+         * @brief gets the layout of the image's file entries; the data of a
+         * folder itself is always chained
+         * @param io the core knoxcrypt io
+         * @return the file layout
+         */
+        FileLayout fileEntryLayout(SharedCoreIO const &io)
+        {
+            return io->indexedFiles ? FileLayout::Indexed : FileLayout::Chained;
+        }
+
         /**
          * @brief put a metadata section out of use by unsetting the first bit
          * @param folderData the data that stores the folder metadata
          * @param n the metadata chunk to put out of use
          */
-        void metaDataToOutOfUse(File folderData, int n)
+        void metaDataToOutOfUse(File &folderData, int n)
         {
             uint32_t bufferSize = 1 + detail::MAX_FILENAME_LENGTH + 8;
             uint32_t seekTo = (8 + (n * bufferSize));
@@ -68,7 +95,7 @@ namespace knoxcrypt
          * @param seekOff the seek offset
          * @return the read meta data
          */
-        std::vector<uint8_t> doSeekAndReadOfEntryMetaData(File folderData,
+        std::vector<uint8_t> doSeekAndReadOfEntryMetaData(File &folderData,
                                                           int n,
                                                           uint32_t bufSize = 0,
                                                           uint64_t seekOff = 0)
@@ -97,6 +124,71 @@ namespace knoxcrypt
             return filename;
         }
 
+        /**
+         * @brief determines if there is room after a filename and its null
+         * byte for recording the size and block count of a file
+         * @param name the entry name
+         * @return true if the size can be recorded
+         */
+        bool sizeFitsAfterName(std::string const &name)
+        {
+            return name.length() + 1 + SIZE_RECORD_BYTES <= detail::MAX_FILENAME_LENGTH;
+        }
+
+        /**
+         * @brief writes a file's size record in to the end of a filename vector
+         * @param filename as built by createFileNameVector
+         * @param sizeRecord the size, block count and tail block of the file
+         */
+        void writeSizeRecord(std::vector<uint8_t> &filename,
+                             FileSizeRecord const &sizeRecord)
+        {
+            auto tail = &filename.front() + detail::MAX_FILENAME_LENGTH - SIZE_RECORD_BYTES;
+            detail::convertUInt64ToInt8Array(sizeRecord.tailBlock, tail);
+            detail::convertUInt64ToInt8Array(sizeRecord.fileSize, tail + 8);
+            detail::convertUInt64ToInt8Array(sizeRecord.blockCount, tail + 16);
+        }
+
+        /**
+         * @brief determines if the size of a file entry has been recorded
+         * in its metadata. Images written before sizes were recorded
+         * will never have the bit set
+         * @param metaData the metadata
+         * @return true if a size and block count were recorded
+         */
+        bool entrySizeIsRecorded(std::vector<uint8_t> const &metaData)
+        {
+            uint8_t byte = metaData[0];
+            return detail::isBitSetInByte(byte, SIZE_RECORDED_BIT);
+        }
+
+        /**
+         * @brief determines if the tail block of a file entry has been
+         * recorded along with its size
+         * @param metaData the metadata
+         * @return true if the tail block was recorded
+         */
+        bool entryTailIsRecorded(std::vector<uint8_t> const &metaData)
+        {
+            uint8_t byte = metaData[0];
+            return detail::isBitSetInByte(byte, TAIL_RECORDED_BIT);
+        }
+
+        /**
+         * @brief reads the size record of a file entry
+         * @param metaData the metadata
+         * @return the size record; the tail block is only meaningful if
+         * entryTailIsRecorded
+         */
+        FileSizeRecord getRecordedSizeForEntry(std::vector<uint8_t> const &metaData)
+        {
+            auto tail = &metaData.front() + 1 + detail::MAX_FILENAME_LENGTH - SIZE_RECORD_BYTES;
+            std::vector<uint8_t> buffer(tail, tail + SIZE_RECORD_BYTES);
+            return FileSizeRecord{detail::convertInt8ArrayToInt64(&buffer.front() + 8),
+                                  detail::convertInt8ArrayToInt64(&buffer.front() + 16),
+                                  detail::convertInt8ArrayToInt64(&buffer.front())};
+        }
+
         /**
          * @brief determines if entry metadata is enabled. Entry metadata
          * consists of one byte, the first bit of which determines if the
@@ -157,12 +249,76 @@ namespace knoxcrypt
          * @brief retrieves the name of an entry with given index
          * @return the name
          */
-        std::string getEntryName(File const & folderData, uint64_t const n)
+        std::string getEntryName(File &folderData, uint64_t const n)
         {
             auto metaData(doSeekAndReadOfEntryMetaData(folderData, n));
             return getEntryName(metaData);
         }
 
+        /**
+         * @brief updates the size record stored in the metadata of a file
+         * entry. Called whenever a file opened from a folder is flushed,
+         * truncated or closed, so that listing a folder does not require
+         * opening each of its files and an append can start at the file's tail
+         * @param io the core knoxcrypt io
+         * @param folderData the data of the folder holding the entry, shared
+         * with the folder itself
+         * @param folderName the name of the folder holding the entry
+         * @param folderStartBlock the start block of the folder data
+         * @param info the cached info of the entry
+         * @param sizeRecord the file's new size record
+         */
+        void recordEntrySize(SharedCoreIO const &io,
+                             SharedFile const &folderData,
+                             std::string const &folderName,
+                             uint64_t const folderStartBlock,
+                             SharedEntryInfo const &info,
+                             FileSizeRecord const &sizeRecord)
+        {
+            if (info->size() == sizeRecord.fileSize &&
+                info->blockCount() == sizeRecord.blockCount &&
+                info->tailBlock() == sizeRecord.tailBlock) {
+                return;
+            }
+            info->updateSize(sizeRecord.fileSize);
+            info->updateBlockCount(sizeRecord.blockCount);
+            info->updateTailBlock(sizeRecord.tailBlock);
+            if (!sizeFitsAfterName(info->filename())) {
+                return;
+            }
+
+            // the folder data only has to be walked when first put in to
+            // overwrite mode; after that its block map seeks straight to
+            // the entry
+            if (folderData->getOpenDisposition().append() == AppendOrOverwrite::Append) {
+                *folderData = File(io, folderName, folderStartBlock,
+                                   OpenDisposition::buildOverwriteDisposition());
+            }
+            auto const n = info->folderIndex();
+            auto metaData(doSeekAndReadOfEntryMetaData(*folderData, n));
+
+            // the entry may have since been removed or its slot reused
+            if (!entryMetaDataIsEnabled(metaData) ||
+                getBlockIndexForEntry(metaData) != info->firstFileBlock()) {
+                return;
+            }
+
+            uint32_t bufferSize = 1 + detail::MAX_FILENAME_LENGTH + 8;
+            uint64_t const offset = 8 + (n * bufferSize);
+            uint8_t byte = metaData[0];
+            detail::setBitInByte(byte, SIZE_RECORDED_BIT);
+            detail::setBitInByte(byte, TAIL_RECORDED_BIT);
+            std::vector<uint8_t> filename(detail::MAX_FILENAME_LENGTH);
+            writeSizeRecord(filename, sizeRecord);
+            if (folderData->seek(offset) != -1) {
+                (void)folderData->write((char*)&byte, 1);
+                (void)folderData->seek(offset + 1 + detail::MAX_FILENAME_LENGTH - SIZE_RECORD_BYTES);
+                (void)folderData->write((char*)&filename.front() + detail::MAX_FILENAME_LENGTH - SIZE_RECORD_BYTES,
+                                        SIZE_RECORD_BYTES);
+                folderData->flush();
+            }
+        }
+
         /**
          * @brief retrieves the number of entries in folder entry
          * @note, this number will refer to the total number of
@@ -171,14 +327,14 @@ namespace knoxcrypt
          * optimization in there somewhere.
          * @return the number of folder entries
          */
-        long getNumberOfEntries(File const & folderData, uint64_t const blocks)
+        long getNumberOfEntries(File const & folderData, SharedCoreIO const &io)
         {
             auto out(folderData.getStream());
-            uint64_t const offset = detail::getOffsetOfFileBlock(folderData.getStartVolumeBlockIndex(), blocks);
-            (void)out->seekg(offset + detail::FILE_BLOCK_META);
+            uint64_t const offset = detail::getOffsetOfFileBlock(folderData.getStartVolumeBlockIndex(),
+                                                                 io->blocks, io->blockSize);
+            uint8_t buf[8];
+            (void)out->readAt((char*)buf, 8, offset + detail::FILE_BLOCK_META);
             if(!out->bad()) { // bad when not initialized, i.e., when sparse image
-                uint8_t buf[8];
-                (void)out->read((char*)buf, 8);
 
                 // there will never be a number of entries that is greater than
                 // the max capacity of a long variable
@@ -193,13 +349,13 @@ namespace knoxcrypt
                                  uint64_t const startVolumeBlock,
                                  std::string const &name)
         : m_io(io)
-        , m_folderData(io,
-                       name,
-                       startVolumeBlock,
-                       OpenDisposition::buildAppendDisposition())
+        , m_folderData(std::make_shared<File>(io,
+                                              name,
+                                              startVolumeBlock,
+                                              OpenDisposition::buildAppendDisposition()))
         , m_startVolumeBlock(startVolumeBlock)
         , m_name(name)
-        , m_entryCount(getNumberOfEntries(m_folderData, m_io->blocks))
+        , m_entryCount(getNumberOfEntries(*m_folderData, m_io))
         , m_deadEntryCount(0)
         , m_entryInfoCacheMap()
         , m_checkForEarlyMetaData(true)
@@ -212,8 +368,8 @@ namespace knoxcrypt
                                  std::string const &name,
                                  bool const enforceRootBlock)
         : m_io(io)
-        , m_folderData(m_io, name, enforceRootBlock)
-        , m_startVolumeBlock(m_folderData.getStartVolumeBlockIndex())
+        , m_folderData(std::make_shared<File>(m_io, name, enforceRootBlock))
+        , m_startVolumeBlock(m_folderData->getStartVolumeBlockIndex())
         , m_name(name)
         , m_entryCount(0)
         , m_deadEntryCount(0)
@@ -225,8 +381,8 @@ namespace knoxcrypt
         uint64_t startCount(0);
         uint8_t buf[8];
         detail::convertUInt64ToInt8Array(startCount, buf);
-        (void)m_folderData.write((char*)buf, 8);
-        m_folderData.flush();
+        (void)m_folderData->write((char*)buf, 8);
+        m_folderData->flush();
 
         countDeadEntries();
     }
@@ -234,11 +390,12 @@ namespace knoxcrypt
     std::streamsize
     ContentFolder::doWrite(char const * buf, std::streampos n)
     {
-        return m_folderData.write(buf, n);
+        return m_folderData->write(buf, n);
     }
 
     std::streamsize
-    ContentFolder::doWriteFirstByteToEntryMetaData(EntryType const &entryType)
+    ContentFolder::doWriteFirstByteToEntryMetaData(EntryType const &entryType,
+                                                   bool const sizeRecorded)
     {
         // set the first bit to indicate that this entry is in use
         uint8_t byte = 0;
@@ -247,15 +404,23 @@ namespace knoxcrypt
         // set second bit to indicate that its type file; folder will be type 0
         detail::setBitInByte(byte, 1, entryType==EntryType::FileType);
 
+        // set third and fourth bits if a size record follows the filename
+        detail::setBitInByte(byte, SIZE_RECORDED_BIT, sizeRecorded);
+        detail::setBitInByte(byte, TAIL_RECORDED_BIT, sizeRecorded);
+
         // write out first byte
         return doWrite((char*)&byte, 1);
     }
 
     std::streamsize
-    ContentFolder::doWriteFilenameToEntryMetaData(std::string const &name)
+    ContentFolder::doWriteFilenameToEntryMetaData(std::string const &name,
+                                                  OptionalSizeRecord const &sizeRecord)
     {
         // create a vector to hold filename
         auto filename(createFileNameVector(name));
+        if (sizeRecord) {
+            writeSizeRecord(filename, *sizeRecord);
+        }
 
         // write out filename
         return doWrite((char*)&filename.front(), detail::MAX_FILENAME_LENGTH);
@@ -273,33 +438,40 @@ namespace knoxcrypt
     void
     ContentFolder::writeNewMetaDataForEntry(std::string const &name,
                                             EntryType const &entryType,
-                                            uint64_t startBlock)
+                                            uint64_t startBlock,
+                                            OptionalSizeRecord const &sizeRecord)
     {
-        this->doWriteNewMetaDataForEntry(name, entryType, startBlock);
+        this->doWriteNewMetaDataForEntry(name, entryType, startBlock, sizeRecord);
     }
 
     void
     ContentFolder::doWriteNewMetaDataForEntry(std::string const &name,
                                               EntryType const &entryType,
-                                              uint64_t startBlock)
+                                              uint64_t startBlock,
+                                              OptionalSizeRecord sizeRecord)
     {
         auto overWroteOld(doFindOffsetWhereMetaDataShouldBeWritten());
 
         if (overWroteOld) {
 
-            m_folderData = File(m_io, m_name, m_startVolumeBlock,
-                                       OpenDisposition::buildOverwriteDisposition());
-            m_folderData.seek(*overWroteOld);
+            *m_folderData = File(m_io, m_name, m_startVolumeBlock,
+                                 OpenDisposition::buildOverwriteDisposition());
+            m_folderData->seek(*overWroteOld);
             --m_deadEntryCount;
         } else {
-            m_folderData.seek(0, std::ios_base::end);
+            m_folderData->seek(0, std::ios_base::end);
+        }
+
+        // file entries only keep their size record if the name leaves room
+        if (entryType != EntryType::FileType || !sizeFitsAfterName(name)) {
+            sizeRecord = boost::none;
         }
 
         // create and write first byte of filename metadata
-        (void)doWriteFirstByteToEntryMetaData(entryType);
+        (void)doWriteFirstByteToEntryMetaData(entryType, !!sizeRecord);
 
         // create and write filename
-        (void)doWriteFilenameToEntryMetaData(name);
+        (void)doWriteFilenameToEntryMetaData(name, sizeRecord);
 
         // write the first block index to the file entry metadata
         (void)doWriteFirstBlockIndexToEntryMetaData(startBlock);
@@ -307,30 +479,31 @@ namespace knoxcrypt
         // increment entry count, but only if brand new
         if (!overWroteOld) {
             ++m_entryCount;
-            detail::writeFolderEntryCount(*m_folderData.getStream(),
+            detail::writeFolderEntryCount(*m_folderData->getStream(),
                                           m_io,
-                                          m_folderData.getStartVolumeBlockIndex(),
+                                          m_folderData->getStartVolumeBlockIndex(),
                                           m_entryCount);
         }
 
         // make sure all data has been written
-        m_folderData.flush();
+        m_folderData->flush();
     }
 
     SharedImageStream
     ContentFolder::getStream() const
     {
-        return m_folderData.getStream();
+        return m_folderData->getStream();
     }
 
     void
     ContentFolder::addFile(std::string const &name)
     {
         // Create a new file entry
-        File entry(m_io, name);
+        File entry(m_io, name, false, fileEntryLayout(m_io));
 
         // write the first block index to the file entry metadata
-        this->doWriteNewMetaDataForEntry(name, EntryType::FileType, entry.getStartVolumeBlockIndex());
+        auto const startBlock = entry.getStartVolumeBlockIndex();
+        this->doWriteNewMetaDataForEntry(name, EntryType::FileType, startBlock, entry.sizeRecord());
     }
 
     void
@@ -339,7 +512,7 @@ namespace knoxcrypt
         // Create a new sub-folder entry
         auto entry(std::make_shared<ContentFolder>(m_io, name));
         // write the first block index to the file entry metadata
-        this->doWriteNewMetaDataForEntry(name, EntryType::FolderType, entry->m_folderData.getStartVolumeBlockIndex());
+        this->doWriteNewMetaDataForEntry(name, EntryType::FolderType, entry->m_folderData->getStartVolumeBlockIndex());
     }
 
     void
@@ -352,7 +525,7 @@ namespace knoxcrypt
         this->doWriteNewMetaDataForEntry(name, EntryType::FolderType, entry
                                                                       ->getCompoundFolder()
                                                                       ->m_folderData
-                                                                      .getStartVolumeBlockIndex());
+                                                                      ->getStartVolumeBlockIndex());
     }
 
     boost::optional<File>
@@ -365,11 +538,22 @@ namespace knoxcrypt
         auto info(doGetNamedEntryInfo(name));
         if (info) {
             if (info->type() == EntryType::FileType) {
-                File file(m_io, name, info->firstFileBlock(), openDisposition);
-                file.setOptionalSizeUpdateCallback(std::bind(&EntryInfo::updateSize,
+                OptionalSizeRecord sizeRecord;
+                if (info->tailBlock()) {
+                    sizeRecord = FileSizeRecord{info->size(), info->blockCount(), *info->tailBlock()};
+                }
+                File file(m_io, name, info->firstFileBlock(), openDisposition, fileEntryLayout(m_io), sizeRecord);
+                file.setOptionalSizeUpdateCallback(std::bind(&recordEntrySize,
+                                                             m_io,
+                                                             m_folderData,
+                                                             m_name,
+                                                             m_startVolumeBlock,
                                                              info,
                                                              std::placeholders::_1));
-                return file;
+
+                // opening may already have changed the file, e.g. by truncating it
+                recordEntrySize(m_io, m_folderData, m_name, m_startVolumeBlock, info, file.sizeRecord());
+                return boost::optional<File>(std::move(file));
             }
         }
         return boost::optional<File>();
@@ -414,7 +598,7 @@ namespace knoxcrypt
         for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
 
             // read all metadata
-            auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+            auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
             if (!entryMetaDataIsEnabled(metaData)) {
                 ++m_deadEntryCount;
             }
@@ -428,7 +612,7 @@ namespace knoxcrypt
         for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
 
             // read all metadata
-            auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+            auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
             if (entryMetaDataIsEnabled(metaData)) {
                 (void)doGetEntryInfo(metaData, entryIndex);
             }
@@ -442,7 +626,7 @@ namespace knoxcrypt
         std::vector<SharedEntryInfo> entries;
         for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
             // only push back if the metadata is enabled
-            auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+            auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
 
             if (entryMetaDataIsEnabled(metaData) &&
                 getTypeForEntry(metaData) == entryType) {
@@ -509,20 +693,26 @@ namespace knoxcrypt
         uint32_t bufferSize = 1 + detail::MAX_FILENAME_LENGTH + 8;
         std::ios_base::streamoff offset = (8 + (index * bufferSize));
 
-        // normally here we'd write the first byte to the metadata
-        // before writing filename, but since we don't do this, we
-        // need to seek forward by one byte
-        ++offset;
+        // a size record is carried over if the new name leaves room for it
+        auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, index));
+        OptionalSizeRecord sizeRecord;
+        if (entryTailIsRecorded(metaData) && sizeFitsAfterName(dstName)) {
+            sizeRecord = getRecordedSizeForEntry(metaData);
+        }
 
         // make sure we're in 'overwrite mode'
-        m_folderData = File(m_io, m_name, m_startVolumeBlock,
-                            OpenDisposition::buildOverwriteDisposition());
+        *m_folderData = File(m_io, m_name, m_startVolumeBlock,
+                             OpenDisposition::buildOverwriteDisposition());
 
         // seek to correct location
-        m_folderData.seek(offset);
+        m_folderData->seek(offset);
+
+        // rewrite the first byte since the size bit may have changed
+        (void)doWriteFirstByteToEntryMetaData(getTypeForEntry(metaData), !!sizeRecord);
 
         // finally write filename
-        doWriteFilenameToEntryMetaData(dstName);
+        doWriteFilenameToEntryMetaData(dstName, sizeRecord);
+        m_folderData->flush();
 
         // finally update cache
         invalidateEntryInEntryInfoCache(srcName);
@@ -542,11 +732,20 @@ namespace knoxcrypt
     bool
     ContentFolder::removeFile(std::string const &name)
     {
-        // first unlink; this deallocates the file blocks, updating the
-        // volume bitmap accordingly; note doesn't matter what opendisposition is here
+        std::vector<uint64_t> blocks;
+        if(!doRemoveFile(name, blocks)) { return false; }
+        detail::deallocateBlocks(*m_io->blockBuilder->getVolumeBitMap(), m_io, blocks);
+        return true;
+    }
+
+    bool
+    ContentFolder::doRemoveFile(std::string const &name, std::vector<uint64_t> &blocks)
+    {
+        // first unlink; this gathers the file blocks for deallocating;
+        // note doesn't matter what opendisposition is here
         auto entry(getFile(name, OpenDisposition::buildAppendDisposition()));
         if(!entry) { return false; }
-        entry->unlink();
+        entry->unlink(blocks);
 
         // second set the metadata to an out of use state; this metadata can
         // then be later overwritten when a new entry is then added
@@ -565,11 +764,13 @@ namespace knoxcrypt
         if(!entry) { return false; }
 
         // loop over entries unlinking files and recursing into sub folders
-        // and deleting their entries
+        // and deleting their entries. The blocks of the files and of the
+        // folder's own data are deallocated together at the end
+        std::vector<uint64_t> blocks;
         auto & infos(entry->listAllEntries());
         for (auto const &it : infos) {
             if (it.second->type() == EntryType::FileType) {
-                entry->removeFile(it.second->filename());
+                entry->doRemoveFile(it.second->filename(), blocks);
             } else {
                 // a leaf will only contain compound folders
                 entry->removeCompoundFolder(it.second->filename());
@@ -581,7 +782,8 @@ namespace knoxcrypt
         this->doPutMetaDataOutOfUse(name);
 
         // unlink entry's data
-        entry->m_folderData.unlink();
+        entry->m_folderData->unlink(blocks);
+        detail::deallocateBlocks(*m_io->blockBuilder->getVolumeBitMap(), m_io, blocks);
 
         ++m_deadEntryCount;
 
@@ -610,7 +812,7 @@ namespace knoxcrypt
         this->doPutMetaDataOutOfUse(name);
 
         // unlink entry's data
-        entry->getCompoundFolder()->m_folderData.unlink();
+        entry->getCompoundFolder()->m_folderData->unlink();
 
         ++m_deadEntryCount;
 
@@ -637,7 +839,7 @@ namespace knoxcrypt
         for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
 
             // read all metadata
-            auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+            auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
             if (entryMetaDataIsEnabled(metaData)) {
                 auto info(doGetEntryInfo(metaData, entryIndex));
                 if (info->filename() == name) {
@@ -652,7 +854,7 @@ namespace knoxcrypt
     EntryInfo
     ContentFolder::getEntryInfo(uint64_t const entryIndex) const
     {
-        auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+        auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
         return *doGetEntryInfo(metaData, entryIndex);
     }
 
@@ -682,12 +884,22 @@ namespace knoxcrypt
 
         auto const entryType(getTypeForEntry(metaData));
         uint64_t fileSize = 0;
+        uint64_t blockCount = 0;
+        OptionalSizeRecord sizeRecord;
         uint64_t startBlock;
         if (entryType == EntryType::FileType) {
-            // note disposition doesn't matter here, can be anything
             startBlock = getBlockIndexForEntry(metaData);
-            File fe(m_io, entryName, startBlock, OpenDisposition::buildAppendDisposition());
-            fileSize = fe.fileSize();
+            if (entrySizeIsRecorded(metaData)) {
+                sizeRecord = getRecordedSizeForEntry(metaData);
+                fileSize = sizeRecord->fileSize;
+                blockCount = sizeRecord->blockCount;
+            } else {
+                // no recorded size so the file has to be opened;
+                // note disposition doesn't matter here, can be anything
+                File fe(m_io, entryName, startBlock, OpenDisposition::buildAppendDisposition(), fileEntryLayout(m_io));
+                fileSize = fe.fileSize();
+                blockCount = fe.blockCount();
+            }
         } else {
             startBlock = getBlockIndexForEntry(metaData);
         }
@@ -697,7 +909,11 @@ namespace knoxcrypt
                                               entryType,
                                               true, // writable
                                               startBlock,
-                                              entryIndex));
+                                              entryIndex,
+                                              blockCount));
+        if (sizeRecord && entryTailIsRecorded(metaData)) {
+            info->updateTailBlock(sizeRecord->tailBlock);
+        }
 
         m_entryInfoCacheMap.emplace(entryName, info);
 
@@ -708,7 +924,7 @@ namespace knoxcrypt
     ContentFolder::doGetMetaDataIndexForEntry(std::string const &name) const
     {
         for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
-            if (name == getEntryName(m_folderData, entryIndex)) {
+            if (name == getEntryName(*m_folderData, entryIndex)) {
                 return entryIndex;
             }
         }
@@ -732,7 +948,7 @@ namespace knoxcrypt
         // to overwrite?
         if(m_checkForEarlyMetaData) { // optimization
             for (long entryIndex = 0; entryIndex < m_entryCount; ++entryIndex) {
-                auto metaData(doSeekAndReadOfEntryMetaData(m_folderData, entryIndex));
+                auto metaData(doSeekAndReadOfEntryMetaData(*m_folderData, entryIndex));
                 if (!entryMetaDataIsEnabled(metaData)) {
                     uint32_t bufferSize = 1 + detail::MAX_FILENAME_LENGTH + 8;
                     std::ios_base::streamoff offset = (8 + (entryIndex * bufferSize));
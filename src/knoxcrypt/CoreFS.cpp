@@ -27,8 +27,11 @@
 */
 
 #include "knoxcrypt/EntryType.hpp"
+#include "knoxcrypt/ContainerImageStream.hpp"
 #include "knoxcrypt/CoreFS.hpp"
+#include "knoxcrypt/FileBlockBuilder.hpp"
 #include "knoxcrypt/KnoxCryptException.hpp"
+#include "knoxcrypt/detail/DetailKnoxCrypt.hpp"
 
 namespace knoxcrypt
 {
@@ -96,6 +99,13 @@ namespace knoxcrypt
         if (!childInfo) {
             throw KnoxCryptException(KnoxCryptError::NotFound);
         }
+
+        // the open file may have grown since its size was last recorded
+        if (m_cachedFileAndPath && m_cachedFileAndPath->first == thePath) {
+            EntryInfo info(*childInfo);
+            info.updateSize(m_cachedFileAndPath->second->fileSize());
+            return info;
+        }
         return *childInfo;
     }
 
@@ -193,6 +203,13 @@ namespace knoxcrypt
         // throw if destination already exists
         throwIfAlreadyExists(dstPath);
 
+        // if the source is the cached file, close it first so that its
+        // final size is recorded before the entry metadata is moved
+        if(m_cachedFileAndPath && m_cachedFileAndPath->first == srcPath) {
+            m_cachedFileAndPath->second->flush();
+            m_cachedFileAndPath.reset();
+        }
+
         // throw if source doesn't exist
         auto const srcPathBoost = ::boost::filesystem::path(srcPath);
         auto const filename(srcPathBoost.filename().string());
@@ -216,7 +233,12 @@ namespace knoxcrypt
             parentSrc->updateMetaDataWithNewFilename(filename, dstFilename);
         } else {
             parentSrc->putMetaDataOutOfUse(filename);
-            parentDst->writeNewMetaDataForEntry(dstFilename, childInfo->type(), childInfo->firstFileBlock());
+            OptionalSizeRecord sizeRecord;
+            if (childInfo->tailBlock()) {
+                sizeRecord = FileSizeRecord{childInfo->size(), childInfo->blockCount(), *childInfo->tailBlock()};
+            }
+            parentDst->writeNewMetaDataForEntry(dstFilename, childInfo->type(), childInfo->firstFileBlock(),
+                                                sizeRecord);
         }
 
         // Need to remove parent entry from cache
@@ -243,6 +265,7 @@ namespace knoxcrypt
             do {
                 cachedPath = cachedPath.parent_path();
                 if(cachedPath == boostFolderPath) {
+                    m_cachedFileAndPath->second->flush();
                     m_cachedFileAndPath.reset();
                     m_cachedFileAndPath = nullptr;
                     break;
@@ -276,6 +299,13 @@ namespace knoxcrypt
             throw KnoxCryptException(KnoxCryptError::NotFound);
         }*/
 
+        // the cached file's buffered writes are flushed so that the blocks
+        // they need are allocated before the file's blocks are freed
+        if(m_cachedFileAndPath && m_cachedFileAndPath->first == thePath) {
+            m_cachedFileAndPath->second->flush();
+            m_cachedFileAndPath.reset();
+        }
+
         try {
             parentEntry->removeFile(boost::filesystem::path(thePath).filename().string());
         } catch (...) {
@@ -319,6 +349,11 @@ namespace knoxcrypt
             }
         }
 
+        // need to also check if this now fucks up the cached file; done
+        // before removal so that the file's buffered writes are flushed
+        // whilst its blocks are still its own
+        resetCachedFile(thePath);
+
         try {
             parentEntry->removeFolder(boostPath.filename().string());
         } catch (...) {
@@ -328,9 +363,6 @@ namespace knoxcrypt
         // also remove entry and its parent from parent cache
         this->removeFolderFromCache(boostPath);
         this->removeFolderFromCache(boostPath.parent_path());
-
-        // need to also check if this now fucks up the cached file
-        resetCachedFile(thePath);
     }
 
     FileDevice
@@ -382,6 +414,25 @@ namespace knoxcrypt
         m_cachedFileAndPath->second->truncate(offset);
     }
 
+    std::streamoff
+    CoreFS::findDataOrHole(std::string const &path,
+                           std::streamoff offset,
+                           bool const hole)
+    {
+        StateLock lock(m_stateMutex);
+        auto parentEntry(doGetParentCompoundFolder(path));
+        if (!parentEntry) {
+            throw KnoxCryptException(KnoxCryptError::NotFound);
+        }
+
+        // a file already open for writing can be searched as it is
+        if (!m_cachedFileAndPath || m_cachedFileAndPath->first != path) {
+            setCachedFile(path, parentEntry, OpenDisposition::buildReadOnlyDisposition());
+        }
+        auto const &file = m_cachedFileAndPath->second;
+        return hole ? file->nextHoleOffset(offset) : file->nextDataOffset(offset);
+    }
+
     void
     CoreFS::setCachedFile(std::string const &path,
                            SharedCompoundFolder const &parentEntry,
@@ -391,7 +442,10 @@ namespace knoxcrypt
         if(m_cachedFileAndPath) {
             if( m_cachedFileAndPath->first != path ||
                !m_cachedFileAndPath->second->getOpenDisposition().equals(openMode)) {
-                m_cachedFileAndPath->second = std::make_shared<File>(parentEntry->getFile(theName, openMode));
+                m_cachedFileAndPath->second->flush();
+                m_cachedFileAndPath.reset(new FileAndPathPair(path,
+                                                              std::make_shared<File>(parentEntry->getFile(theName,
+                                                                                                          openMode))));
             }
         } else {
             m_cachedFileAndPath.reset(new FileAndPathPair(path,
@@ -408,7 +462,8 @@ namespace knoxcrypt
     CoreFS::statvfs(struct statvfs *buf)
     {
         StateLock lock(m_stateMutex);
-        buf->f_bsize   = detail::FILE_BLOCK_SIZE;
+        checkAndCountFreeBlocks();
+        buf->f_bsize   = m_io->blockSize;
         buf->f_blocks  = m_io->blocks;
         buf->f_bfree   = m_io->freeBlocks;
         buf->f_bavail  = m_io->freeBlocks;
@@ -421,6 +476,57 @@ namespace knoxcrypt
         buf->f_namemax = detail::MAX_FILENAME_LENGTH;
     }
 
+    uint64_t
+    CoreFS::blockSize() const
+    {
+        return m_io->blockSize;
+    }
+
+    void
+    CoreFS::flushFile(std::string const &path)
+    {
+        StateLock lock(m_stateMutex);
+        if(m_cachedFileAndPath && m_cachedFileAndPath->first == path) {
+            m_cachedFileAndPath->second->flush();
+        }
+    }
+
+    void
+    CoreFS::sync()
+    {
+        StateLock lock(m_stateMutex);
+        if(m_cachedFileAndPath) {
+            m_cachedFileAndPath->second->flush();
+        }
+        m_io->blockBuilder->getVolumeBitMap()->sync();
+        ContainerImageStream::sync(m_io);
+    }
+
+    void
+    CoreFS::unmount()
+    {
+        StateLock lock(m_stateMutex);
+        if(m_cachedFileAndPath) {
+            m_cachedFileAndPath->second->flush();
+        }
+        checkAndCountFreeBlocks();
+        m_io->blockBuilder->getVolumeBitMap()->sync();
+        ContainerImageStream stream(m_io, std::ios::in | std::ios::out | std::ios::binary);
+        detail::writeAllocationState(stream, m_io->blocks, m_io->blocks - m_io->freeBlocks, true);
+        stream.close();
+        ContainerImageStream::sync(m_io);
+    }
+
+    void
+    CoreFS::checkAndCountFreeBlocks()
+    {
+        if (!m_io->freeBlocksCounted) {
+            auto const allocated = m_io->blockBuilder->getVolumeBitMap()->getNumberOfAllocatedBlocks(m_io);
+            m_io->freeBlocks = m_io->blocks - allocated;
+            m_io->freeBlocksCounted = true;
+        }
+    }
+
     void
     CoreFS::throwIfAlreadyExists(std::string const &path) const
     {
@@ -35,7 +35,8 @@ namespace knoxcrypt
                          EntryType const &entryType,
                          bool const writable,
                          uint64_t const firstFileBlock,
-                         uint64_t const folderIndex)
+                         uint64_t const folderIndex,
+                         uint64_t const blockCount)
         : m_fileName(fileName)
         , m_fileSize(fileSize)
         , m_entryType(entryType)
@@ -44,6 +45,8 @@ namespace knoxcrypt
         , m_folderIndex(folderIndex)
         , m_hasBucketIndex(false)
         , m_bucketIndex(0) // TODO, is this initialization wise?
+        , m_blockCount(blockCount)
+        , m_tailBlock()
     {
 
     }
@@ -66,6 +69,30 @@ namespace knoxcrypt
         m_fileSize = newSize;
     }
 
+    uint64_t
+    EntryInfo::blockCount() const
+    {
+        return m_blockCount;
+    }
+
+    void
+    EntryInfo::updateBlockCount(uint64_t newBlockCount)
+    {
+        m_blockCount = newBlockCount;
+    }
+
+    boost::optional<uint64_t>
+    EntryInfo::tailBlock() const
+    {
+        return m_tailBlock;
+    }
+
+    void
+    EntryInfo::updateTailBlock(uint64_t newTailBlock)
+    {
+        m_tailBlock = newTailBlock;
+    }
+
     EntryType
     EntryInfo::type() const
     {
@@ -0,0 +1,229 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/ExtentAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace knoxcrypt
+{
+
+    namespace
+    {
+        /// the fewest blocks set aside for a writer; small enough that
+        /// tiny files don't waste much when their reservation is released
+        uint64_t const MIN_RESERVATION_BLOCKS = 16;
+
+        /// the most writers that can hold reservations at once
+        size_t const MAX_RESERVATIONS = 64;
+    }
+
+    ExtentAllocator::ExtentAllocator()
+        : m_firstBlock(0)
+        , m_endBlock(std::numeric_limits<uint64_t>::max())
+        , m_freeExtents()
+        , m_freeExtentsBySize()
+        , m_reservations()
+        , m_clock(0)
+    {
+    }
+
+    ExtentAllocator::ExtentAllocator(uint64_t const firstBlock, uint64_t const endBlock)
+        : m_firstBlock(firstBlock)
+        , m_endBlock(endBlock)
+        , m_freeExtents()
+        , m_freeExtentsBySize()
+        , m_reservations()
+        , m_clock(0)
+    {
+    }
+
+    void
+    ExtentAllocator::populate(SharedCoreIO const &io, VolumeBitMap &volumeBitMap)
+    {
+        m_freeExtents.clear();
+        m_freeExtentsBySize.clear();
+        m_reservations.clear();
+        for (auto const & extent : volumeBitMap.getFreeExtents(io, m_firstBlock, m_endBlock)) {
+            (void)m_freeExtents.emplace(extent.first, extent.second);
+            (void)m_freeExtentsBySize.emplace(extent.second, extent.first);
+        }
+    }
+
+    void
+    ExtentAllocator::addFreeExtent(uint64_t first, uint64_t count)
+    {
+        // merge with an extent that ends where this one begins
+        auto next = m_freeExtents.lower_bound(first);
+        if (next != m_freeExtents.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == first) {
+                first = prev->first;
+                count += prev->second;
+                removeFreeExtent(prev);
+            }
+        }
+
+        // merge with an extent that begins where this one ends
+        if (next != m_freeExtents.end() && next->first == first + count) {
+            count += next->second;
+            removeFreeExtent(next);
+        }
+
+        (void)m_freeExtents.emplace(first, count);
+        (void)m_freeExtentsBySize.emplace(count, first);
+    }
+
+    void
+    ExtentAllocator::removeFreeExtent(ExtentMap::iterator const &it)
+    {
+        (void)m_freeExtentsBySize.erase(Extent(it->second, it->first));
+        (void)m_freeExtents.erase(it);
+    }
+
+    ExtentAllocator::ExtentMap::iterator
+    ExtentAllocator::findFreeExtentContaining(uint64_t const block)
+    {
+        auto it = m_freeExtents.upper_bound(block);
+        if (it == m_freeExtents.begin()) {
+            return m_freeExtents.end();
+        }
+        --it;
+        if (block < it->first + it->second) {
+            return it;
+        }
+        return m_freeExtents.end();
+    }
+
+    uint64_t
+    ExtentAllocator::allocateAndReserve(ExtentMap::iterator const &it,
+                                        uint64_t const block,
+                                        uint64_t const blocksWanted)
+    {
+        uint64_t const first = it->first;
+        uint64_t const end = it->first + it->second;
+        uint64_t const taken = std::min(blocksWanted, end - block);
+        removeFreeExtent(it);
+
+        // whatever isn't taken stays free
+        if (block > first) {
+            addFreeExtent(first, block - first);
+        }
+        if (block + taken < end) {
+            addFreeExtent(block + taken, end - (block + taken));
+        }
+
+        // the block is handed out, the rest is reserved
+        if (taken > 1) {
+            m_reservations[block + 1] = Reservation{block + taken, m_clock};
+            if (m_reservations.size() > MAX_RESERVATIONS) {
+                releaseOldestReservation();
+            }
+        }
+        return block;
+    }
+
+    void
+    ExtentAllocator::releaseOldestReservation()
+    {
+        auto oldest = std::min_element(m_reservations.begin(), m_reservations.end(),
+                                       [](Reservations::value_type const &a,
+                                          Reservations::value_type const &b) {
+                                           return a.second.lastUsed < b.second.lastUsed;
+                                       });
+        addFreeExtent(oldest->first, oldest->second.end - oldest->first);
+        (void)m_reservations.erase(oldest);
+    }
+
+    void
+    ExtentAllocator::releaseAllReservations()
+    {
+        for (auto const & reservation : m_reservations) {
+            addFreeExtent(reservation.first, reservation.second.end - reservation.first);
+        }
+        m_reservations.clear();
+    }
+
+    ExtentAllocator::OptionalBlock
+    ExtentAllocator::allocate(SharedCoreIO const &io,
+                              VolumeBitMap &volumeBitMap,
+                              OptionalBlock const &goal,
+                              uint64_t const blocksExpected)
+    {
+        ++m_clock;
+        uint64_t const blocksWanted = std::max(blocksExpected, MIN_RESERVATION_BLOCKS);
+
+        // on first use, read in the free extents so that a goal can be met
+        if (m_freeExtents.empty() && m_reservations.empty()) {
+            populate(io, volumeBitMap);
+        }
+
+        if (goal) {
+            // the writer is continuing through its reservation
+            auto reservation = m_reservations.find(*goal);
+            if (reservation != m_reservations.end()) {
+                Reservation const remaining{reservation->second.end, m_clock};
+                (void)m_reservations.erase(reservation);
+                if (*goal + 1 < remaining.end) {
+                    m_reservations[*goal + 1] = remaining;
+                }
+                return OptionalBlock(*goal);
+            }
+
+            // the writer's reservation has run out but the
+            // blocks that follow it are still free
+            auto it = findFreeExtentContaining(*goal);
+            if (it != m_freeExtents.end()) {
+                return OptionalBlock(allocateAndReserve(it, *goal, blocksWanted));
+            }
+        }
+
+        // reservations are given up before the bitmap is re-read
+        if (m_freeExtents.empty()) {
+            releaseAllReservations();
+        }
+        if (m_freeExtents.empty()) {
+            populate(io, volumeBitMap);
+        }
+        if (m_freeExtents.empty()) {
+            return OptionalBlock();
+        }
+
+        // the smallest extent that fits, otherwise the largest there is
+        auto bySize = m_freeExtentsBySize.lower_bound(Extent(blocksWanted, 0));
+        if (bySize == m_freeExtentsBySize.end()) {
+            bySize = std::prev(bySize);
+        }
+        auto it = m_freeExtents.find(bySize->second);
+        assert(it != m_freeExtents.end());
+        return OptionalBlock(allocateAndReserve(it, it->first, blocksWanted));
+    }
+
+}
@@ -34,24 +34,45 @@
 #include "knoxcrypt/detail/Detailknoxcrypt.hpp"
 #include "knoxcrypt/detail/DetailFileBlock.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <stdexcept>
+#include <utility>
 
 namespace knoxcrypt
 {
 
     namespace {
 
-        uint32_t blockWriteSpace()
+        /// the number of data bytes each block of the image can hold
+        uint32_t blockWriteSpace(SharedCoreIO const &io)
         {
-            return detail::FILE_BLOCK_SIZE - detail::FILE_BLOCK_META;
+            return io->blockSize - detail::FILE_BLOCK_META;
         }
 
+        /// each extent in an index block is stored as an 8 byte first block
+        /// followed by a 4 byte length
+        size_t const INDEX_EXTENT_BYTES = 12;
+
+        /// the number of extents that fit in one index block
+        size_t extentsPerIndexBlock(SharedCoreIO const &io)
+        {
+            return blockWriteSpace(io) / INDEX_EXTENT_BYTES;
+        }
+
+        /// the first block of an extent standing for a hole; the hole's
+        /// blocks were never written so read back as zeros and take up no
+        /// space in the image. It also marks them in the block map
+        uint64_t const HOLE_BLOCK = UINT64_MAX;
+
     }
 
     // for writing a brand new entry where start block isn't known
     File::File(SharedCoreIO const &io,
                              std::string const &name,
-                             bool const enforceStartBlock)
+                             bool const enforceStartBlock,
+                             FileLayout const layout)
         : m_io(io)
         , m_name(name)
         , m_enforceStartBlock(enforceStartBlock)
@@ -62,8 +83,15 @@ namespace knoxcrypt
         , m_blockIndex(0)
         , m_openDisposition(OpenDisposition::buildAppendDisposition())
         , m_pos(0)
-        , m_blockCount(0)
+        , m_blockIndices()
+        , m_unmappedBlocks(0)
+        , m_holeBlocks(0)
         , m_stream()
+        , m_pendingData()
+        , m_layout(layout)
+        , m_indexBlocks()
+        , m_extents()
+        , m_firstDirtyExtent()
     {
     }
 
@@ -71,7 +99,9 @@ namespace knoxcrypt
     File::File(SharedCoreIO const &io,
                              std::string const &name,
                              uint64_t const startBlock,
-                             OpenDisposition const &openDisposition)
+                             OpenDisposition const &openDisposition,
+                             FileLayout const layout,
+                             OptionalSizeRecord const &sizeRecord)
         : m_io(io)
         , m_name(name)
         , m_enforceStartBlock(false)
@@ -82,16 +112,33 @@ namespace knoxcrypt
         , m_blockIndex(0)
         , m_openDisposition(openDisposition)
         , m_pos(0)
-        , m_blockCount(0)
+        , m_blockIndices()
+        , m_unmappedBlocks(0)
+        , m_holeBlocks(0)
         , m_stream()
+        , m_pendingData()
+        , m_layout(layout)
+        , m_indexBlocks()
+        , m_extents()
+        , m_firstDirtyExtent()
     {
+        // an append can go straight to the recorded tail
+        if (m_openDisposition.readWrite() != ReadOrWriteOrBoth::ReadOnly &&
+            m_openDisposition.trunc() == TruncateOrKeep::Keep &&
+            m_openDisposition.append() == AppendOrOverwrite::Append &&
+            openAtRecordedTail(sizeRecord)) {
+            return;
+        }
+
         // counts number of blocks and sets file size
         enumerateBlockStats();
 
-        // sets the current working block to the very first file block
-        m_workingBlock = std::make_shared<FileBlock>(io, startBlock, openDisposition, m_stream);
-
-        m_stream = m_workingBlock->getStream();
+        // sets the current working block to the very first file block; an
+        // indexed file might not have any
+        if (!m_blockIndices.empty()) {
+            m_workingBlock = std::make_shared<FileBlock>(io, m_blockIndices.front(), openDisposition, m_stream);
+            m_stream = m_workingBlock->getStream();
+        }
 
         // set up for specific write-mode
         if (m_openDisposition.readWrite() != ReadOrWriteOrBoth::ReadOnly) {
@@ -109,6 +156,84 @@ namespace knoxcrypt
         }
     }
 
+    File::File(File &&other)
+        : m_io(std::move(other.m_io))
+        , m_name(std::move(other.m_name))
+        , m_enforceStartBlock(other.m_enforceStartBlock)
+        , m_fileSize(other.m_fileSize)
+        , m_workingBlock(std::move(other.m_workingBlock))
+        , m_buffer(std::move(other.m_buffer))
+        , m_startVolumeBlock(other.m_startVolumeBlock)
+        , m_blockIndex(other.m_blockIndex)
+        , m_openDisposition(other.m_openDisposition)
+        , m_pos(other.m_pos)
+        , m_blockIndices(std::move(other.m_blockIndices))
+        , m_unmappedBlocks(other.m_unmappedBlocks)
+        , m_holeBlocks(other.m_holeBlocks)
+        , m_optionalSizeCallback(std::move(other.m_optionalSizeCallback))
+        , m_stream(std::move(other.m_stream))
+        , m_pendingData(std::move(other.m_pendingData))
+        , m_layout(other.m_layout)
+        , m_indexBlocks(std::move(other.m_indexBlocks))
+        , m_extents(std::move(other.m_extents))
+        , m_firstDirtyExtent(other.m_firstDirtyExtent)
+    {
+        other.m_pendingData.clear();
+        other.m_firstDirtyExtent = boost::none;
+        other.m_optionalSizeCallback = boost::none;
+    }
+
+    File&
+    File::operator=(File &&other)
+    {
+        if (this == &other) {
+            return *this;
+        }
+
+        // unlike in the destructor, a failure here can be reported
+        allocatePendingBlocks();
+        writeIndex();
+        recordSize();
+
+        m_io = std::move(other.m_io);
+        m_name = std::move(other.m_name);
+        m_enforceStartBlock = other.m_enforceStartBlock;
+        m_fileSize = other.m_fileSize;
+        m_workingBlock = std::move(other.m_workingBlock);
+        m_buffer = std::move(other.m_buffer);
+        m_startVolumeBlock = other.m_startVolumeBlock;
+        m_blockIndex = other.m_blockIndex;
+        m_openDisposition = other.m_openDisposition;
+        m_pos = other.m_pos;
+        m_blockIndices = std::move(other.m_blockIndices);
+        m_unmappedBlocks = other.m_unmappedBlocks;
+        m_holeBlocks = other.m_holeBlocks;
+        m_optionalSizeCallback = std::move(other.m_optionalSizeCallback);
+        m_stream = std::move(other.m_stream);
+        m_pendingData = std::move(other.m_pendingData);
+        m_layout = other.m_layout;
+        m_indexBlocks = std::move(other.m_indexBlocks);
+        m_extents = std::move(other.m_extents);
+        m_firstDirtyExtent = other.m_firstDirtyExtent;
+
+        other.m_pendingData.clear();
+        other.m_firstDirtyExtent = boost::none;
+        other.m_optionalSizeCallback = boost::none;
+        return *this;
+    }
+
+    File::~File()
+    {
+        // nothing can be thrown from here, e.g. when the image is full, so
+        // any such failure loses what was pending; flush reports it instead
+        try {
+            allocatePendingBlocks();
+            writeIndex();
+            recordSize();
+        } catch (...) {
+        }
+    }
+
     std::string
     File::filename() const
     {
@@ -121,6 +246,26 @@ namespace knoxcrypt
         return m_fileSize;
     }
 
+    uint64_t
+    File::blockCount() const
+    {
+        return dataBlockCount() + m_indexBlocks.size();
+    }
+
+    uint64_t
+    File::dataBlockCount() const
+    {
+        return m_unmappedBlocks + m_blockIndices.size() - m_holeBlocks;
+    }
+
+    FileSizeRecord
+    File::sizeRecord() const
+    {
+        allocatePendingBlocks();
+        uint64_t const tail = m_blockIndices.empty() ? m_startVolumeBlock : m_blockIndices.back();
+        return FileSizeRecord{m_fileSize, blockCount(), tail};
+    }
+
     OpenDisposition
     File::getOpenDisposition() const
     {
@@ -136,6 +281,7 @@ namespace knoxcrypt
     uint64_t
     File::getCurrentVolumeBlockIndex()
     {
+        allocatePendingBlocks();
         if (!m_workingBlock) {
             checkAndUpdateWorkingBlockWithNew();
         }
@@ -145,15 +291,34 @@ namespace knoxcrypt
     uint64_t
     File::getStartVolumeBlockIndex() const
     {
-        if (!m_workingBlock) {
+        allocatePendingBlocks();
+        if (m_blockIndices.empty()) {
             checkAndUpdateWorkingBlockWithNew();
-            m_startVolumeBlock = m_workingBlock->getIndex();
         }
         return m_startVolumeBlock;
     }
 
+    void
+    File::openWorkingBlock(uint64_t const blockIndex)
+    {
+        // there's no block to open in a hole
+        if (m_blockIndices[blockIndex] == HOLE_BLOCK) {
+            m_workingBlock = nullptr;
+            return;
+        }
+
+        // nothing else holding the working block means its storage can be
+        // reused; reading from block to block then doesn't allocate
+        FileBlock block(m_io, m_blockIndices[blockIndex], m_openDisposition, m_stream);
+        if (m_workingBlock && m_workingBlock.use_count() == 1) {
+            *m_workingBlock = block;
+        } else {
+            m_workingBlock = std::make_shared<FileBlock>(block);
+        }
+    }
+
     std::streamsize
-    File::readWorkingBlockBytes(uint32_t const thisMany)
+    File::readWorkingBlockBytes(char * const s, uint32_t const thisMany)
     {
 
         // need to take into account the currently seeked-to position and
@@ -165,43 +330,493 @@ namespace knoxcrypt
         // try to read thisMany bytes
         uint32_t bytesToRead = std::min(size, thisMany);
 
-        std::vector<uint8_t>().swap(m_buffer);
-        m_buffer.resize(bytesToRead);
-        (void)m_workingBlock->read((char*)&m_buffer.front(), bytesToRead);
+        (void)m_workingBlock->read(s, bytesToRead);
 
-        if (static_cast<uint64_t>(m_blockIndex + 1) < m_blockCount && bytesToRead == size) {
+        if (static_cast<uint64_t>(m_blockIndex + 1) < m_blockIndices.size() && bytesToRead == size) {
             ++m_blockIndex;
-            m_workingBlock = std::make_shared<FileBlock>(m_io,
-                                                           m_workingBlock->getNextIndex(),
-                                                           m_openDisposition,
-                                                           m_stream);
+            openWorkingBlock(m_blockIndex);
         }
 
         return bytesToRead;
     }
 
-    void File::newWritableFileBlock() const
+    bool
+    File::inHole() const
+    {
+        return static_cast<uint64_t>(m_blockIndex) < m_blockIndices.size() &&
+               m_blockIndices[m_blockIndex] == HOLE_BLOCK;
+    }
+
+    uint64_t
+    File::holeOffset() const
+    {
+        // without a working block, the position within the block follows
+        // from the file position
+        return m_pos - (m_blockIndex * blockWriteSpace(m_io));
+    }
+
+    std::streamsize
+    File::readHoleBytes(char * const s, uint32_t const thisMany)
+    {
+        // a hole is never a file's last block so it's always full and
+        // there's always a block after it
+        uint64_t const left = blockWriteSpace(m_io) - holeOffset();
+        uint32_t const bytesToRead = std::min(uint64_t(thisMany), left);
+        std::memset(s, 0, bytesToRead);
+        if (bytesToRead == left) {
+            ++m_blockIndex;
+            openWorkingBlock(m_blockIndex);
+        }
+        return bytesToRead;
+    }
+
+    std::streamsize
+    File::readBlockRun(char * const s, std::streamsize const n)
+    {
+        uint64_t const space = blockWriteSpace(m_io);
+        uint64_t const blocksWanted = std::min(uint64_t(n) / m_io->blockSize,
+                                               uint64_t(m_blockIndices.size() - m_blockIndex));
+        uint64_t run = 1;
+        while (run < blocksWanted &&
+               m_blockIndices[m_blockIndex + run] == m_blockIndices[m_blockIndex + run - 1] + 1) {
+            ++run;
+        }
+        if (run < 2) {
+            return 0;
+        }
+        if (!m_stream) {
+            m_stream = m_workingBlock->getStream();
+        }
+
+        // the run's headers and data are read together straight in to the
+        // destination, which is big enough to hold the whole run
+        (void)m_stream->readAt(s, run * m_io->blockSize, detail::getOffsetOfFileBlock(m_blockIndices[m_blockIndex],
+                                                                                      m_io->blocks,
+                                                                                      m_io->blockSize));
+
+        // each block's data is then moved down over the headers. A block's
+        // data only ever moves towards the front of the destination so the
+        // next block's header is still intact when it is reached. Every
+        // block but a file's last is full so a block that isn't ends the run
+        std::streamsize copied = 0;
+        uint64_t block = 0;
+        uint64_t taken = 0;
+        for (; block < run; ++block) {
+            char * const header = s + (block * m_io->blockSize);
+            taken = std::min(uint64_t(detail::convertInt4ArrayToInt32((uint8_t*)header)), space);
+            std::memmove(s + copied, header + detail::FILE_BLOCK_META, taken);
+            copied += taken;
+            if (taken < space) {
+                break;
+            }
+        }
+        block = std::min(block, run - 1);
+
+        // as with readWorkingBlockBytes, the working block moves on to the
+        // next block once read to its end
+        m_blockIndex += block;
+        openWorkingBlock(m_blockIndex);
+        (void)m_workingBlock->seek(taken);
+        if (static_cast<uint64_t>(m_blockIndex + 1) < m_blockIndices.size() &&
+            taken == m_workingBlock->getDataBytesWritten()) {
+            ++m_blockIndex;
+            openWorkingBlock(m_blockIndex);
+        }
+        return copied;
+    }
+
+    void File::newWritableFileBlock(uint64_t const blocksExpected) const
     {
+        if (m_layout == FileLayout::Indexed && m_indexBlocks.empty()) {
+            allocateIndexRoot(blocksExpected);
+        }
+
+        // ideally the new block directly follows the working block (or the
+        // index root of an empty indexed file). A file that keeps growing is
+        // expected to keep on growing so asks for at least as many blocks
+        // again as it already has
+        VolumeBitMap::OptionalBlock goal;
+        if (m_workingBlock) {
+            goal = VolumeBitMap::OptionalBlock(m_workingBlock->getIndex() + 1);
+        } else if (!m_indexBlocks.empty()) {
+            goal = VolumeBitMap::OptionalBlock(m_indexBlocks.front() + 1);
+        }
         auto block(m_io->blockBuilder->buildWritableFileBlock(m_io,
                                                               knoxcrypt::OpenDisposition::buildAppendDisposition(),
                                                               m_stream,
-                                                              m_enforceStartBlock));
+                                                              m_enforceStartBlock,
+                                                              goal,
+                                                              std::max(blocksExpected, dataBlockCount())));
 
         if (m_enforceStartBlock) { m_enforceStartBlock = false; }
 
+        // the block might have belonged to a deleted file. Its header is reset
+        // here rather than when it was deallocated
+        block.writeNewBlock(nullptr, 0, block.getIndex());
+
         block.registerBlockWithVolumeBitmap();
 
-        if (m_workingBlock) {
+        if (m_workingBlock && m_layout == FileLayout::Chained) {
             m_workingBlock->setNextIndex(block.getIndex());
         }
 
-        ++m_blockCount;
-        m_blockIndex = m_blockCount - 1;
+        addBlock(block.getIndex());
+        m_blockIndex = m_blockIndices.size() - 1;
         m_workingBlock = std::make_shared<FileBlock>(block);
     }
 
+    bool
+    File::shouldDelayAllocation() const
+    {
+        // only appends to the end of the file are held back
+        if (!m_io->useBlockCache || !m_io->useDelayedAllocation ||
+            m_openDisposition.append() != AppendOrOverwrite::Append) {
+            return false;
+        }
+        return !m_pendingData.empty() || static_cast<uint64_t>(m_pos) == m_fileSize;
+    }
+
+    void
+    File::allocatePendingBlocks() const
+    {
+        if (m_pendingData.empty()) {
+            return;
+        }
+
+        // whatever space is left in the working block is filled first so
+        // that its size is only rewritten the once
+        uint64_t const space = blockWriteSpace(m_io);
+        uint64_t taken = 0;
+        if (m_workingBlock && workingBlockHasAvailableSpace()) {
+            taken = std::min(space - m_workingBlock->tell(), uint64_t(m_pendingData.size()));
+            (void)m_workingBlock->write((char*)&m_pendingData.front(), taken);
+            if (!m_stream) {
+                m_stream = m_workingBlock->getStream();
+            }
+        }
+        if (taken == m_pendingData.size()) {
+            m_pendingData.clear();
+            return;
+        }
+        uint64_t const count = (m_pendingData.size() - taken + space - 1) / space;
+        if (m_layout == FileLayout::Indexed && m_indexBlocks.empty()) {
+            allocateIndexRoot(count);
+        }
+
+        // every block is allocated before any is written so that each block's
+        // next index is known up front. As in newWritableFileBlock, the
+        // allocator is told to expect at least as many blocks again as the
+        // file already has so that it can find a long enough run
+        std::vector<FileBlock> blocks;
+        blocks.reserve(count);
+        VolumeBitMap::OptionalBlock goal;
+        if (m_workingBlock) {
+            goal = VolumeBitMap::OptionalBlock(m_workingBlock->getIndex() + 1);
+        } else if (!m_indexBlocks.empty()) {
+            goal = VolumeBitMap::OptionalBlock(m_indexBlocks.front() + 1);
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            blocks.push_back(m_io->blockBuilder->buildWritableFileBlock(m_io,
+                                                                        OpenDisposition::buildAppendDisposition(),
+                                                                        m_stream,
+                                                                        m_enforceStartBlock,
+                                                                        goal,
+                                                                        std::max(count - i, dataBlockCount() + i)));
+            m_enforceStartBlock = false;
+            blocks.back().registerBlockWithVolumeBitmap();
+            goal = VolumeBitMap::OptionalBlock(blocks.back().getIndex() + 1);
+        }
+
+        // each run of blocks that follow one another in the image is
+        // written in one go
+        bool const chained = (m_layout == FileLayout::Chained);
+        for (uint64_t first = 0; first < count;) {
+            uint64_t last = first + 1;
+            while (last < count && blocks[last].getIndex() == blocks[last - 1].getIndex() + 1) {
+                ++last;
+            }
+            uint64_t const offset = taken + (first * space);
+            uint64_t const bytes = std::min((last - first) * space, m_pendingData.size() - offset);
+            uint64_t const next = (chained && last < count) ? blocks[last].getIndex() : blocks[last - 1].getIndex();
+            FileBlock::writeNewBlockRun(&blocks[first], last - first, (char*)&m_pendingData[offset],
+                                        bytes, chained, next);
+            first = last;
+        }
+        m_stream = blocks.back().getStream();
+        m_stream->flushUnlessBuffered();
+
+        // link the batch on to the end of the file
+        if (m_layout == FileLayout::Chained) {
+            if (m_workingBlock) {
+                m_workingBlock->setNextIndex(blocks.front().getIndex());
+            } else {
+                m_startVolumeBlock = blocks.front().getIndex();
+            }
+        }
+
+        for (auto const &block : blocks) {
+            addBlock(block.getIndex());
+        }
+        m_blockIndex = m_blockIndices.size() - 1;
+        m_workingBlock = std::make_shared<FileBlock>(blocks.back());
+
+        // the storage is kept for the writes still to come; flush frees it
+        m_pendingData.clear();
+    }
+
+    void
+    File::addBlock(uint64_t const block) const
+    {
+        m_blockIndices.push_back(block);
+        if (m_layout == FileLayout::Chained) {
+            return;
+        }
+
+        // a block directly following the last extent lengthens it
+        if (!m_extents.empty() && m_extents.back().first != HOLE_BLOCK &&
+            m_extents.back().first + m_extents.back().second == block &&
+            m_extents.back().second < UINT32_MAX) {
+            ++m_extents.back().second;
+        } else {
+            m_extents.emplace_back(block, 1);
+        }
+        size_t const changed = m_extents.size() - 1;
+        m_firstDirtyExtent = std::min(m_firstDirtyExtent.get_value_or(changed), changed);
+    }
+
+    void
+    File::addHoles(uint64_t const count) const
+    {
+        m_blockIndices.insert(m_blockIndices.end(), count, HOLE_BLOCK);
+        m_holeBlocks += count;
+
+        // as with blocks, holes lengthen a hole extent that ends the file
+        size_t const changed = (!m_extents.empty() && m_extents.back().first == HOLE_BLOCK) ?
+                               m_extents.size() - 1 : m_extents.size();
+        for (uint64_t left = count; left > 0;) {
+            if (m_extents.empty() || m_extents.back().first != HOLE_BLOCK || m_extents.back().second == UINT32_MAX) {
+                m_extents.emplace_back(HOLE_BLOCK, 0);
+            }
+            uint64_t const taken = std::min(left, UINT32_MAX - m_extents.back().second);
+            m_extents.back().second += taken;
+            left -= taken;
+        }
+        m_firstDirtyExtent = std::min(m_firstDirtyExtent.get_value_or(changed), changed);
+    }
+
+    void
+    File::fillHole(uint64_t const blockIndex) const
+    {
+        // find the hole extent and how far in to it the block is
+        size_t e = 0;
+        uint64_t into = blockIndex;
+        for (; into >= m_extents[e].second; ++e) {
+            into -= m_extents[e].second;
+        }
+
+        // the block is given zeros for whatever isn't then written to it.
+        // Ideally it follows the data preceding the hole
+        VolumeBitMap::OptionalBlock goal(m_indexBlocks.front() + 1);
+        for (size_t before = e; before-- > 0;) {
+            if (m_extents[before].first != HOLE_BLOCK) {
+                goal = VolumeBitMap::OptionalBlock(m_extents[before].first + m_extents[before].second);
+                break;
+            }
+        }
+        auto block(m_io->blockBuilder->buildWritableFileBlock(m_io,
+                                                              OpenDisposition::buildAppendDisposition(),
+                                                              m_stream,
+                                                              false,
+                                                              goal));
+        std::vector<char> const zeros(blockWriteSpace(m_io));
+        block.writeNewBlock(&zeros.front(), zeros.size(), block.getIndex());
+        block.registerBlockWithVolumeBitmap();
+        m_stream = block.getStream();
+        m_stream->flushUnlessBuffered();
+        uint64_t const index = block.getIndex();
+
+        // the hole's extent is split either side of the block, which joins
+        // on to the extent before the hole when it directly follows it
+        std::vector<std::pair<uint64_t, uint64_t>> pieces;
+        if (into > 0) {
+            pieces.emplace_back(HOLE_BLOCK, into);
+        }
+        pieces.emplace_back(index, 1);
+        if (into + 1 < m_extents[e].second) {
+            pieces.emplace_back(HOLE_BLOCK, m_extents[e].second - into - 1);
+        }
+        size_t changed = e;
+        if (into == 0 && e > 0 && m_extents[e - 1].first != HOLE_BLOCK &&
+            m_extents[e - 1].first + m_extents[e - 1].second == index &&
+            m_extents[e - 1].second < UINT32_MAX) {
+            ++m_extents[e - 1].second;
+            pieces.erase(pieces.begin());
+            changed = e - 1;
+        }
+        m_extents.erase(m_extents.begin() + e);
+        m_extents.insert(m_extents.begin() + e, pieces.begin(), pieces.end());
+        m_firstDirtyExtent = std::min(m_firstDirtyExtent.get_value_or(changed), changed);
+
+        m_blockIndices[blockIndex] = index;
+        --m_holeBlocks;
+        m_blockIndex = blockIndex;
+        m_workingBlock = std::make_shared<FileBlock>(m_io, index, m_openDisposition, m_stream);
+    }
+
+    void
+    File::extendWithHole(uint64_t const newSize)
+    {
+        // as with an overwrite that runs past the end of the file, the file
+        // is then appended to. The last block is first topped up with zeros
+        m_openDisposition = OpenDisposition::buildAppendDisposition();
+        (void)this->seek(0, std::ios_base::end);
+        uint64_t const space = blockWriteSpace(m_io);
+        uint64_t const capacity = m_blockIndices.size() * space;
+        std::vector<char> const zeros(space);
+        uint64_t const topUp = std::min(newSize, capacity) - m_fileSize;
+        if (topUp > 0) {
+            (void)this->write(&zeros.front(), topUp);
+        }
+        if (newSize <= capacity) {
+            return;
+        }
+        allocatePendingBlocks();
+
+        // whole blocks short of the new size are left as a hole. The block
+        // holding the new end is allocated as a file's last block is always
+        // needed to work out its size
+        uint64_t const rest = newSize - capacity;
+        uint64_t const holes = (rest - 1) / space;
+        if (holes > 0) {
+            if (m_indexBlocks.empty()) {
+                allocateIndexRoot(1);
+            }
+            addHoles(holes);
+            m_fileSize += holes * space;
+            m_pos = m_fileSize;
+            newWritableFileBlock();
+        }
+        (void)this->write(&zeros.front(), rest - (holes * space));
+    }
+
+    void
+    File::allocateIndexRoot(uint64_t const blocksExpected) const
+    {
+        // the root comes before any data so that the data can follow it
+        auto block(m_io->blockBuilder->buildWritableFileBlock(m_io,
+                                                              OpenDisposition::buildAppendDisposition(),
+                                                              m_stream,
+                                                              m_enforceStartBlock,
+                                                              VolumeBitMap::OptionalBlock(),
+                                                              blocksExpected + 1));
+        m_enforceStartBlock = false;
+        block.writeNewBlock(nullptr, 0, block.getIndex());
+        block.registerBlockWithVolumeBitmap();
+        m_stream = block.getStream();
+        m_indexBlocks.push_back(block.getIndex());
+        m_startVolumeBlock = block.getIndex();
+    }
+
+    void
+    File::readIndex()
+    {
+        // the index blocks are chained from the root, each holding as many
+        // extents as will fit
+        uint64_t index = m_startVolumeBlock;
+        while (true) {
+            FileBlock block(m_io, index, OpenDisposition::buildReadOnlyDisposition(), m_stream);
+            m_stream = block.getStream();
+            m_indexBlocks.push_back(index);
+
+            std::vector<uint8_t> buf(block.getDataBytesWritten());
+            if (!buf.empty()) {
+                (void)block.read((char*)&buf.front(), buf.size());
+            }
+            for (size_t offset = 0; offset + INDEX_EXTENT_BYTES <= buf.size(); offset += INDEX_EXTENT_BYTES) {
+                uint64_t const first = detail::convertInt8ArrayToInt64(&buf[offset]);
+                uint64_t const length = detail::convertInt4ArrayToInt32(&buf[offset + 8]);
+                m_extents.emplace_back(first, length);
+                if (first == HOLE_BLOCK) {
+                    m_blockIndices.insert(m_blockIndices.end(), length, HOLE_BLOCK);
+                    m_holeBlocks += length;
+                    continue;
+                }
+                for (uint64_t b = 0; b < length; ++b) {
+                    m_blockIndices.push_back(first + b);
+                }
+            }
+
+            if (block.getNextIndex() == index) {
+                break;
+            }
+            index = block.getNextIndex();
+        }
+
+        // every block but the last is full so only the last block's
+        // header is needed to work out the file size. The last block is
+        // never a hole
+        if (!m_blockIndices.empty()) {
+            FileBlock last(m_io, m_blockIndices.back(), OpenDisposition::buildReadOnlyDisposition(), m_stream);
+            m_fileSize = (m_blockIndices.size() - 1) * blockWriteSpace(m_io) + last.getDataBytesWritten();
+        }
+    }
+
+    void
+    File::writeIndex() const
+    {
+        if (!m_firstDirtyExtent || m_indexBlocks.empty()) {
+            return;
+        }
+        size_t const perBlock = extentsPerIndexBlock(m_io);
+        size_t const needed = std::max(size_t(1), (m_extents.size() + perBlock - 1) / perBlock);
+        size_t const existing = m_indexBlocks.size();
+
+        // overflow index blocks are added or given back as the number of
+        // extents changes. The last of the blocks kept is then rewritten
+        // too since its next index changes
+        std::vector<uint64_t> toFree(m_indexBlocks.begin() + std::min(needed, existing), m_indexBlocks.end());
+        m_indexBlocks.resize(std::min(needed, existing));
+        while (m_indexBlocks.size() < needed) {
+            auto block(m_io->blockBuilder->buildWritableFileBlock(m_io,
+                                                                  OpenDisposition::buildAppendDisposition(),
+                                                                  m_stream,
+                                                                  false,
+                                                                  VolumeBitMap::OptionalBlock(m_indexBlocks.back() + 1)));
+            block.registerBlockWithVolumeBitmap();
+            m_indexBlocks.push_back(block.getIndex());
+        }
+        size_t const firstDirtyBlock = std::min(*m_firstDirtyExtent / perBlock, std::min(needed, existing) - 1);
+
+        for (size_t b = firstDirtyBlock; b < needed; ++b) {
+            std::vector<uint8_t> buf;
+            size_t const endExtent = std::min(m_extents.size(), (b + 1) * perBlock);
+            for (size_t e = b * perBlock; e < endExtent; ++e) {
+                uint8_t dat[8];
+                detail::convertUInt64ToInt8Array(m_extents[e].first, dat);
+                buf.insert(buf.end(), dat, dat + 8);
+                detail::convertInt32ToInt4Array(uint32_t(m_extents[e].second), dat);
+                buf.insert(buf.end(), dat, dat + 4);
+            }
+            uint64_t const next = (b + 1 < needed) ? m_indexBlocks[b + 1] : m_indexBlocks[b];
+            FileBlock block(m_io, m_indexBlocks[b], next, OpenDisposition::buildAppendDisposition(), m_stream);
+            block.writeNewBlock(buf.empty() ? nullptr : (char*)&buf.front(), buf.size(), next);
+            m_stream = block.getStream();
+        }
+        m_stream->flushUnlessBuffered();
+        m_firstDirtyExtent = boost::none;
+
+        if (!toFree.empty()) {
+            detail::deallocateBlocks(*m_io->blockBuilder->getVolumeBitMap(), m_io, toFree);
+        }
+    }
+
     void File::enumerateBlockStats()
     {
+        if (m_layout == FileLayout::Indexed) {
+            readIndex();
+            return;
+        }
+
         // find very first block
         FileBlockIterator block(m_io,
                                 m_startVolumeBlock,
@@ -210,10 +825,71 @@ namespace knoxcrypt
         FileBlockIterator end;
         for (; block != end; ++block) {
             m_fileSize += block->getDataBytesWritten();
-            ++m_blockCount;
+            m_blockIndices.push_back(block->getIndex());
         }
     }
 
+    bool
+    File::openAtRecordedTail(OptionalSizeRecord const &sizeRecord)
+    {
+        // indexed files already find their tail from the index
+        if (!sizeRecord || m_layout != FileLayout::Chained || sizeRecord->blockCount == 0 ||
+            (sizeRecord->blockCount == 1 && sizeRecord->tailBlock != m_startVolumeBlock)) {
+            return false;
+        }
+
+        // a deallocated block keeps its old header so the tail must still be
+        // in use. Every block before the tail is full so the tail's header
+        // must account for the rest of the recorded size
+        if (!m_io->blockBuilder->getVolumeBitMap()->isBlockInUse(m_io, sizeRecord->tailBlock)) {
+            return false;
+        }
+        auto tail(std::make_shared<FileBlock>(m_io, sizeRecord->tailBlock, m_openDisposition, m_stream));
+        uint64_t const precedingBytes = (sizeRecord->blockCount - 1) * blockWriteSpace(m_io);
+        if (tail->getNextIndex() != tail->getIndex() ||
+            precedingBytes + tail->getDataBytesWritten() != sizeRecord->fileSize) {
+            return false;
+        }
+
+        // likewise a start block that has since been reused for a shorter
+        // file won't be full and linked on to a further block
+        if (sizeRecord->blockCount > 1) {
+            FileBlock start(m_io, m_startVolumeBlock, m_openDisposition, m_stream);
+            if (start.getNextIndex() == start.getIndex() ||
+                start.getDataBytesWritten() != blockWriteSpace(m_io)) {
+                return false;
+            }
+        }
+
+        m_stream = tail->getStream();
+        m_fileSize = sizeRecord->fileSize;
+        m_blockIndices.assign(1, tail->getIndex());
+        m_unmappedBlocks = sizeRecord->blockCount - 1;
+        m_blockIndex = 0;
+        (void)tail->seek(tail->getDataBytesWritten());
+        m_workingBlock = tail;
+        m_pos = m_fileSize;
+        return true;
+    }
+
+    void
+    File::mapAllBlocks() const
+    {
+        if (m_unmappedBlocks == 0) {
+            return;
+        }
+        std::vector<uint64_t> indices;
+        indices.reserve(m_unmappedBlocks + m_blockIndices.size());
+        FileBlockIterator block(m_io, m_startVolumeBlock, m_openDisposition, m_stream);
+        for (uint64_t i = 0; i < m_unmappedBlocks; ++i, ++block) {
+            indices.push_back(block->getIndex());
+        }
+        indices.insert(indices.end(), m_blockIndices.begin(), m_blockIndices.end());
+        m_blockIndices.swap(indices);
+        m_blockIndex += m_unmappedBlocks;
+        m_unmappedBlocks = 0;
+    }
+
     void
     File::writeBufferedDataToWorkingBlock(uint32_t const bytes)
     {
@@ -233,7 +909,7 @@ namespace knoxcrypt
         // is always updates after reads/writes
         uint32_t const bytesWritten = m_workingBlock->tell();
 
-        if (bytesWritten < blockWriteSpace()) {
+        if (bytesWritten < blockWriteSpace(m_io)) {
             return true;
         }
         return false;
@@ -241,16 +917,19 @@ namespace knoxcrypt
     }
 
     void
-    File::checkAndUpdateWorkingBlockWithNew() const
+    File::checkAndUpdateWorkingBlockWithNew(uint64_t const blocksExpected) const
     {
         // first case no file blocks so absolutely need one to write to
         if (!m_workingBlock) {
 
-            newWritableFileBlock();
+            newWritableFileBlock(blocksExpected);
 
             // when writing the file, the working block will be empty
-            // and the start volume block will be unset so need to set now
-            m_startVolumeBlock = m_workingBlock->getIndex();
+            // and the start volume block will be unset so need to set now.
+            // An indexed file's start block is its index root instead
+            if (m_layout == FileLayout::Chained) {
+                m_startVolumeBlock = m_workingBlock->getIndex();
+            }
             return;
         }
 
@@ -267,23 +946,27 @@ namespace knoxcrypt
                 // if the reported stream position in the block is less that
                 // the block's total capacity, then we don't create a new block
                 // we simply overwrite
-                if (m_workingBlock->tell() < blockWriteSpace()) {
+                if (m_workingBlock->tell() < blockWriteSpace(m_io)) {
                     return;
                 }
 
                 // edge case; if right at the very end of the block, need to
                 // iterate the block index and return if possible
-                if (m_workingBlock->tell() == blockWriteSpace()) {
+                if (m_workingBlock->tell() == blockWriteSpace(m_io)) {
                     ++m_blockIndex;
+                    if (m_blockIndices[m_blockIndex] == HOLE_BLOCK) {
+                        fillHole(m_blockIndex);
+                        return;
+                    }
                     m_workingBlock = std::make_shared<FileBlock>(m_io,
-                                                                   m_workingBlock->getNextIndex(),
+                                                                   m_blockIndices[m_blockIndex],
                                                                    m_openDisposition,
                                                                    m_stream);
                     return;
                 }
 
             }
-            newWritableFileBlock();
+            newWritableFileBlock(blocksExpected);
 
             return;
         }
@@ -300,7 +983,7 @@ namespace knoxcrypt
         // the stream position is subtracted since block may have already
         // had bytes written to it in which case the available size left
         // is approx. block size - stream position
-        return (blockWriteSpace()) - streamPosition;
+        return (blockWriteSpace(m_io)) - streamPosition;
     }
 
     std::streamsize
@@ -309,29 +992,52 @@ namespace knoxcrypt
         if (m_openDisposition.readWrite() == ReadOrWriteOrBoth::WriteOnly) {
             throw FileEntryException(FileEntryError::NotReadable);
         }
+        allocatePendingBlocks();
+
+        // an indexed file that has been emptied has nothing to read from
+        // and nor does the space beyond the end of a file
+        if (m_blockIndices.empty() || static_cast<uint64_t>(m_pos) > m_fileSize) {
+            return 0;
+        }
 
         // read block data
         uint32_t read(0);
         uint64_t offset(0);
         while (read < n) {
 
-            // there are n-read bytes left to read so try and read that many!
-            uint32_t count = readWorkingBlockBytes(n - read);
-            read += count;
+            // a hole reads back as zeros; there's nothing to decrypt
+            if (inHole()) {
+                auto const count = readHoleBytes(s + offset, n - read);
+                read += count;
+                offset += count;
+                m_pos += count;
+                continue;
+            }
 
-            // optimization; use this rather than for loop
-            // copies from m_buffer to s + offset
-            std::copy(&m_buffer[0], &m_buffer[count], s + offset);
+            // reads spanning more than a block read as many of the blocks
+            // as are physically consecutive together
+            if (m_workingBlock->tell() == 0 && static_cast<uint64_t>(n - read) > blockWriteSpace(m_io)) {
+                auto const count = readBlockRun(s + offset, n - read);
+                if (count > 0) {
+                    read += count;
+                    offset += count;
+                    m_pos += count;
+                    continue;
+                }
+            }
 
+            // there are n-read bytes left to read so try and read that many!
+            auto const blockIndex = m_blockIndex;
+            uint32_t count = readWorkingBlockBytes(s + offset, n - read);
+            read += count;
             offset += count;
+            m_pos += count;
 
-            // edge case bug fix
-            if (count == 0) { break;}
+            // edge case bug fix; nothing is read from a block that was
+            // already at its end but the next block can still be read
+            if (count == 0 && m_blockIndex == blockIndex) { break;}
         }
 
-        // update stream position
-        m_pos += read;
-
         return read;
     }
 
@@ -365,11 +1071,45 @@ namespace knoxcrypt
             throw FileEntryException(FileEntryError::NotWritable);
         }
 
+        // writing beyond the end of an indexed file leaves a hole in between
+        if (static_cast<uint64_t>(m_pos) > m_fileSize) {
+            extendWithHole(m_pos);
+        }
+
         std::streamsize wrote(0);
         while (wrote < n) {
 
+            // a block of a hole is only allocated once written to. Writing
+            // to a hole is always an overwrite since a hole is never at the
+            // end of the file
+            if (inHole()) {
+                m_openDisposition = OpenDisposition::buildOverwriteDisposition();
+                uint64_t const offset = holeOffset();
+                if (offset == blockWriteSpace(m_io)) {
+                    ++m_blockIndex;
+                    openWorkingBlock(m_blockIndex);
+                    continue;
+                }
+                fillHole(m_blockIndex);
+                (void)m_workingBlock->seek(offset);
+            }
+
+            // with delayed allocation, data that would need a new block is
+            // held back until flush; blocks can then be allocated as a batch
+            if (shouldDelayAllocation()) {
+                m_pendingData.insert(m_pendingData.end(), s + wrote, s + n);
+                m_pos += (n - wrote);
+                m_fileSize += (n - wrote);
+                wrote = n;
+                if (m_pendingData.size() >= m_io->writeBufferBytes) {
+                    allocatePendingBlocks();
+                }
+                break;
+            }
+
             // check if the working block needs to be updated with a new one
-            checkAndUpdateWorkingBlockWithNew();
+            uint64_t const blocksExpected = ((n - wrote) + blockWriteSpace(m_io) - 1) / blockWriteSpace(m_io);
+            checkAndUpdateWorkingBlockWithNew(blocksExpected);
 
             // buffers the data that will be written to the working block
             // computed as a function of the data left to write and the
@@ -385,6 +1125,9 @@ namespace knoxcrypt
 
             if (m_openDisposition.append() == AppendOrOverwrite::Append) {
                 m_fileSize+=actualWritten;
+            } else if (static_cast<uint64_t>(m_pos) > m_fileSize) {
+                // an overwrite running past the end grows the file too
+                m_fileSize = m_pos;
             }
         }
         return wrote;
@@ -393,47 +1136,71 @@ namespace knoxcrypt
     void
     File::truncate(std::ios_base::streamoff newSize)
     {
-        // compute number of block required
-        auto const blockSize = blockWriteSpace();
+        allocatePendingBlocks();
+        mapAllBlocks();
 
-        // edge case
-        if (newSize < blockSize) {
-            FileBlock zeroBlock = getBlockWithIndex(0);
-            zeroBlock.setSize(newSize);
-            zeroBlock.setNextIndex(zeroBlock.getIndex());
+        // an indexed file is grown by a hole
+        if (static_cast<uint64_t>(newSize) > m_fileSize && m_layout == FileLayout::Indexed) {
+            extendWithHole(newSize);
+            recordSize();
+            return;
+        }
+        if (m_blockIndices.empty() || static_cast<uint64_t>(newSize) >= m_fileSize) {
             return;
         }
 
-        boost::iostreams::stream_offset const leftOver = newSize % blockSize;
-
-        boost::iostreams::stream_offset const roundedDown = newSize - leftOver;
-
-        uint64_t blocksRequired = roundedDown / blockSize;
-
-        // edge case
-        SharedFileBlock block;
-        if (leftOver == 0) {
-            --blocksRequired;
-            block = std::make_shared<FileBlock>(getBlockWithIndex(blocksRequired));
-            block->setSize(blockSize);
-        } else {
-            block = std::make_shared<FileBlock>(getBlockWithIndex(blocksRequired));
-            block->setSize(leftOver);
+        // the index of what will be the final block; a file always has at
+        // least one and it can't be a hole
+        auto const blockSize = blockWriteSpace(m_io);
+        uint64_t const lastBlock = (newSize == 0) ? 0 : (newSize - 1) / blockSize;
+        if (m_blockIndices[lastBlock] == HOLE_BLOCK) {
+            fillHole(lastBlock);
         }
 
+        // the blocks after the new final block are deallocated together;
+        // the blocks of a hole were never allocated
+        std::vector<uint64_t> toFree;
+        for (auto it = m_blockIndices.begin() + lastBlock + 1; it != m_blockIndices.end(); ++it) {
+            if (*it == HOLE_BLOCK) {
+                --m_holeBlocks;
+            } else {
+                toFree.push_back(*it);
+            }
+        }
+        auto block(std::make_shared<FileBlock>(getBlockWithIndex(lastBlock)));
+        block->setSize(newSize - (lastBlock * blockSize));
         block->setNextIndex(block->getIndex());
 
-        m_blockCount = blocksRequired;
-
+        // the index is cut back so that its last extent ends at the new final
+        // block and written out before the dropped blocks can be reallocated
+        if (m_layout == FileLayout::Indexed) {
+            uint64_t blocksLeft = lastBlock + 1;
+            size_t e = 0;
+            for (; blocksLeft > m_extents[e].second; ++e) {
+                blocksLeft -= m_extents[e].second;
+            }
+            m_extents[e].second = blocksLeft;
+            m_extents.resize(e + 1);
+            m_firstDirtyExtent = std::min(m_firstDirtyExtent.get_value_or(e), e);
+            writeIndex();
+        }
+        detail::deallocateBlocks(*m_io->blockBuilder->getVolumeBitMap(), m_io, toFree);
+
+        m_blockIndices.resize(lastBlock + 1);
+        m_fileSize = newSize;
+        m_blockIndex = lastBlock;
+        m_workingBlock = block;
+        (void)m_workingBlock->seek(m_workingBlock->getDataBytesWritten());
+        m_pos = newSize;
+        recordSize();
     }
 
     using SeekPair = std::pair<int64_t, boost::iostreams::stream_offset>;
     SeekPair
-    getPositionFromBegin(boost::iostreams::stream_offset off)
+    getPositionFromBegin(boost::iostreams::stream_offset off, boost::iostreams::stream_offset const blockSize)
     {
         // find what file block the offset would relate to and set extra offset in file block
         // to that position
-        auto const blockSize = blockWriteSpace();
         boost::iostreams::stream_offset casted = off;
         boost::iostreams::stream_offset const leftOver = casted % blockSize;
         int64_t block = 0;
@@ -448,7 +1215,9 @@ namespace knoxcrypt
                 blockPosition = leftOver;
 
             } else {
-                blockPosition = 0;
+                // an offset on a block boundary is at the end of the
+                // preceding block, as when the offset is blockSize
+                blockPosition = blockSize;
             }
 
             // get exact number of blocks after round-down
@@ -468,16 +1237,16 @@ namespace knoxcrypt
 
     SeekPair
     getPositionFromEnd(boost::iostreams::stream_offset off, int64_t endBlockIndex,
-                       boost::iostreams::stream_offset bytesWrittenToEnd)
+                       boost::iostreams::stream_offset bytesWrittenToEnd,
+                       boost::iostreams::stream_offset const blockSize)
     {
         // treat like begin and then 'inverse'
-        auto treatLikeBegin = getPositionFromBegin(std::abs(off));
+        auto treatLikeBegin = getPositionFromBegin(std::abs(off), blockSize);
 
         int64_t block = endBlockIndex - treatLikeBegin.first;
         auto blockPosition = bytesWrittenToEnd - treatLikeBegin.second;
 
         if (blockPosition < 0) {
-            uint16_t const blockSize = blockWriteSpace();
             blockPosition = blockSize + blockPosition;
             --block;
         }
@@ -489,11 +1258,11 @@ namespace knoxcrypt
     SeekPair
     getPositionFromCurrent(boost::iostreams::stream_offset off,
                            int64_t blockIndex,
-                           boost::iostreams::stream_offset indexedBlockPosition)
+                           boost::iostreams::stream_offset indexedBlockPosition,
+                           boost::iostreams::stream_offset const blockSize)
     {
         // find what file block the offset would relate to and set extra offset in file block
         // to that position
-        auto const blockSize = blockWriteSpace();
         auto addition = off + indexedBlockPosition;
         auto leftOver = std::abs(addition) % blockSize;
         auto roundedDown = std::abs(addition) - leftOver;
@@ -512,6 +1281,36 @@ namespace knoxcrypt
     boost::iostreams::stream_offset
     File::seek(boost::iostreams::stream_offset off, std::ios_base::seekdir way)
     {
+        allocatePendingBlocks();
+        mapAllBlocks();
+
+        // an indexed file can be seeked beyond its end; the gap becomes a
+        // hole if the file is then written to
+        boost::iostreams::stream_offset const target = (way == std::ios_base::beg) ? off :
+                                                       (way == std::ios_base::cur) ? m_pos + off :
+                                                       m_fileSize + off;
+        if (target > static_cast<boost::iostreams::stream_offset>(m_fileSize) &&
+            m_layout == FileLayout::Indexed &&
+            m_openDisposition.readWrite() != ReadOrWriteOrBoth::ReadOnly) {
+            m_pos = target;
+            return off;
+        }
+
+        // the working block isn't moved by a seek beyond the end so from
+        // there, the seek can't be relative to it
+        if (way == std::ios_base::cur && static_cast<uint64_t>(m_pos) > m_fileSize) {
+            return (this->seek(target) == -1) ? -1 : off;
+        }
+
+        // a file without any blocks can only be at its beginning
+        if (m_blockIndices.empty()) {
+            if ((way == std::ios_base::cur ? m_pos + off : off) != 0) {
+                return -1;
+            }
+            m_pos = 0;
+            return off;
+        }
+
         // reset any offset values to zero but only if not seeking from the current
         // position. When seeking from the current position, we need to keep
         // track of the original block offset
@@ -525,9 +1324,10 @@ namespace knoxcrypt
         SeekPair seekPair;
         if (way == std::ios_base::end) {
 
-            size_t endBlock = m_blockCount - 1;
+            size_t endBlock = m_blockIndices.size() - 1;
             seekPair = getPositionFromEnd(off, endBlock,
-                                          getBlockWithIndex(endBlock).getDataBytesWritten());
+                                          getBlockWithIndex(endBlock).getDataBytesWritten(),
+                                          blockWriteSpace(m_io));
 
         }
 
@@ -536,26 +1336,31 @@ namespace knoxcrypt
         // if seeking from the beginning
 
         if (way == std::ios_base::beg) {
-            seekPair = getPositionFromBegin(off);
+            seekPair = getPositionFromBegin(off, blockWriteSpace(m_io));
         }
         // seek relative to the current position
         if (way == std::ios_base::cur) {
             seekPair = getPositionFromCurrent(off, m_blockIndex,
-                                              m_workingBlock->tell());
+                                              m_workingBlock ? m_workingBlock->tell() : holeOffset(),
+                                              blockWriteSpace(m_io));
         }
 
         // check bounds and error if too big
-        if (static_cast<uint64_t>(seekPair.first) >= m_blockCount || seekPair.first < 0) {
+        if (static_cast<uint64_t>(seekPair.first) >= m_blockIndices.size() || seekPair.first < 0) {
             return -1; // fail
         } else {
 
             // update block where we start reading/writing from
             m_blockIndex = seekPair.first;
-            m_workingBlock = std::make_shared<FileBlock>(this->getBlockWithIndex(m_blockIndex));
+            if (m_blockIndices[m_blockIndex] == HOLE_BLOCK) {
+                m_workingBlock = nullptr;
+            } else {
+                m_workingBlock = std::make_shared<FileBlock>(this->getBlockWithIndex(m_blockIndex));
 
-            // set the position to seek to for given block
-            // this will be the point from which we read or write
-            m_workingBlock->seek(seekPair.second);
+                // set the position to seek to for given block
+                // this will be the point from which we read or write
+                m_workingBlock->seek(seekPair.second);
+            }
 
             switch (way) {
               case std::ios_base::cur:
@@ -582,15 +1387,74 @@ namespace knoxcrypt
         return m_pos;
     }
 
+    boost::iostreams::stream_offset
+    File::nextDataOffset(uint64_t const from) const
+    {
+        return nextOffset(from, false);
+    }
+
+    boost::iostreams::stream_offset
+    File::nextHoleOffset(uint64_t const from) const
+    {
+        return nextOffset(from, true);
+    }
+
+    boost::iostreams::stream_offset
+    File::nextOffset(uint64_t const from, bool const hole) const
+    {
+        allocatePendingBlocks();
+        if (from >= m_fileSize) {
+            return -1;
+        }
+        if (m_holeBlocks == 0) {
+            return hole ? m_fileSize : from;
+        }
+
+        // the extents are walked rather than the block map; the end of the
+        // file counts as a hole
+        uint64_t const space = blockWriteSpace(m_io);
+        uint64_t start = 0;
+        for (auto const &extent : m_extents) {
+            uint64_t const end = std::min(start + (extent.second * space), m_fileSize);
+            if (end > from && (extent.first == HOLE_BLOCK) == hole) {
+                return std::max(start, from);
+            }
+            start = end;
+        }
+        return hole ? m_fileSize : -1;
+    }
+
     void
     File::flush()
     {
-        writeBufferedDataToWorkingBlock(m_buffer.size());
-        if (m_optionalSizeCallback) {
-            (*m_optionalSizeCallback)(m_fileSize);
+        // a file opened for reading has nothing to write out
+        if (m_openDisposition.readWrite() == ReadOrWriteOrBoth::ReadOnly) {
+            return;
+        }
+        allocatePendingBlocks();
+        std::vector<uint8_t>().swap(m_pendingData);
+        writeIndex();
+        if (m_workingBlock) {
+            writeBufferedDataToWorkingBlock(m_buffer.size());
+        }
+        recordSize();
+    }
+
+    void
+    File::recordSize() const
+    {
+        if (m_optionalSizeCallback && m_openDisposition.readWrite() != ReadOrWriteOrBoth::ReadOnly) {
+            (*m_optionalSizeCallback)(sizeRecord());
         }
     }
 
+    void
+    File::sync()
+    {
+        flush();
+        ContainerImageStream::sync(m_io);
+    }
+
     void
     File::reset()
     {
@@ -600,24 +1464,48 @@ namespace knoxcrypt
     void
     File::doReset()
     {
+        std::vector<uint8_t>().swap(m_pendingData);
         m_fileSize = 0;
-        m_blockCount = 0;
+        m_blockIndices.clear();
+        m_unmappedBlocks = 0;
+        m_holeBlocks = 0;
         m_workingBlock = nullptr;
         m_blockIndex = 0;
+        m_indexBlocks.clear();
+        m_extents.clear();
+        m_firstDirtyExtent = boost::none;
     }
 
     void
     File::unlink()
     {
-        // loop over all file blocks and update the volume bitmap indicating
-        // that block is no longer in use
-        FileBlockIterator it(m_io, m_startVolumeBlock, m_openDisposition, m_stream);
-        FileBlockIterator end;
-
-        for (; it != end; ++it) {
-            it->unlink();
-            ++m_io->freeBlocks;
+        std::vector<uint64_t> blocks;
+        bool const hadBlocks = !m_blockIndices.empty() || !m_indexBlocks.empty();
+        unlink(blocks);
+        detail::deallocateBlocks(*m_io->blockBuilder->getVolumeBitMap(), m_io, blocks);
+
+        // an entry might still refer to the start block (e.g. when opened
+        // with truncation) so it's reset to an empty block, which for an
+        // indexed file is an empty index. Other blocks keep their stale
+        // headers until they're next allocated
+        if (hadBlocks) {
+            FileBlock startBlock(m_io, m_startVolumeBlock, m_startVolumeBlock,
+                                 OpenDisposition::buildAppendDisposition(), m_stream);
+            startBlock.writeNewBlock(nullptr, 0, m_startVolumeBlock);
+            startBlock.getStream()->flushUnlessBuffered();
         }
+    }
+
+    void
+    File::unlink(std::vector<uint64_t> &blocks)
+    {
+        // data still waiting for blocks has nowhere to be unlinked from
+        std::vector<uint8_t>().swap(m_pendingData);
+
+        mapAllBlocks();
+        std::copy_if(m_blockIndices.begin(), m_blockIndices.end(), std::back_inserter(blocks),
+                     [](uint64_t const block) { return block != HOLE_BLOCK; });
+        blocks.insert(blocks.end(), m_indexBlocks.begin(), m_indexBlocks.end());
 
         doReset();
     }
@@ -631,19 +1519,10 @@ namespace knoxcrypt
     FileBlock
     File::getBlockWithIndex(uint64_t n) const
     {
-
-        {
-            FileBlockIterator it(m_io, m_startVolumeBlock, m_openDisposition, m_stream);
-            FileBlockIterator end;
-            uint64_t c(0);
-            for (; it != end; ++it) {
-                if (c==n) {
-                    return *it;
-                }
-                ++c;
-            }
+        mapAllBlocks();
+        if (n >= m_blockIndices.size()) {
+            throw std::runtime_error("Whoops! Something went wrong in File::getBlockWithIndex");
         }
-
-        throw std::runtime_error("Whoops! Something went wrong in File::getBlockWithIndex");
+        return FileBlock(m_io, m_blockIndices[n], m_openDisposition, m_stream);
     }
 }
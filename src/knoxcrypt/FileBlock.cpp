@@ -31,6 +31,7 @@
 #include "knoxcrypt/FileBlockBuilder.hpp"
 #include "knoxcrypt/FileBlockException.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace knoxcrypt
@@ -54,7 +55,7 @@ namespace knoxcrypt
         , m_stream(stream)
     {
         // set m_offset
-        m_offset = detail::getOffsetOfFileBlock(m_index, io->blocks);
+        m_offset = detail::getOffsetOfFileBlock(m_index, io->blocks, io->blockSize);
     }
 
     FileBlock::FileBlock(SharedCoreIO const &io,
@@ -65,26 +66,19 @@ namespace knoxcrypt
         , m_index(index)
         , m_bytesWritten(0)
         , m_next(0)
-        , m_offset(detail::getOffsetOfFileBlock(index, io->blocks))
+        , m_offset(detail::getOffsetOfFileBlock(index, io->blocks, io->blockSize))
         , m_seekPos(0)
         , m_openDisposition(openDisposition)
         , m_bytesToWriteOnFlush(0)
         , m_stream(stream)
     {
-        // set m_offset
+        // read m_bytesWritten and m_next together
         initImageStream();
-        detail::checkAndSeekG(*m_stream, m_offset);
-
-        // read m_bytesWritten
-        uint8_t sizeDat[4];
-        (void)m_stream->read((char*)sizeDat, 4);
-        m_bytesWritten = detail::convertInt4ArrayToInt32(sizeDat);
+        uint8_t header[detail::FILE_BLOCK_META];
+        (void)m_stream->readAt((char*)header, detail::FILE_BLOCK_META, m_offset);
+        m_bytesWritten = detail::convertInt4ArrayToInt32(header);
         m_initialBytesWritten = m_bytesWritten;
-
-        // read m_next
-        uint8_t nextDat[8];
-        (void)m_stream->read((char*)nextDat, 8);
-        m_next = detail::convertInt8ArrayToInt64(nextDat);
+        m_next = detail::convertInt8ArrayToInt64(header + 4);
 
         assert(!m_stream->bad());
     }
@@ -137,8 +131,7 @@ namespace knoxcrypt
 
             // open the image stream for reading
             initImageStream();
-            detail::checkAndSeekG(*m_stream, m_offset + detail::FILE_BLOCK_META + m_seekPos);
-            (void)m_stream->read((char*)buf, n);
+            (void)m_stream->readAt((char*)buf, n, m_offset + detail::FILE_BLOCK_META + m_seekPos);
 
             // update the stream position
             m_seekPos += n;
@@ -158,11 +151,9 @@ namespace knoxcrypt
         // open the image stream for writing
         this->initImageStream();
 
-        if(!detail::checkAndSeekP(*m_stream, m_offset + detail::FILE_BLOCK_META + m_seekPos)) {
+        if(m_stream->writeAt((char*)buf, n, m_offset + detail::FILE_BLOCK_META + m_seekPos).bad()) {
             throw std::runtime_error("seek in write function broke");
         }
-        assert(!m_stream->bad());
-        (void)m_stream->write((char*)buf, n);
 
         // do updates to file block metadata only if in append mode
         // note update to next index taken care of in FileEntry
@@ -194,7 +185,7 @@ namespace knoxcrypt
             doSetSize(*m_stream, m_seekPos + n);
         }
 
-        m_stream->flush();
+        m_stream->flushUnlessBuffered();
 
         // update the stream position
         m_seekPos += n;
@@ -202,6 +193,74 @@ namespace knoxcrypt
         return n;
     }
 
+    void
+    FileBlock::writeNewBlock(char const * const buf, std::streamsize const n, uint64_t const nextIndex) const
+    {
+        if (m_openDisposition.readWrite() == ReadOrWriteOrBoth::ReadOnly) {
+            throw FileBlockException(FileBlockError::NotWritable);
+        }
+        assert(n <= std::streamsize(m_io->blockSize - detail::FILE_BLOCK_META));
+
+        // the metadata directly precedes the data so both go in the one write
+        std::vector<char> whole(detail::FILE_BLOCK_META + n);
+        detail::convertInt32ToInt4Array(uint32_t(n), (uint8_t*)&whole[0]);
+        detail::convertUInt64ToInt8Array(nextIndex, (uint8_t*)&whole[4]);
+        std::copy(buf, buf + n, &whole[detail::FILE_BLOCK_META]);
+
+        this->initImageStream();
+        if(m_stream->writeAt(&whole.front(), whole.size(), m_offset).bad()) {
+            throw std::runtime_error("seek in writeNewBlock function broke");
+        }
+
+        m_bytesWritten = uint32_t(n);
+        m_initialBytesWritten = m_bytesWritten;
+        m_next = nextIndex;
+        m_seekPos = n;
+    }
+
+    void
+    FileBlock::writeNewBlockRun(FileBlock const * const blocks,
+                                size_t const count,
+                                char const * const buf,
+                                std::streamsize const n,
+                                bool const chained,
+                                uint64_t const lastNext)
+    {
+        FileBlock const &first = blocks[0];
+        if (first.m_openDisposition.readWrite() == ReadOrWriteOrBoth::ReadOnly) {
+            throw FileBlockException(FileBlockError::NotWritable);
+        }
+        uint64_t const blockSize = first.m_io->blockSize;
+        uint64_t const space = blockSize - detail::FILE_BLOCK_META;
+        assert(uint64_t(n) > (count - 1) * space && uint64_t(n) <= count * space);
+
+        // the last block is only written as far as its data goes
+        std::vector<char> whole(((count - 1) * blockSize) + detail::FILE_BLOCK_META + (n - ((count - 1) * space)));
+        for (size_t i = 0; i < count; ++i) {
+            FileBlock const &block = blocks[i];
+            uint64_t const offset = i * space;
+            uint32_t const bytes = uint32_t(std::min(space, uint64_t(n) - offset));
+            uint64_t next = lastNext;
+            if (i + 1 < count) {
+                next = chained ? blocks[i + 1].m_index : block.m_index;
+            }
+            char * const header = &whole[i * blockSize];
+            detail::convertInt32ToInt4Array(bytes, (uint8_t*)header);
+            detail::convertUInt64ToInt8Array(next, (uint8_t*)header + 4);
+            std::copy(buf + offset, buf + offset + bytes, header + detail::FILE_BLOCK_META);
+
+            block.m_bytesWritten = bytes;
+            block.m_initialBytesWritten = bytes;
+            block.m_next = next;
+            block.m_seekPos = bytes;
+        }
+
+        first.initImageStream();
+        if(first.m_stream->writeAt(&whole.front(), whole.size(), first.m_offset).bad()) {
+            throw std::runtime_error("seek in writeNewBlockRun function broke");
+        }
+    }
+
     uint32_t
     FileBlock::getDataBytesWritten() const
     {
@@ -229,10 +288,8 @@ namespace knoxcrypt
     void
     FileBlock::registerBlockWithVolumeBitmap()
     {
-        this->initImageStream();
-        detail::updateVolumeBitmapWithOne(*m_stream, m_index, m_io->blocks);
+        detail::updateVolumeBitmapWithOne(*m_io->blockBuilder->getVolumeBitMap(), m_io, m_index);
         m_io->freeBlocks--;
-        m_stream->flush();
     }
 
     void
@@ -240,7 +297,7 @@ namespace knoxcrypt
     {
         this->initImageStream();
         doSetSize(*m_stream, m_seekPos);
-        m_stream->flush();
+        m_stream->flushUnlessBuffered();
     }
 
     void
@@ -250,17 +307,16 @@ namespace knoxcrypt
         doSetSize(*m_stream, size);
         m_initialBytesWritten = size;
         m_bytesWritten = size;
-        m_stream->flush();
+        m_stream->flushUnlessBuffered();
     }
 
     void
     FileBlock::doSetSize(ContainerImageStream &stream, std::ios_base::streamoff size) const
     {
         // update m_bytesWritten
-        (void)stream.seekp(m_offset);
         uint8_t sizeDat[4];
         detail::convertInt32ToInt4Array(size, sizeDat);
-        (void)stream.write((char*)sizeDat, 4);
+        (void)stream.writeAt((char*)sizeDat, 4, m_offset);
     }
 
     void
@@ -269,24 +325,23 @@ namespace knoxcrypt
         this->initImageStream();
         doSetNextIndex(*m_stream, nextIndex);
         m_next = nextIndex;
-        m_stream->flush();
+        m_stream->flushUnlessBuffered();
     }
 
     void
     FileBlock::doSetNextIndex(ContainerImageStream &stream, uint64_t nextIndex) const
     {
         // update m_next
-        (void)stream.seekp(m_offset + 4);
         uint8_t nextDat[8];
         detail::convertUInt64ToInt8Array(nextIndex, nextDat);
-        (void)stream.write((char*)nextDat, 8);
+        (void)stream.writeAt((char*)nextDat, 8, m_offset + 4);
     }
 
     void
     FileBlock::unlink()
     {
         this->initImageStream();
-        detail::updateVolumeBitmapWithOne(*m_stream, m_index, m_io->blocks, false);
+        detail::updateVolumeBitmapWithOne(*m_io->blockBuilder->getVolumeBitMap(), m_io, m_index, false);
         doSetNextIndex(*m_stream, m_index);
         doSetSize(*m_stream, 0);
         m_next = m_index;
@@ -294,7 +349,7 @@ namespace knoxcrypt
         m_bytesWritten = 0;
         m_seekPos = 0;
         m_positionBeforeWrite = 0;
-        m_stream->flush();
+        m_stream->flushUnlessBuffered();
     }
 
     bool
@@ -30,21 +30,35 @@
 #include "knoxcrypt/ContainerImageStream.hpp"
 #include "knoxcrypt/detail/Detailknoxcrypt.hpp"
 
+#include <stdexcept>
+
 namespace knoxcrypt
 {
 
     namespace
     {
 
-        knoxcrypt::BlockDeque populateBlockDeque(SharedCoreIO const &io)
+        /// the most free blocks held in the deque at any one time
+        uint64_t const BLOCK_BATCH = 1024;
+
+        knoxcrypt::BlockDeque populateBlockDeque(SharedCoreIO const &io,
+                                                 VolumeBitMap &volumeBitMap,
+                                                 uint64_t &cursor)
         {
-            // obtain all available blocks and store in a map for quick lookup
-            knoxcrypt::ContainerImageStream stream(io, std::ios::in | std::ios::out | std::ios::binary);
-            auto allBlocks = detail::getNAvailableBlocks(stream,
-                                                         io->freeBlocks,
-                                                         io->blocks);
-            BlockDeque deque(allBlocks.begin(), allBlocks.end());
-            return deque;
+            // obtain the next batch of available blocks after the cursor rather
+            // than every available block, so memory doesn't grow with free space;
+            // note the in-memory bitmap is used since it might hold allocations
+            // that haven't yet been written back to the image
+            auto blocks = volumeBitMap.getNAvailableBlocks(io, BLOCK_BATCH, cursor);
+            if (blocks.empty() && cursor != 0) {
+                // wrap around to pick up blocks freed behind the cursor
+                cursor = 0;
+                blocks = volumeBitMap.getNAvailableBlocks(io, BLOCK_BATCH, cursor);
+            }
+            if (!blocks.empty()) {
+                cursor = blocks.back() + 1;
+            }
+            return BlockDeque(blocks.begin(), blocks.end());
         }
 
         void checkAndInitStream(SharedCoreIO const & io, SharedImageStream &stream)
@@ -63,28 +77,36 @@ namespace knoxcrypt
         {
             checkAndInitStream(io, stream);
 
-            (void)stream->seekp(0, std::ios::end);
-            auto toReturn = stream->tellp();
-            stream->seekp(0);
+            auto toReturn = stream->size();
             uint64_t const volumeBitMapBytes = io->blocks / uint64_t(8);
             toReturn -= (detail::beginning() + 8 /* block count */ + volumeBitMapBytes + 8 /* count */);
             if(toReturn == 0) { // no block written yet
                 return 0;
             }
 
-            return (toReturn / (detail::FILE_BLOCK_META + detail::FILE_BLOCK_SIZE));
+            // note the block size includes the block's metadata
+            return (toReturn / io->blockSize);
         }
     }
 
 
     FileBlockBuilder::FileBlockBuilder()
-      : m_blocksWritten(0)
+      : m_volumeBitMap(std::make_shared<VolumeBitMap>())
+      , m_blockDeque()
+      , m_blockCursor(0)
+      , m_allocationGroups()
+      , m_mutex()
+      , m_blocksWritten(0)
     {
 
     }
 
-    FileBlockBuilder::FileBlockBuilder(SharedCoreIO const &io)
-        : m_blockDeque(populateBlockDeque(io))
+    FileBlockBuilder::FileBlockBuilder(SharedCoreIO const &)
+        : m_volumeBitMap(std::make_shared<VolumeBitMap>())
+        , m_blockDeque()
+        , m_blockCursor(0)
+        , m_allocationGroups()
+        , m_mutex()
         , m_blocksWritten(0)
     {
 
@@ -94,7 +116,9 @@ namespace knoxcrypt
     FileBlockBuilder::buildWritableFileBlock(SharedCoreIO const &io,
                                              OpenDisposition const &openDisposition,
                                              SharedImageStream &stream,
-                                             bool const enforceRootBlock)
+                                             bool const enforceRootBlock,
+                                             VolumeBitMap::OptionalBlock const &goal,
+                                             uint64_t const blocksExpected)
     {
         // note building a new block to write to should always be in append mode
         uint64_t id;
@@ -104,30 +128,47 @@ namespace knoxcrypt
             id = io->rootBlock;
         } else {
 
-            if(io->useBlockCache) {
-                id = m_blockDeque.front();
-                m_blockDeque.pop_front();
-                // attempt to refill cache with blocks
+            VolumeBitMap::OptionalBlock block;
+            if(io->useBlockCache && io->useExtentAllocation) {
+                block = m_allocationGroups.allocate(io, *m_volumeBitMap, goal, blocksExpected);
+            } else if(io->useBlockCache) {
+                BuilderLock lock(m_mutex);
+                // the cache is filled on demand rather than on construction
+                // so that mounting doesn't have to read in the whole bitmap
                 if(m_blockDeque.empty()) {
-                    populateBlockDeque(io).swap(m_blockDeque);
+                    populateBlockDeque(io, *m_volumeBitMap, m_blockCursor).swap(m_blockDeque);
+                }
+                if(!m_blockDeque.empty()) {
+                    block = m_blockDeque.front();
+                    m_blockDeque.pop_front();
                 }
             } else {
-                checkAndInitStream(io, stream);
-                id = *(detail::getNextAvailableBlock(*stream, io->blocks));
+                block = m_volumeBitMap->getNextAvailableBlock(io);
+            }
+            if(!block) {
+                throw std::runtime_error("No free blocks left in image");
             }
+            id = *block;
         }
 
         // check if block data is actually written into iomage structure (might not have been
         // if image is sparse).
-        if(m_blocksWritten == 0) {
-            m_blocksWritten = getInitialBlocksWritten(io, stream);
-        }
-        if(id >= m_blocksWritten) {
-            checkAndInitStream(io, stream);
-            detail::writeBlock(io, *stream, id);
-            stream->flush();
-            stream->close();
-            ++m_blocksWritten;
+        {
+            BuilderLock lock(m_mutex);
+            if(m_blocksWritten == 0) {
+                m_blocksWritten = getInitialBlocksWritten(io, stream);
+            }
+            if(id >= m_blocksWritten) {
+                // blocks aren't necessarily handed out in order so any skipped
+                // over blocks are written too; that way every block before
+                // m_blocksWritten is known to be in the image
+                checkAndInitStream(io, stream);
+                for (; m_blocksWritten <= id; ++m_blocksWritten) {
+                    detail::writeBlock(io, *stream, m_blocksWritten);
+                }
+                stream->flush();
+                stream->close();
+            }
         }
 
         return FileBlock(io, id, id, openDisposition, stream);
@@ -139,9 +180,16 @@ namespace knoxcrypt
                                      OpenDisposition const &openDisposition,
                                      SharedImageStream &stream)
     {
+        BuilderLock lock(m_mutex);
         if(m_blocksWritten == 0) {
             m_blocksWritten = getInitialBlocksWritten(io, stream);
         }
         return FileBlock(io, index, openDisposition, stream);
     }
+
+    SharedVolumeBitMap
+    FileBlockBuilder::getVolumeBitMap() const
+    {
+        return m_volumeBitMap;
+    }
 }
@@ -49,9 +49,20 @@ namespace knoxcrypt
     std::streamsize
     FileDevice::write(const char* s, std::streamsize n)
     {
-        std::streamsize wrote = m_entry->write(s, n);
+        return m_entry->write(s, n);
+    }
+
+    bool
+    FileDevice::flush()
+    {
+        m_entry->flush();
+        return true;
+    }
+
+    void
+    FileDevice::close()
+    {
         m_entry->flush();
-        return wrote;
     }
 
     std::streampos
@@ -0,0 +1,147 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/IOQueue.hpp"
+
+#include <system_error>
+
+namespace knoxcrypt
+{
+    IOQueue::IOQueue(size_t const depth)
+        : m_depth(depth)
+        , m_submitted()
+        , m_pending()
+        , m_mutex()
+        , m_work()
+        , m_done()
+        , m_stopping(false)
+        , m_worker()
+    {
+        if (m_depth == 0) {
+            return;
+        }
+        try {
+            m_worker = std::thread(&IOQueue::run, this);
+        } catch (std::system_error const &) {
+            // no threads to be had so transfers are made as submitted
+        }
+    }
+
+    IOQueue::~IOQueue()
+    {
+        if (m_worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+                m_pending.clear();
+            }
+            m_work.notify_one();
+            m_worker.join();
+        }
+    }
+
+    void
+    IOQueue::submit(Operation const &operation, Completion const &completion)
+    {
+        if (!m_worker.joinable()) {
+            completion(operation());
+            return;
+        }
+
+        while (m_submitted.size() >= m_depth) {
+            completeOldest();
+        }
+        auto request(std::make_shared<Request>());
+        request->operation = operation;
+        request->completion = completion;
+        request->result = 0;
+        request->done = false;
+        m_submitted.push_back(request);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(request);
+        }
+        m_work.notify_one();
+    }
+
+    void
+    IOQueue::wait()
+    {
+        while (!m_submitted.empty()) {
+            completeOldest();
+        }
+    }
+
+    bool
+    IOQueue::isAsynchronous() const
+    {
+        return m_worker.joinable();
+    }
+
+    void
+    IOQueue::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_work.wait(lock, [this]{ return m_stopping || !m_pending.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            auto request(m_pending.front());
+            m_pending.pop_front();
+            lock.unlock();
+            std::streamsize result = 0;
+            std::exception_ptr error;
+            try {
+                result = request->operation();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            lock.lock();
+            request->result = result;
+            request->error = error;
+            request->done = true;
+            m_done.notify_one();
+        }
+    }
+
+    void
+    IOQueue::completeOldest()
+    {
+        auto request(m_submitted.front());
+        m_submitted.pop_front();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&request]{ return request->done; });
+        }
+        if (request->error) {
+            std::rethrow_exception(request->error);
+        }
+        request->completion(request->result);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/ImageCacheAdvisor.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace knoxcrypt
+{
+    namespace
+    {
+        // how much is read, in whole pages, before the pages are dropped
+        std::streamoff const DROP_BYTES = 1024 * 1024;
+
+        void dropRange(int const fd, std::streamoff const offset, std::streamoff const bytes)
+        {
+#ifdef POSIX_FADV_DONTNEED
+            (void)::posix_fadvise(fd, offset, bytes, POSIX_FADV_DONTNEED);
+#else
+            (void)fd;
+            (void)offset;
+            (void)bytes;
+#endif
+        }
+    }
+
+    ImageCacheAdvisor::ImageCacheAdvisor(std::string const &path)
+        : m_fd(::open(path.c_str(), O_RDONLY))
+        , m_low(0)
+        , m_high(0)
+        , m_bytes(0)
+    {
+    }
+
+    ImageCacheAdvisor::~ImageCacheAdvisor()
+    {
+        if (m_fd >= 0) {
+            dropRead();
+            (void)::close(m_fd);
+        }
+    }
+
+    void
+    ImageCacheAdvisor::read(std::streamoff const offset, std::streamsize const n)
+    {
+        if (m_fd < 0 || offset < 0 || n <= 0) {
+            return;
+        }
+
+        // only whole pages are dropped so take in the pages at either end
+        std::streamoff const page = ::sysconf(_SC_PAGESIZE);
+        std::streamoff const low = offset - (offset % page);
+        std::streamoff const high = ((offset + n + page - 1) / page) * page;
+        if (m_low == m_high) {
+            m_low = low;
+            m_high = high;
+        } else {
+            m_low = std::min(m_low, low);
+            m_high = std::max(m_high, high);
+        }
+
+        // pages in the span that weren't read are only ciphertext as well
+        m_bytes += high - low;
+        if (m_bytes >= DROP_BYTES) {
+            dropRead();
+        }
+    }
+
+    void
+    ImageCacheAdvisor::drop(std::string const &path)
+    {
+        int const fd = ::open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            dropRange(fd, 0, 0);
+            (void)::close(fd);
+        }
+    }
+
+    void
+    ImageCacheAdvisor::dropRead()
+    {
+        if (m_low != m_high) {
+            dropRange(m_fd, m_low, m_high - m_low);
+            m_low = m_high = 0;
+            m_bytes = 0;
+        }
+    }
+}
@@ -0,0 +1,288 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "knoxcrypt/MappedImage.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace knoxcrypt
+{
+    namespace
+    {
+        uint64_t const NO_PAGE = std::numeric_limits<uint64_t>::max();
+
+        // anonymous memory locked so that it never reaches swap and kept
+        // out of core dumps; null if it could not be mapped or locked
+        char *lockedMap(std::size_t const bytes)
+        {
+            void *map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (map == MAP_FAILED) {
+                return nullptr;
+            }
+            if (::mlock(map, bytes) != 0) {
+                (void)::munmap(map, bytes);
+                return nullptr;
+            }
+#ifdef MADV_DONTDUMP
+            (void)::madvise(map, bytes, MADV_DONTDUMP);
+#endif
+            return static_cast<char*>(map);
+        }
+
+        void unmap(char * const map, std::size_t const bytes)
+        {
+            std::memset(map, 0, bytes);
+            (void)::munlock(map, bytes);
+            (void)::munmap(map, bytes);
+        }
+    }
+
+    MappedImage::MappedImage(cryptostreampp::SharedCryptoStream const &stream,
+                             std::streamoff const size,
+                             uint64_t const capacity,
+                             std::shared_ptr<ImageCacheAdvisor> const &advisor)
+        : m_stream(stream)
+        , m_advisor(advisor)
+        , m_size(size)
+        , m_pageSize(::sysconf(_SC_PAGESIZE))
+        , m_slotCount(slotsFor(capacity, m_pageSize))
+        , m_slots(nullptr)
+        , m_slotOfPage()
+        , m_pageOfSlot()
+        , m_referenced()
+        , m_dirty()
+        , m_hand(0)
+    {
+        // no more slots than there are pages to put in them
+        uint64_t const pages = (m_size + m_pageSize - 1) / m_pageSize;
+        m_slotCount = std::max(std::size_t(1), std::size_t(std::min(uint64_t(m_slotCount), pages)));
+        m_slots = lockedMap(m_slotCount * m_pageSize);
+        if (!m_slots) {
+            throw std::bad_alloc();
+        }
+        m_pageOfSlot.resize(m_slotCount, NO_PAGE);
+        m_referenced.resize(m_slotCount, false);
+        m_dirty.resize(m_slotCount, false);
+    }
+
+    MappedImage::~MappedImage()
+    {
+        (void)flush();
+        unmap(m_slots, m_slotCount * m_pageSize);
+    }
+
+    bool
+    MappedImage::canLock(uint64_t const capacity)
+    {
+        std::streamoff const pageSize = ::sysconf(_SC_PAGESIZE);
+        std::size_t const bytes = slotsFor(capacity, pageSize) * pageSize;
+        char * const map = lockedMap(bytes);
+        if (!map) {
+            return false;
+        }
+        unmap(map, bytes);
+        return true;
+    }
+
+    bool
+    MappedImage::covers(std::streamoff const offset, std::streamsize const n) const
+    {
+        return offset >= 0 && offset + n <= m_size;
+    }
+
+    bool
+    MappedImage::read(char * buf, std::streamsize n, std::streamoff offset)
+    {
+        while (n > 0) {
+            std::streamoff const within = offset % m_pageSize;
+            std::streamsize const bytes = std::min(n, std::streamsize(m_pageSize - within));
+            std::size_t slot;
+            if (!slotFor(offset / m_pageSize, true, slot)) {
+                return false;
+            }
+            std::memcpy(buf, m_slots + slot * m_pageSize + within, bytes);
+            buf += bytes;
+            offset += bytes;
+            n -= bytes;
+        }
+        return true;
+    }
+
+    bool
+    MappedImage::write(char const * buf, std::streamsize n, std::streamoff offset)
+    {
+        while (n > 0) {
+            uint64_t const page = offset / m_pageSize;
+            std::streamoff const within = offset % m_pageSize;
+            std::streamsize const bytes = std::min(n, std::streamsize(m_pageSize - within));
+
+            // a page only partly overwritten needs the rest of its content first
+            std::size_t slot;
+            if (!slotFor(page, within != 0 || bytes < pageBytes(page), slot)) {
+                return false;
+            }
+            std::memcpy(m_slots + slot * m_pageSize + within, buf, bytes);
+            m_dirty[slot] = true;
+            buf += bytes;
+            offset += bytes;
+            n -= bytes;
+        }
+        return true;
+    }
+
+    bool
+    MappedImage::flush()
+    {
+        std::vector<std::pair<uint64_t, std::size_t>> written;
+        for (std::size_t slot = 0; slot < m_slotCount; ++slot) {
+            if (m_dirty[slot]) {
+                written.emplace_back(m_pageOfSlot[slot], slot);
+            }
+        }
+        std::sort(written.begin(), written.end());
+        for (auto const &pageAndSlot : written) {
+            if (!writeBack(pageAndSlot.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void
+    MappedImage::forget(std::streamoff const offset, std::streamsize const n)
+    {
+        (void)flush();
+        std::streamoff const start = std::max(std::streamoff(0), offset);
+        std::streamoff const end = std::min(m_size, offset + n);
+        if (start >= end) {
+            return;
+        }
+        uint64_t const first = start / m_pageSize;
+        uint64_t const last = (end - 1) / m_pageSize;
+        for (std::size_t slot = 0; slot < m_slotCount; ++slot) {
+            if (m_pageOfSlot[slot] >= first && m_pageOfSlot[slot] <= last) {
+                drop(slot);
+            }
+        }
+    }
+
+    void
+    MappedImage::forget()
+    {
+        (void)flush();
+        for (std::size_t slot = 0; slot < m_slotCount; ++slot) {
+            drop(slot);
+        }
+    }
+
+    std::size_t
+    MappedImage::slotsFor(uint64_t const capacity, std::streamoff const pageSize)
+    {
+        return std::max(uint64_t(1), capacity / pageSize);
+    }
+
+    bool
+    MappedImage::slotFor(uint64_t const page, bool const load, std::size_t &slot)
+    {
+        auto const found = m_slotOfPage.find(page);
+        if (found != m_slotOfPage.end()) {
+            slot = found->second;
+            m_referenced[slot] = true;
+            return true;
+        }
+
+        // sweep for a slot not used since the hand last passed it
+        while (m_pageOfSlot[m_hand] != NO_PAGE && m_referenced[m_hand]) {
+            m_referenced[m_hand] = false;
+            m_hand = (m_hand + 1) % m_slotCount;
+        }
+        slot = m_hand;
+        m_hand = (m_hand + 1) % m_slotCount;
+        if (!writeBack(slot)) {
+            return false;
+        }
+        drop(slot);
+
+        if (load) {
+            std::streamoff const offset = page * m_pageSize;
+            (void)m_stream->seekg(offset);
+            (void)m_stream->read(m_slots + slot * m_pageSize, pageBytes(page));
+            if (m_stream->fail()) {
+                return false;
+            }
+            if (m_advisor) {
+                m_advisor->read(offset, pageBytes(page));
+            }
+        }
+        m_slotOfPage[page] = slot;
+        m_pageOfSlot[slot] = page;
+        m_referenced[slot] = true;
+        return true;
+    }
+
+    bool
+    MappedImage::writeBack(std::size_t const slot)
+    {
+        if (!m_dirty[slot]) {
+            return true;
+        }
+        uint64_t const page = m_pageOfSlot[slot];
+        (void)m_stream->seekp(page * m_pageSize);
+        (void)m_stream->write(m_slots + slot * m_pageSize, pageBytes(page));
+        if (m_stream->fail()) {
+            return false;
+        }
+        m_dirty[slot] = false;
+        return true;
+    }
+
+    void
+    MappedImage::drop(std::size_t const slot)
+    {
+        if (m_pageOfSlot[slot] != NO_PAGE) {
+            (void)m_slotOfPage.erase(m_pageOfSlot[slot]);
+            m_pageOfSlot[slot] = NO_PAGE;
+        }
+        m_referenced[slot] = false;
+        m_dirty[slot] = false;
+    }
+
+    std::streamsize
+    MappedImage::pageBytes(uint64_t const page) const
+    {
+        return std::min(m_size, std::streamoff((page + 1) * m_pageSize)) - std::streamoff(page * m_pageSize);
+    }
+}
@@ -0,0 +1,448 @@
+/*
+  Copyright (c) <2013-2016>, <BenHJ>
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+  3. Neither the name of the copyright holder nor the names of its contributors
+  may be used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "knoxcrypt/VolumeBitMap.hpp"
+#include "knoxcrypt/detail/DetailBitMap.hpp"
+#include "knoxcrypt/detail/DetailKnoxCrypt.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace knoxcrypt
+{
+
+    namespace
+    {
+        /// when caching, how long dirty ranges can stay in memory before
+        /// they are written back as a side effect of the next update
+        std::chrono::seconds const WRITE_BACK_INTERVAL(5);
+
+        /// where the bitmap bytes start in the image
+        uint64_t bitMapOffset()
+        {
+            return detail::beginning() + 8 /* block count */;
+        }
+
+        /// the number of bitmap bytes covered by each group
+        uint64_t const GROUP_BYTES = VolumeBitMap::GROUP_BLOCKS / 8;
+    }
+
+    uint64_t const VolumeBitMap::GROUP_BLOCKS;
+
+    VolumeBitMap::VolumeBitMap()
+        : m_mutex()
+        , m_bitMap()
+        , m_dirtyRanges()
+        , m_groupFreeCounts()
+        , m_groupsWithFree()
+        , m_allocatedBlocks(0)
+        , m_stream()
+        , m_loaded(false)
+        , m_lastWriteBack(std::chrono::steady_clock::now())
+    {
+    }
+
+    VolumeBitMap::~VolumeBitMap()
+    {
+        sync();
+    }
+
+    void
+    VolumeBitMap::initImageStream(SharedCoreIO const &io)
+    {
+        if (!m_stream) {
+            m_stream = std::make_shared<ContainerImageStream>(io, std::ios::in | std::ios::out | std::ios::binary);
+        }
+    }
+
+    void
+    VolumeBitMap::refreshBytes(SharedCoreIO const &io, uint64_t const begin, uint64_t const end)
+    {
+        initImageStream(io);
+        if (end > begin) {
+            (void)m_stream->readAt((char*)&m_bitMap[begin], end - begin, bitMapOffset() + begin);
+            summariseGroups(begin, end);
+        }
+    }
+
+    uint64_t
+    VolumeBitMap::groupSize(uint64_t const group) const
+    {
+        return std::min(GROUP_BLOCKS, (m_bitMap.size() * 8) - (group * GROUP_BLOCKS));
+    }
+
+    void
+    VolumeBitMap::updateGroupWithFree(uint64_t const group)
+    {
+        detail::setBitInByte(m_groupsWithFree[group / 8], group % 8, m_groupFreeCounts[group] != 0);
+    }
+
+    void
+    VolumeBitMap::summariseGroups(uint64_t const begin, uint64_t const end)
+    {
+        uint64_t const lastGroup = (end + GROUP_BYTES - 1) / GROUP_BYTES;
+        for (uint64_t group = begin / GROUP_BYTES; group < lastGroup; ++group) {
+            uint64_t const byte = group * GROUP_BYTES;
+            uint64_t const bytes = std::min(GROUP_BYTES, m_bitMap.size() - byte);
+            uint64_t const allocated = detail::countSetBits(&m_bitMap[byte], bytes);
+            uint64_t const previouslyAllocated = groupSize(group) - m_groupFreeCounts[group];
+            m_allocatedBlocks = m_allocatedBlocks + allocated - previouslyAllocated;
+            m_groupFreeCounts[group] = uint32_t(groupSize(group) - allocated);
+            updateGroupWithFree(group);
+        }
+    }
+
+    uint64_t
+    VolumeBitMap::findFirstBlock(uint64_t const fromBlock, bool const set) const
+    {
+        uint64_t const groups = m_groupFreeCounts.size();
+        uint64_t group = fromBlock / GROUP_BLOCKS;
+        uint64_t from = fromBlock;
+        while (group < groups) {
+            // skip groups that can't contain what we're looking for
+            if (!set && m_groupFreeCounts[group] == 0) {
+                group = detail::findFirstBit(m_groupsWithFree.data(), m_groupsWithFree.size(), group + 1, true);
+                if (group == detail::NO_BIT) {
+                    return detail::NO_BIT;
+                }
+                from = group * GROUP_BLOCKS;
+                continue;
+            }
+            if (set && m_groupFreeCounts[group] == groupSize(group)) {
+                from = ++group * GROUP_BLOCKS;
+                continue;
+            }
+
+            uint64_t const byte = group * GROUP_BYTES;
+            uint64_t const bytes = std::min(GROUP_BYTES, m_bitMap.size() - byte);
+            uint64_t const bit = detail::findFirstBit(&m_bitMap[byte], bytes, from - (group * GROUP_BLOCKS), set);
+            if (bit != detail::NO_BIT) {
+                return (group * GROUP_BLOCKS) + bit;
+            }
+            from = ++group * GROUP_BLOCKS;
+        }
+        return detail::NO_BIT;
+    }
+
+    void
+    VolumeBitMap::checkAndLoad(SharedCoreIO const &io)
+    {
+        uint64_t const bytes = io->blocks / uint64_t(8);
+        if (!m_loaded || m_bitMap.size() != bytes) {
+            std::vector<uint8_t>(bytes, 0).swap(m_bitMap);
+            m_dirtyRanges.clear();
+
+            // summary of an all-free bitmap; corrected as bytes are read in
+            uint64_t const groups = (io->blocks + GROUP_BLOCKS - 1) / GROUP_BLOCKS;
+            m_groupFreeCounts.assign(groups, 0);
+            m_groupsWithFree.assign((groups + 7) / 8, 0);
+            for (uint64_t group = 0; group < groups; ++group) {
+                m_groupFreeCounts[group] = uint32_t(groupSize(group));
+                updateGroupWithFree(group);
+            }
+            m_allocatedBlocks = 0;
+
+            refreshBytes(io, 0, bytes);
+            m_loaded = true;
+        } else if (!io->useBlockCache) {
+            // image might have been updated via another io
+            refreshBytes(io, 0, bytes);
+        }
+    }
+
+    void
+    VolumeBitMap::checkAndLoadBytes(SharedCoreIO const &io, uint64_t const begin, uint64_t const end)
+    {
+        if (!m_loaded || io->useBlockCache) {
+            checkAndLoad(io);
+        } else {
+            refreshBytes(io, begin, std::min(end, uint64_t(m_bitMap.size())));
+        }
+    }
+
+    void
+    VolumeBitMap::markDirty(uint64_t const byte)
+    {
+        uint64_t begin = byte;
+        uint64_t end = byte + 1;
+
+        // merge with a range that ends at or contains this byte
+        auto it = m_dirtyRanges.upper_bound(byte);
+        if (it != m_dirtyRanges.begin()) {
+            auto prev = std::prev(it);
+            if (prev->second >= byte) {
+                begin = prev->first;
+                end = std::max(end, prev->second);
+                (void)m_dirtyRanges.erase(prev);
+            }
+        }
+
+        // merge with a range that starts immediately after
+        if (it != m_dirtyRanges.end() && it->first == end) {
+            end = it->second;
+            (void)m_dirtyRanges.erase(it);
+        }
+
+        m_dirtyRanges[begin] = end;
+    }
+
+    void
+    VolumeBitMap::doSetBlockInUse(uint64_t const block, bool const set)
+    {
+        uint64_t const byte = block / uint64_t(8);
+        assert(byte < m_bitMap.size());
+        uint8_t const before = m_bitMap[byte];
+        detail::setBitInByte(m_bitMap[byte], block % 8, set);
+        if (m_bitMap[byte] != before) {
+            markDirty(byte);
+            uint64_t const group = block / GROUP_BLOCKS;
+            if (set) {
+                --m_groupFreeCounts[group];
+                ++m_allocatedBlocks;
+            } else {
+                ++m_groupFreeCounts[group];
+                --m_allocatedBlocks;
+            }
+            updateGroupWithFree(group);
+        }
+    }
+
+    void
+    VolumeBitMap::checkAndWriteBack(SharedCoreIO const &io)
+    {
+        if (!io->useBlockCache ||
+            std::chrono::steady_clock::now() - m_lastWriteBack > WRITE_BACK_INTERVAL) {
+            doSync();
+        }
+    }
+
+    bool
+    VolumeBitMap::isBlockInUse(SharedCoreIO const &io, uint64_t const block)
+    {
+        BitMapLock lock(m_mutex);
+        uint64_t const byte = block / uint64_t(8);
+        checkAndLoadBytes(io, byte, byte + 1);
+        return detail::isBitSetInByte(m_bitMap[byte], block % 8);
+    }
+
+    std::vector<bool>
+    VolumeBitMap::areBlocksInUse(SharedCoreIO const &io,
+                                 std::vector<uint64_t> const &blocks)
+    {
+        BitMapLock lock(m_mutex);
+        std::vector<bool> inUse(blocks.size(), false);
+        if (blocks.empty()) {
+            return inUse;
+        }
+        auto minMax = std::minmax_element(blocks.begin(), blocks.end());
+        checkAndLoadBytes(io, *minMax.first / uint64_t(8), (*minMax.second / uint64_t(8)) + 1);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            inUse[i] = detail::isBitSetInByte(m_bitMap[blocks[i] / uint64_t(8)], blocks[i] % 8);
+        }
+        return inUse;
+    }
+
+    bool
+    VolumeBitMap::isRangeInUse(SharedCoreIO const &io, uint64_t const first, uint64_t const count)
+    {
+        BitMapLock lock(m_mutex);
+        if (count == 0) {
+            return true;
+        }
+        uint64_t const end = first + count;
+        uint64_t const endByte = ((end - 1) / uint64_t(8)) + 1;
+        checkAndLoadBytes(io, first / uint64_t(8), endByte);
+        assert(endByte <= m_bitMap.size());
+
+        // the search doesn't need to look beyond the range's final byte
+        uint64_t const bit = detail::findFirstUnsetBit(m_bitMap.data(), endByte, first);
+        return bit == detail::NO_BIT || bit >= end;
+    }
+
+    bool
+    VolumeBitMap::isRangeFree(SharedCoreIO const &io, uint64_t const first, uint64_t const count)
+    {
+        BitMapLock lock(m_mutex);
+        if (count == 0) {
+            return true;
+        }
+        uint64_t const end = first + count;
+        uint64_t const endByte = ((end - 1) / uint64_t(8)) + 1;
+        checkAndLoadBytes(io, first / uint64_t(8), endByte);
+        assert(endByte <= m_bitMap.size());
+
+        // the search doesn't need to look beyond the range's final byte
+        uint64_t const bit = detail::findFirstBit(m_bitMap.data(), endByte, first, true);
+        return bit == detail::NO_BIT || bit >= end;
+    }
+
+    void
+    VolumeBitMap::setBlockInUse(SharedCoreIO const &io, uint64_t const block, bool const set)
+    {
+        BitMapLock lock(m_mutex);
+        // only the byte that stores the bit needs to be current
+        uint64_t const byte = block / uint64_t(8);
+        checkAndLoadBytes(io, byte, byte + 1);
+        doSetBlockInUse(block, set);
+        checkAndWriteBack(io);
+    }
+
+    void
+    VolumeBitMap::setBlocksInUse(SharedCoreIO const &io,
+                                 std::vector<uint64_t> const &blocks,
+                                 bool const set)
+    {
+        BitMapLock lock(m_mutex);
+        if (blocks.empty()) {
+            return;
+        }
+        // only the span of bytes storing the bits needs to be current
+        auto minMax = std::minmax_element(blocks.begin(), blocks.end());
+        checkAndLoadBytes(io, *minMax.first / uint64_t(8), (*minMax.second / uint64_t(8)) + 1);
+        for (auto const & block : blocks) {
+            doSetBlockInUse(block, set);
+        }
+        checkAndWriteBack(io);
+    }
+
+    VolumeBitMap::OptionalBlock
+    VolumeBitMap::getNextAvailableBlock(SharedCoreIO const &io)
+    {
+        BitMapLock lock(m_mutex);
+        checkAndLoad(io);
+        uint64_t const bit = findFirstBlock(0, false);
+        if (bit == detail::NO_BIT) {
+            return OptionalBlock();
+        }
+        return OptionalBlock(bit);
+    }
+
+    std::vector<uint64_t>
+    VolumeBitMap::getNAvailableBlocks(SharedCoreIO const &io,
+                                      uint64_t const blocksRequired,
+                                      uint64_t const fromBlock)
+    {
+        BitMapLock lock(m_mutex);
+        checkAndLoad(io);
+        std::vector<uint64_t> available;
+        available.reserve(std::min(blocksRequired, (m_bitMap.size() * 8) - m_allocatedBlocks));
+        uint64_t bit = findFirstBlock(fromBlock, false);
+        while (available.size() < blocksRequired && bit != detail::NO_BIT) {
+            available.push_back(bit);
+            bit = findFirstBlock(bit + 1, false);
+        }
+        return available;
+    }
+
+    VolumeBitMap::OptionalBlock
+    VolumeBitMap::getAvailableRun(SharedCoreIO const &io,
+                                  uint64_t const runLength)
+    {
+        BitMapLock lock(m_mutex);
+        checkAndLoad(io);
+        uint64_t const first = findFirstBlock(0, false);
+        if (first == detail::NO_BIT) {
+            return OptionalBlock();
+        }
+        uint64_t const bit = detail::findFirstUnsetRun(m_bitMap.data(), m_bitMap.size(), runLength, first);
+        if (bit == detail::NO_BIT) {
+            return OptionalBlock();
+        }
+        return OptionalBlock(bit);
+    }
+
+    std::vector<VolumeBitMap::Extent>
+    VolumeBitMap::getFreeExtents(SharedCoreIO const &io,
+                                 uint64_t const fromBlock,
+                                 uint64_t const endBlock)
+    {
+        BitMapLock lock(m_mutex);
+        checkAndLoad(io);
+        std::vector<Extent> extents;
+        uint64_t const last = std::min(endBlock, uint64_t(m_bitMap.size() * 8));
+        uint64_t begin = findFirstBlock(fromBlock, false);
+        while (begin != detail::NO_BIT && begin < last) {
+            uint64_t end = findFirstBlock(begin, true);
+            if (end == detail::NO_BIT || end > last) {
+                end = last;
+            }
+            extents.emplace_back(begin, end - begin);
+            begin = findFirstBlock(end, false);
+        }
+        return extents;
+    }
+
+    uint64_t
+    VolumeBitMap::getNumberOfAllocatedBlocks(SharedCoreIO const &io)
+    {
+        BitMapLock lock(m_mutex);
+        checkAndLoad(io);
+        return m_allocatedBlocks;
+    }
+
+    uint64_t
+    VolumeBitMap::getFreeBlocksInGroup(SharedCoreIO const &io, uint64_t const group)
+    {
+        BitMapLock lock(m_mutex);
+        uint64_t const byte = group * GROUP_BYTES;
+        checkAndLoadBytes(io, byte, byte + GROUP_BYTES);
+        assert(group < m_groupFreeCounts.size());
+        return m_groupFreeCounts[group];
+    }
+
+    void
+    VolumeBitMap::sync()
+    {
+        BitMapLock lock(m_mutex);
+        doSync();
+    }
+
+    void
+    VolumeBitMap::doSync()
+    {
+        if (!m_dirtyRanges.empty() && m_stream) {
+            // dirty ranges that are close together are written as one; the
+            // clean bytes in between are current so rewriting them is harmless
+            // and cheaper than a separate encrypted write
+            auto it = m_dirtyRanges.begin();
+            while (it != m_dirtyRanges.end()) {
+                uint64_t const begin = it->first;
+                uint64_t end = it->second;
+                for (++it; it != m_dirtyRanges.end() && it->first - end < GROUP_BYTES; ++it) {
+                    end = it->second;
+                }
+                (void)m_stream->writeAt((char*)&m_bitMap[begin], end - begin, bitMapOffset() + begin);
+            }
+            m_stream->flush();
+            m_dirtyRanges.clear();
+        }
+        m_lastWriteBack = std::chrono::steady_clock::now();
+    }
+}
@@ -66,14 +66,18 @@ int main(int argc, char *argv[])
     namespace po = boost::program_options;
     bool magicPartition;
     bool sparse;
+    bool indexed;
+    uint64_t blockSize;
     std::string cipher;
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help", "produce help message")
         ("imageName", po::value<std::string>(), "knoxcrypt image path")
-        ("blockCount", po::value<uint64_t>(), "size of filesystem in 4096 blocks (12800 = 50MB)")
+        ("blockCount", po::value<uint64_t>(), "size of filesystem in blocks (12800 = 50MB with 4096 byte blocks)")
+        ("blockSize", po::value<uint64_t>(&blockSize)->default_value(4096), "size of each block; a power of two from 4096 to 1048576")
         ("coffee", po::value<bool>(&magicPartition)->default_value(false), "create alternative sub-volume")
         ("sparse", po::value<bool>(&sparse)->default_value(false), "create a sparse image")
+        ("indexed", po::value<bool>(&indexed)->default_value(false), "index file blocks by extent (faster seeking)")
         ("cipher", po::value<std::string>(&cipher)->default_value("aes"), "the cipher type used");
 
     po::positional_options_description positionalOptions;
@@ -111,13 +115,21 @@ int main(int argc, char *argv[])
                 exit(0);
             }
 
+            if(!knoxcrypt::detail::isValidBlockSize(blockSize)) {
+                std::cout<<"Error: block size must be a power of two from "<<knoxcrypt::detail::MIN_FILE_BLOCK_SIZE
+                         <<" to "<<knoxcrypt::detail::MAX_FILE_BLOCK_SIZE<<std::endl;
+                return 1;
+            }
+
             std::cout<<"image path: "<<vm["imageName"].as<std::string>()<<std::endl;
             std::cout<<"file system size in blocks: "<<vm["blockCount"].as<uint64_t>()<<std::endl;
+            std::cout<<"block size: "<<blockSize<<std::endl;
             std::cout<<"initialization vector A: "<<io->encProps.iv<<std::endl;
             std::cout<<"initialization vector B: "<<io->encProps.iv2<<std::endl;
             std::cout<<"initialization vector C: "<<io->encProps.iv3<<std::endl;
             std::cout<<"initialization vector D: "<<io->encProps.iv4<<std::endl;
             std::cout<<"Encryption algorithm: "<<cipher<<std::endl;
+            std::cout<<"indexed files: "<<(indexed ? "yes" : "no")<<std::endl;
         }
     } catch (...) {
         std::cout<<"Problem parsing options"<<std::endl;
@@ -130,6 +142,8 @@ int main(int argc, char *argv[])
     io->path = vm["imageName"].as<std::string>().c_str();
     io->blocks = blocks;
     io->freeBlocks = blocks;
+    io->indexedFiles = indexed;
+    io->blockSize = blockSize;
     io->encProps.password.append(knoxcrypt::utility::getPassword("knoxcrypt password: "));
     io->rounds = 64; // obsolete (not currently used; used to be used by XTEA)
 
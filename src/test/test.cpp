@@ -26,15 +26,21 @@
   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "test/ContainerImageStreamTest.hpp"
 #include "test/CoreFSTest.hpp"
+#include "test/ExtentAllocatorTest.hpp"
+#include "test/AllocationGroupsTest.hpp"
 #include "test/FileBlockTest.hpp"
+#include "test/FileBlockBuilderTest.hpp"
 #include "test/FileBlockIteratorTest.hpp"
 #include "test/FileTest.hpp"
 #include "test/FileDeviceTest.hpp"
+#include "test/IOQueueTest.hpp"
 #include "test/MakeKnoxCryptTest.hpp"
 #include "test/ContentFolderTest.hpp"
 #include "test/SimpleTest.hpp"
 #include "test/TestHelpers.hpp"
+#include "test/VolumeBitMapTest.hpp"
 
 #include <boost/progress.hpp>
 
@@ -49,9 +55,15 @@ int main()
         MakeKnoxCryptTest();
         FileDeviceTest();
         FileBlockTest();
+        FileBlockBuilderTest();
         FileBlockIteratorTest();
         FileTest();
         ContentFolderTest();
+        VolumeBitMapTest();
+        ExtentAllocatorTest();
+        AllocationGroupsTest();
+        ContainerImageStreamTest();
+        IOQueueTest();
     }
 
     simpletest::showResults();
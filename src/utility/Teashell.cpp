@@ -346,8 +346,10 @@ void parse(knoxcrypt::CoreFS &theBfs, std::string const &commandStr, std::string
     } else if (comTokens[0] == "help") {
         com_help();
     } else if (comTokens[0] == "quit") {
+        theBfs.unmount();
         exit(0);
     } else if (comTokens[0] == "exit") {
+        theBfs.unmount();
         exit(0);
     }
 }
@@ -646,15 +648,15 @@ int main(int argc, char *argv[])
 
     io->blocks = knoxcrypt::detail::getBlockCount(stream);
 
-    printf("Counting allocated blocks. Please wait...\n");
+    stream.close();
 
-    io->freeBlocks = io->blocks - knoxcrypt::detail::getNumberOfAllocatedBlocks(stream);
+    // a container that wasn't cleanly unmounted has its allocated blocks
+    // counted when the bitmap is first needed rather than up front
+    if (!knoxcrypt::detail::initFreeBlocksOnMount(io)) {
+        printf("Container was not cleanly unmounted; allocated blocks will be recounted.\n");
+    }
     io->blockBuilder = std::make_shared<knoxcrypt::FileBlockBuilder>(io);
 
-    printf("Finished counting allocated blocks.\n");
-
-    stream.close();
-
     // Create the basic file system
     knoxcrypt::CoreFS theBfs(io);
     return loop(theBfs);